@@ -0,0 +1,369 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+
+/* binary snapshot format
+
+   All integers are unsigned LEB128 varints, signed ones zigzag-encoded.
+
+   file:    magic "POOL" 'b', version, symbol table, base directory (atoms), dir
+   symbols: count, then per symbol: byte length, bytes
+   atoms:   count, then per atom a tag with the type in the lower two bits:
+            0 integer (value in the upper bits), 1 symbol (table index in the upper bits),
+            2 float (32 bit, little endian, follows), 6 double (64 bit, little endian, follows)
+   dir:     mode (atoms, empty for hash),
+            chunk count, chunks (atoms),
+            value count, values (key atoms, data atoms),
+            subdirectory count, subdirectories (name atom, dir)
+
+   The counts precede the items, so that the tables can be sized before loading.
+*/
+
+static const char binmagic[5] = { 'P','O','O','L','b' };
+static const int binversion = 1;
+
+enum { bin_int = 0,bin_sym = 1,bin_float = 2,bin_double = 6 };
+
+class poolbinwriter
+{
+public:
+	void Varint(unsigned long long v)
+	{
+		for(; v >= 0x80; v >>= 7) buf += (char)((v&0x7f)|0x80);
+		buf += (char)v;
+	}
+
+	void Atom(const t_atom &a);
+	void Atoms(int argc,const t_atom *argv)
+	{
+		Varint(argc);
+		for(int i = 0; i < argc; ++i) Atom(argv[i]);
+	}
+	void Atoms(const flext::AtomList &l) { Atoms(l.Count(),l.Atoms()); }
+
+	bool Write(ostream &os);
+
+	string buf;
+
+protected:
+	void Raw(unsigned long long v,int bytes)
+	{
+		for(int i = 0; i < bytes; ++i,v >>= 8) buf += (char)(v&0xff);
+	}
+
+	// symbols in order of first appearance
+	map<const t_symbol *,int> symix;
+	vector<const t_symbol *> syms;
+};
+
+void poolbinwriter::Atom(const t_atom &a)
+{
+	if(flext::IsSymbol(a)) {
+		const t_symbol *s = flext::GetSymbol(a);
+		map<const t_symbol *,int>::iterator it = symix.find(s);
+		int ix;
+		if(it == symix.end()) {
+			ix = (int)syms.size();
+			symix[s] = ix;
+			syms.push_back(s);
+		}
+		else
+			ix = it->second;
+		Varint(((unsigned long long)ix<<2)|bin_sym);
+	}
+	else if(flext::IsInt(a)) {
+		int i = flext::GetInt(a);
+		Varint(((unsigned long long)(((unsigned int)i<<1)^(unsigned int)(i>>31))<<2)|bin_int);
+	}
+	else if(flext::IsFloat(a)) {
+		double d = flext::GetFloat(a);
+		float f = (float)d;
+		int i = (int)f;
+		union { float f; unsigned int u; } fu,iu;
+		fu.f = f,iu.f = (float)i;
+
+		if(f == d && f >= -(1<<30) && f < (1<<30) && fu.u == iu.u)
+			// integral (and not -0), store compactly
+			Varint(((unsigned long long)(((unsigned int)i<<1)^(unsigned int)(i>>31))<<2)|bin_int);
+		else if(f == d) {
+			Varint(bin_float);
+			Raw(fu.u,4);
+		}
+		else {
+			// double precision floats
+			union { double d; unsigned long long u; } du;
+			du.d = d;
+			Varint(bin_double);
+			Raw(du.u,8);
+		}
+	}
+	else {
+		FLEXT_ASSERT(false);
+		Varint(bin_int);
+	}
+}
+
+bool poolbinwriter::Write(ostream &os)
+{
+	string body;
+	body.swap(buf);
+
+	buf.append(binmagic,sizeof binmagic);
+	Varint(binversion);
+	Varint(syms.size());
+	for(size_t i = 0; i < syms.size(); ++i) {
+		const char *s = flext::GetString(syms[i]);
+		size_t l = strlen(s);
+		Varint(l);
+		buf.append(s,l);
+	}
+
+	os.write(buf.data(),buf.size());
+	os.write(body.data(),body.size());
+	buf.swap(body);
+	return os.good();
+}
+
+
+class poolbinreader
+{
+public:
+	poolbinreader(const char *buf,size_t len): ok(true),p((const unsigned char *)buf),e((const unsigned char *)buf+len) {}
+
+	bool Header();
+
+	unsigned long long Varint()
+	{
+		unsigned long long v = 0;
+		for(int sh = 0; p < e && sh < 64; sh += 7) {
+			unsigned char c = *p++;
+			v |= (unsigned long long)(c&0x7f)<<sh;
+			if(!(c&0x80)) return v;
+		}
+		ok = false;
+		return 0;
+	}
+
+	// item count, checked against the remaining size (each item takes at least a byte)
+	int Count()
+	{
+		unsigned long long n = Varint();
+		if(n > (unsigned long long)(e-p)) ok = false;
+		return ok?(int)n:0;
+	}
+
+	bool Atom(t_atom &a);
+	bool Atoms(flext::AtomList &l)
+	{
+		int n = Count();
+		l(n);
+		for(int i = 0; i < n; ++i)
+			if(!Atom(l[i])) return false;
+		return ok;
+	}
+
+	// read over a directory and its subdirectories
+	bool SkipDir();
+
+	bool ok;
+
+protected:
+	unsigned long long Raw(int bytes)
+	{
+		if(e-p < bytes) { ok = false; return 0; }
+		unsigned long long v = 0;
+		for(int i = 0; i < bytes; ++i) v |= (unsigned long long)*p++<<(i*8);
+		return v;
+	}
+
+	const unsigned char *p,*e;
+	vector<const t_symbol *> syms;
+};
+
+bool poolbinreader::Header()
+{
+	if(e-p < (int)sizeof binmagic || memcmp(p,binmagic,sizeof binmagic)) {
+		post("pool - file is not in binary pool format");
+		return ok = false;
+	}
+	p += sizeof binmagic;
+
+	int ver = (int)Varint();
+	if(ok && ver > binversion) {
+		post("pool - binary file version %i not supported",ver);
+		return ok = false;
+	}
+
+	int n = Count();
+	syms.resize(n);
+	string s;
+	for(int i = 0; ok && i < n; ++i) {
+		unsigned long long l = Varint();
+		if(l > (unsigned long long)(e-p)) { ok = false; break; }
+		s.assign((const char *)p,(size_t)l);
+		p += l;
+		syms[i] = flext::MakeSymbol(s.c_str());
+	}
+	return ok;
+}
+
+bool poolbinreader::Atom(t_atom &a)
+{
+	unsigned long long t = Varint();
+	switch(t&3) {
+	case bin_int: {
+		unsigned int z = (unsigned int)(t>>2);
+		flext::SetInt(a,(int)(z>>1)^-(int)(z&1));
+		break;
+	}
+	case bin_sym:
+		if((t>>2) < syms.size())
+			flext::SetSymbol(a,syms[(size_t)(t>>2)]);
+		else
+			ok = false;
+		break;
+	default:
+		if(t == bin_float) {
+			union { float f; unsigned int u; } fu;
+			fu.u = (unsigned int)Raw(4);
+			flext::SetFloat(a,fu.f);
+		}
+		else if(t == bin_double) {
+			union { double d; unsigned long long u; } du;
+			du.u = Raw(8);
+			flext::SetFloat(a,(t_float)du.d);
+		}
+		else
+			ok = false;
+	}
+	return ok;
+}
+
+bool poolbinreader::SkipDir()
+{
+	::Atoms l;
+	Atoms(l);
+	for(int i = Count(); ok && i; --i) Atoms(l);
+	for(int i = Count(); ok && i; --i) Atoms(l),Atoms(l);
+	for(int i = Count(); ok && i; --i) {
+		t_atom d;
+		Atom(d);
+		SkipDir();
+	}
+	return ok;
+}
+
+
+void pooldir::SvDirBinRec(poolbinwriter &wr,int depth)
+{
+	Atoms m;
+	if(GetMode() != poolstore::mode_hash) GetMode(m);
+	wr.Atoms(m);
+
+	int chunks = vals->Chunks();
+	wr.Varint(chunks);
+	for(int ci = 0; ci < chunks; ++ci) {
+		Atoms c;
+		vals->GetChunk(ci,c);
+		wr.Atoms(c);
+	}
+
+	// packed series store all their values in the chunks
+	wr.Varint(chunks?0:CntAll());
+	if(!chunks) {
+		for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+			poolkey k = ix->Key();
+			wr.Atoms(k.cnt,k.atoms);
+			wr.Atoms(*ix->data);
+		}
+	}
+
+	wr.Varint(depth?subcnt:0);
+	if(depth) {
+		int nd = depth > 0?depth-1:-1;
+		for(int di = 0; di < DTSize(); ++di) {
+			for(pooldir *ix = dirs[di].d; ix; ix = ix->nxt) {
+				wr.Atom(ix->dir);
+				ix->SvDirBinRec(wr,nd);
+			}
+		}
+	}
+}
+
+bool pooldir::SvDirBin(ostream &os,int depth,const AtomList &dir)
+{
+	poolbinwriter wr;
+	wr.Atoms(dir);
+	SvDirBinRec(wr,depth);
+	return wr.Write(os);
+}
+
+bool pooldir::LdDirBinRec(poolbinreader &rd,int depth,bool mkdir,int level)
+{
+	Atoms m;
+	if(rd.Atoms(m) && m.Count() && !SetMode(m))
+		post("pool - binary file: unknown directory mode");
+
+	for(int n = rd.Count(); rd.ok && n; --n) {
+		Atoms c;
+		if(rd.Atoms(c) && !AddChunk(c))
+			post("pool - binary file: bad value chunk");
+	}
+
+	int n = rd.Count();
+	if(n > 1) Reserve(CntAll()+n,0);
+	for(; rd.ok && n; --n) {
+		Atoms k,*v = new Atoms;
+		if(rd.Atoms(k) && rd.Atoms(*v) && k.Count()) {
+			SetVal(k,v); v = NULL;
+		}
+		if(v) delete v;
+	}
+
+	n = rd.Count();
+	if(mkdir) Reserve(0,CntSub()+n);
+	for(; rd.ok && n; --n) {
+		t_atom d;
+		if(!rd.Atom(d)) break;
+
+		pooldir *nd = NULL;
+		if(depth < 0 || level < depth)
+			nd = mkdir?AddDir(1,&d):GetDir(1,&d);
+		if(nd)
+			nd->LdDirBinRec(rd,depth,mkdir,level+1);
+		else
+			rd.SkipDir();
+	}
+	return rd.ok;
+}
+
+bool pooldir::LdDirBin(const char *buf,size_t len,int depth,bool mkdir)
+{
+	poolbinreader rd(buf,len);
+	if(!rd.Header()) return false;
+
+	// directory the data has been saved from (with absdir)
+	Atoms d;
+	if(!rd.Atoms(d)) return false;
+
+	pooldir *nd = NULL;
+	if(depth < 0 || d.Count() <= depth)
+		nd = mkdir?AddDir(d):GetDir(d);
+	bool ok = nd?nd->LdDirBinRec(rd,depth,mkdir,d.Count()):rd.SkipDir();
+
+	if(!ok) post("pool - binary file is corrupt");
+	return ok;
+}
@@ -0,0 +1,147 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <sys/stat.h>
+
+using namespace std;
+
+
+// total size of the cached files, the least recently used trees are dropped beyond it
+#ifndef POOL_CACHESIZE
+#define POOL_CACHESIZE (64<<20)
+#endif
+
+// number of files remembered as loaded once
+#ifndef POOL_CACHEFILES
+#define POOL_CACHEFILES 256
+#endif
+
+struct poolcached
+{
+	poolcached(): tree(NULL),size(0),use(0) {}
+
+	// state of the file when it was loaded
+	long long mtime,fsize;
+	pooldir *tree;
+	size_t size;
+	unsigned long use;
+};
+
+// file name (prefixed by the format and the string setting) -> tree
+typedef map<string,poolcached> poolcachemap;
+
+// only used from the main thread
+static poolcachemap cache;
+static size_t cachesize = 0;
+static unsigned long cacheuse = 0;
+
+// seconds alone would miss writes within the same second
+long long poolcache::MTime(const struct stat &st)
+{
+#if FLEXT_OS == FLEXT_OS_LINUX
+	return (long long)st.st_mtim.tv_sec*1000000000+st.st_mtim.tv_nsec;
+#elif FLEXT_OS == FLEXT_OS_MAC
+	return (long long)st.st_mtimespec.tv_sec*1000000000+st.st_mtimespec.tv_nsec;
+#else
+	return (long long)st.st_mtime*1000000000;
+#endif
+}
+
+// trees are parsed with pool-owned strings or real symbols, as the loading pool has it (see poolstrings::Use)
+static string CacheKey(const char *flnm,bool xml,bool own = poolstrings::Active())
+{
+	return string(xml?"x":"t")+(own?"o":"s")+flnm;
+}
+
+static void Free(poolcached &c)
+{
+	if(c.tree) {
+		delete c.tree;
+		c.tree = NULL;
+		cachesize -= c.size;
+		c.size = 0;
+	}
+}
+
+// drop the least recently used entries (with trees, if trees is set)
+static void Evict(bool trees)
+{
+	for(;;) {
+		if(trees?cachesize <= POOL_CACHESIZE:cache.size() <= POOL_CACHEFILES) break;
+
+		poolcachemap::iterator o = cache.end();
+		for(poolcachemap::iterator it = cache.begin(); it != cache.end(); ++it)
+			if((!trees || it->second.tree) && (o == cache.end() || it->second.use < o->second.use)) o = it;
+		if(o == cache.end()) break;
+
+		Free(o->second);
+		cache.erase(o);
+	}
+}
+
+pooldir *poolcache::Get(const char *flnm,bool xml,bool &build)
+{
+	build = false;
+
+	struct stat st;
+	if(stat(flnm,&st)) return NULL;
+
+	pair<poolcachemap::iterator,bool> r = cache.insert(poolcachemap::value_type(CacheKey(flnm,xml),poolcached()));
+	poolcached &c = r.first->second;
+	c.use = ++cacheuse;
+	if(!r.second && c.mtime == MTime(st) && c.fsize == (long long)st.st_size) {
+		if(c.tree) return c.tree;
+		// loaded before, unchanged
+		build = true;
+	}
+	else {
+		// new or changed
+		Free(c);
+		c.mtime = MTime(st);
+		c.fsize = (long long)st.st_size;
+		Evict(false);
+	}
+	return NULL;
+}
+
+bool poolcache::Has(const char *flnm,bool xml)
+{
+	poolcachemap::iterator it = cache.find(CacheKey(flnm,xml));
+	if(it == cache.end() || !it->second.tree) return false;
+
+	struct stat st;
+	return !stat(flnm,&st) && it->second.mtime == MTime(st) && it->second.fsize == (long long)st.st_size;
+}
+
+void poolcache::Put(const char *flnm,bool xml,pooldir *t,size_t size)
+{
+	poolcachemap::iterator it = cache.find(CacheKey(flnm,xml));
+	if(it == cache.end() || size > POOL_CACHESIZE) {
+		delete t;
+		return;
+	}
+
+	Free(it->second);
+	it->second.tree = t;
+	it->second.size = size;
+	cachesize += size;
+	Evict(true);
+}
+
+void poolcache::Drop(const char *flnm)
+{
+	for(int xml = 0; xml < 2; ++xml)
+		for(int own = 0; own < 2; ++own) {
+			poolcachemap::iterator it = cache.find(CacheKey(flnm,xml != 0,own != 0));
+			if(it != cache.end()) {
+				Free(it->second);
+				cache.erase(it);
+			}
+		}
+}
@@ -0,0 +1,404 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef POOL_ZLIB
+#include <zlib.h>
+#endif
+#ifdef POOL_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef POOL_THREADS
+#include <deque>
+#endif
+
+using namespace std;
+
+
+/* compressed pool files
+
+   Files are saved compressed if their name ends in .gz (gzip) or .zst (zstd).
+   When loading, compressed data is recognized by its magic bytes, whatever the name,
+   and decompressed into memory as a whole.
+   Support is compiled in with POOL_ZLIB and POOL_ZSTD defined (linking zlib and libzstd).
+*/
+
+// compression levels, fast ones so that saving isn't held up
+#ifndef POOL_GZLEVEL
+#define POOL_GZLEVEL 1
+#endif
+
+#ifndef POOL_ZSTDLEVEL
+#define POOL_ZSTDLEVEL 1
+#endif
+
+// buffer size for data to compress and compressed data
+#define POOL_ZBUF (1<<16)
+
+// blocks waiting for the compressing thread
+#define POOL_ZQUEUE 8
+
+int ZipKind(const char *data,size_t len)
+{
+	const unsigned char *d = (const unsigned char *)data;
+	if(len >= 2 && d[0] == 0x1f && d[1] == 0x8b) return zip_gzip;
+	if(len >= 4 && d[0] == 0x28 && d[1] == 0xb5 && d[2] == 0x2f && d[3] == 0xfd) return zip_zstd;
+	return zip_none;
+}
+
+int ZipKind(const char *flnm)
+{
+	size_t n = strlen(flnm);
+	if(n >= 3 && !strcmp(flnm+n-3,".gz")) return zip_gzip;
+	if(n >= 4 && !strcmp(flnm+n-4,".zst")) return zip_zstd;
+	return zip_none;
+}
+
+static bool ZipSupported(int kind)
+{
+	switch(kind) {
+#ifdef POOL_ZLIB
+	case zip_gzip: return true;
+#endif
+#ifdef POOL_ZSTD
+	case zip_zstd: return true;
+#endif
+	default:
+		post("pool - %s compression is not supported by this build",kind == zip_gzip?"gzip":"zstd");
+		return false;
+	}
+}
+
+bool Unzip(int kind,const char *data,size_t len,char *&res,size_t &reslen)
+{
+	if(!ZipSupported(kind)) return false;
+
+	// output grows as needed, starting from a guess
+	size_t sz = len*4+POOL_ZBUF,n = 0;
+	char *buf = (char *)malloc(sz);
+	bool ok = buf != NULL;
+
+#ifdef POOL_ZLIB
+	if(ok && kind == zip_gzip) {
+		z_stream zs;
+		memset(&zs,0,sizeof zs);
+		// gzip header, several members may follow each other
+		ok = inflateInit2(&zs,15+16) == Z_OK;
+		zs.next_in = (Bytef *)data;
+		zs.avail_in = 0;
+		size_t left = len;
+		while(ok) {
+			if(!zs.avail_in) {
+				if(!left) {
+					// input ends within a member
+					ok = false;
+					break;
+				}
+				zs.avail_in = left > (1u<<30)?(1u<<30):(uInt)left;
+				left -= zs.avail_in;
+			}
+			if(n == sz) {
+				char *nb = (char *)realloc(buf,sz *= 2);
+				if(!nb) { ok = false; break; }
+				buf = nb;
+			}
+			size_t avail = sz-n > (1u<<30)?(1u<<30):sz-n;
+			zs.next_out = (Bytef *)buf+n;
+			zs.avail_out = (uInt)avail;
+			int r = inflate(&zs,Z_NO_FLUSH);
+			n += avail-zs.avail_out;
+			if(r == Z_STREAM_END) {
+				if(!zs.avail_in && !left) break;
+				ok = inflateReset(&zs) == Z_OK;
+			}
+			else if(r != Z_OK && r != Z_BUF_ERROR)
+				ok = false;
+		}
+		inflateEnd(&zs);
+	}
+#endif
+#ifdef POOL_ZSTD
+	if(ok && kind == zip_zstd) {
+		ZSTD_DStream *zd = ZSTD_createDStream();
+		ok = zd != NULL;
+		ZSTD_inBuffer ib = { data,len,0 };
+		size_t r = 0;
+		while(ok && (ib.pos < ib.size || r)) {
+			if(n == sz) {
+				char *nb = (char *)realloc(buf,sz *= 2);
+				if(!nb) { ok = false; break; }
+				buf = nb;
+			}
+			ZSTD_outBuffer ob = { buf+n,sz-n,0 };
+			r = ZSTD_decompressStream(zd,&ob,&ib);
+			n += ob.pos;
+			if(ZSTD_isError(r) || (r && ib.pos == ib.size && ob.pos < ob.size))
+				// corrupt or truncated
+				ok = false;
+		}
+		if(zd) ZSTD_freeDStream(zd);
+	}
+#endif
+
+	if(!ok) {
+		if(buf) free(buf);
+		return false;
+	}
+	res = buf;
+	reslen = n;
+	return true;
+}
+
+
+// stream buffer compressing into another stream
+// with threads, compression runs alongside the formatting of the data
+class poolzbuf:
+	public std::streambuf
+{
+public:
+	poolzbuf(ostream &o,int k);
+	~poolzbuf();
+
+	bool Ok() const { return ok; }
+	// write the end of the compressed data
+	bool Finish();
+
+protected:
+	virtual int_type overflow(int_type c);
+	virtual streamsize xsputn(const char *s,streamsize n);
+	virtual int sync() { return Drain()?0:-1; }
+
+	// compress the buffered data
+	bool Drain();
+	// hand data over for compression
+	bool Feed(const char *s,size_t n);
+	bool Put(const char *s,size_t n,bool end);
+
+	ostream &os;
+	int kind;
+	bool ok;
+	char in[POOL_ZBUF],out[POOL_ZBUF];
+#ifdef POOL_ZLIB
+	z_stream zs;
+#endif
+#ifdef POOL_ZSTD
+	ZSTD_CStream *zc;
+#endif
+
+#ifdef POOL_THREADS
+	void Work();
+	void Stop();
+
+	thread worker;
+	mutex mtx;
+	condition_variable cond;
+	deque<string> queue;
+	bool done;
+#endif
+};
+
+poolzbuf::poolzbuf(ostream &o,int k):
+	os(o),kind(k),ok(false)
+{
+	setp(in,in+sizeof in);
+#ifdef POOL_ZLIB
+	if(kind == zip_gzip) {
+		memset(&zs,0,sizeof zs);
+		ok = deflateInit2(&zs,POOL_GZLEVEL,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY) == Z_OK;
+	}
+#endif
+#ifdef POOL_ZSTD
+	zc = NULL;
+	if(kind == zip_zstd) {
+		zc = ZSTD_createCStream();
+		ok = zc && !ZSTD_isError(ZSTD_CCtx_setParameter(zc,ZSTD_c_compressionLevel,POOL_ZSTDLEVEL));
+	}
+#endif
+
+#ifdef POOL_THREADS
+	done = false;
+	if(ok && thread::hardware_concurrency() > 1) {
+		// otherwise compress in place
+		try { worker = thread(&poolzbuf::Work,this); }
+		catch(...) {}
+	}
+#endif
+}
+
+poolzbuf::~poolzbuf()
+{
+#ifdef POOL_THREADS
+	Stop();
+#endif
+#ifdef POOL_ZLIB
+	if(kind == zip_gzip) deflateEnd(&zs);
+#endif
+#ifdef POOL_ZSTD
+	if(zc) ZSTD_freeCStream(zc);
+#endif
+}
+
+bool poolzbuf::Drain()
+{
+	size_t n = pptr()-pbase();
+	setp(in,in+sizeof in);
+	return !n || Feed(in,n);
+}
+
+bool poolzbuf::Feed(const char *s,size_t n)
+{
+#ifdef POOL_THREADS
+	if(worker.joinable()) {
+		// errors show when finishing
+		unique_lock<mutex> lock(mtx);
+		while(queue.size() >= POOL_ZQUEUE) cond.wait(lock);
+		queue.push_back(string(s,n));
+		cond.notify_all();
+		return true;
+	}
+#endif
+	return Put(s,n,false);
+}
+
+#ifdef POOL_THREADS
+void poolzbuf::Work()
+{
+	// the compressor and the output stream are only used here while the thread runs
+	for(;;) {
+		string blk;
+		{
+			unique_lock<mutex> lock(mtx);
+			while(!done && queue.empty()) cond.wait(lock);
+			if(queue.empty()) return;
+			blk.swap(queue.front());
+			queue.pop_front();
+		}
+		cond.notify_all();
+		Put(blk.data(),blk.size(),false);
+	}
+}
+
+void poolzbuf::Stop()
+{
+	if(worker.joinable()) {
+		{
+			lock_guard<mutex> lock(mtx);
+			done = true;
+		}
+		cond.notify_all();
+		worker.join();
+	}
+}
+#endif
+
+poolzbuf::int_type poolzbuf::overflow(int_type c)
+{
+	if(!Drain()) return traits_type::eof();
+	if(!traits_type::eq_int_type(c,traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+streamsize poolzbuf::xsputn(const char *s,streamsize n)
+{
+	// large blocks (as written by poolwriter) are compressed without copying
+	if(n < (streamsize)sizeof in) return streambuf::xsputn(s,n);
+	return Drain() && Feed(s,(size_t)n)?n:0;
+}
+
+bool poolzbuf::Put(const char *s,size_t n,bool end)
+{
+	if(!ok) return false;
+
+#ifdef POOL_ZLIB
+	if(kind == zip_gzip) {
+		zs.next_in = (Bytef *)s;
+		do {
+			uInt cnt = n > (1u<<30)?(1u<<30):(uInt)n;
+			zs.avail_in = cnt;
+			n -= cnt;
+			bool fin = end && !n;
+			int r;
+			do {
+				zs.next_out = (Bytef *)out;
+				zs.avail_out = sizeof out;
+				r = deflate(&zs,fin?Z_FINISH:Z_NO_FLUSH);
+				if(r == Z_STREAM_ERROR) return ok = false;
+				size_t have = sizeof out-zs.avail_out;
+				if(have && !os.write(out,have)) return ok = false;
+			} while(fin?r != Z_STREAM_END:!zs.avail_out);
+		} while(n);
+	}
+#endif
+#ifdef POOL_ZSTD
+	if(kind == zip_zstd) {
+		ZSTD_inBuffer ib = { s,n,0 };
+		for(;;) {
+			ZSTD_outBuffer ob = { out,sizeof out,0 };
+			size_t r = ZSTD_compressStream2(zc,&ob,&ib,end?ZSTD_e_end:ZSTD_e_continue);
+			if(ZSTD_isError(r)) return ok = false;
+			if(ob.pos && !os.write(out,ob.pos)) return ok = false;
+			if(end?!r:ib.pos == ib.size) break;
+		}
+	}
+#endif
+	return true;
+}
+
+bool poolzbuf::Finish()
+{
+	bool ret = Drain();
+#ifdef POOL_THREADS
+	Stop();
+#endif
+	return ret && Put(NULL,0,true);
+}
+
+
+poolostream::poolostream(const char *flnm,bool binary):
+	ostream(NULL),zbuf(NULL)
+{
+	int kind = ZipKind(flnm);
+	if(kind && !ZipSupported(kind)) {
+		setstate(badbit);
+		return;
+	}
+
+	file.open(flnm,binary || kind?ios::out|ios::binary:ios::out);
+	if(kind) {
+		zbuf = new poolzbuf(file,kind);
+		rdbuf(zbuf);
+		if(!zbuf->Ok()) setstate(badbit);
+	}
+	else
+		rdbuf(file.rdbuf());
+	if(!file.is_open()) setstate(badbit);
+}
+
+poolostream::~poolostream()
+{
+	if(zbuf) {
+		rdbuf(NULL);
+		delete zbuf;
+	}
+}
+
+bool poolostream::Close()
+{
+	bool ok = good();
+	if(zbuf) ok = ok && zbuf->Finish();
+	else ok = ok && flush().good();
+	file.close();
+	return ok && !file.fail();
+}
@@ -16,21 +16,27 @@ using namespace std;
 
 pooldata::pooldata(const t_symbol *s,int vcnt,int dcnt):
 	sym(s),nxt(NULL),refs(0),
-	root(nullatom,NULL,vcnt,dcnt)
+	root(nullatom,NULL,vcnt,dcnt),
+	image(NULL),journal(NULL),shards(NULL)
 {
 	FLEXT_LOG1("new pool %s",sym?flext_base::GetString(sym):"<private>");
 }
 
 pooldata::~pooldata()
 {
+	if(shards) delete shards;
+	if(journal) delete journal;
+	if(image) delete image;
 	FLEXT_LOG1("free pool %s",sym?flext_base::GetString(sym):"<private>");
 }
 
 
 const t_atom pooldata::nullatom = { A_NULL };
 
-int pooldata::GetAll(const AtomList &d,t_atom *&keys,Atoms *&lst)
+int pooldata::GetAll(const AtomList &d,Atoms *&keys,Atoms *&lst)
 {
+	if(image) return image->GetAll(image->Dir(d),keys,lst);
+
 	pooldir *pd = root.GetDir(d);
 	if(pd)
 		return pd->GetAll(keys,lst);
@@ -40,19 +46,37 @@ int pooldata::GetAll(const AtomList &d,t_atom *&keys,Atoms *&lst)
 	}
 }
 
+int pooldata::GetRange(const AtomList &d,double t0,double t1,Atoms *&keys,Atoms *&lst)
+{
+	pooldir *pd = image?NULL:root.GetDir(d);
+	if(pd)
+		return pd->GetRange(t0,t1,keys,lst);
+	else {
+		keys = NULL; lst = NULL;
+		return -1;
+	}
+}
+
 int pooldata::PrintAll(const AtomList &d)
 {
     char tmp[1024];
     d.Print(tmp,sizeof tmp);
-    pooldir *pd = root.GetDir(d);
     strcat(tmp," , ");
-	int cnt = pd?pd->PrintAll(tmp,sizeof tmp):0;
+	int cnt;
+	if(image)
+		cnt = image->PrintAll(image->Dir(d),tmp,sizeof tmp);
+	else {
+		pooldir *pd = root.GetDir(d);
+		cnt = pd?pd->PrintAll(tmp,sizeof tmp):0;
+	}
     if(!cnt) post(tmp);
     return cnt;
 }
 
 int pooldata::GetSub(const AtomList &d,const t_atom **&dirs)
 {
+	if(image) return image->GetSub(image->Dir(d),dirs);
+
 	pooldir *pd = root.GetDir(d);
 	if(pd)
 		return pd->GetSub(dirs);
@@ -65,14 +89,25 @@ int pooldata::GetSub(const AtomList &d,const t_atom **&dirs)
 
 bool pooldata::Paste(const AtomList &d,const pooldir *clip,int depth,bool repl,bool mkdir)
 {
-	pooldir *pd = root.GetDir(d);
-	return pd && pd->Paste(clip,depth,repl,mkdir);
+	pooldir *pd = WrDir(d);
+	if(!pd) return false;
+	if(journal) journal->Paste(d,clip,depth,repl,mkdir);
+	return pd->Paste(clip,depth,repl,mkdir);
 }
 
-pooldir *pooldata::Copy(const AtomList &d,const t_atom &key,bool cut)
+pooldir *pooldata::Copy(const AtomList &d,const poolkey &key,bool cut)
 {
+	if(image) {
+		poolval *r = cut?NULL:image->Ref(image->Dir(d),key);
+		if(!r) return NULL;
+		pooldir *ret = new pooldir(nullatom,NULL,root.VSize(),root.DSize());
+		ret->SetVal(key,new Atoms(*r->data));
+		return ret;
+	}
+
 	pooldir *pd = root.GetDir(d);
 	if(pd) {
+		if(cut && journal) journal->Clr(d,key);
 		AtomList *val = pd->GetVal(key,cut);
 		if(val) {
 			pooldir *ret = new pooldir(nullatom,NULL,pd->VSize(),pd->DSize());
@@ -88,8 +123,21 @@ pooldir *pooldata::Copy(const AtomList &d,const t_atom &key,bool cut)
 
 pooldir *pooldata::CopyAll(const AtomList &d,int depth,bool cut)
 {
+	if(image) {
+		size_t id = cut?0:image->Dir(d);
+		if(!id) return NULL;
+		pooldir *ret = new pooldir(nullatom,NULL,root.VSize(),root.DSize());
+		if(image->Copy(id,ret,depth))
+			return ret;
+		else {
+			delete ret;
+			return NULL;
+		}
+	}
+
 	pooldir *pd = root.GetDir(d);
 	if(pd) {
+		if(cut && journal) journal->CutAll(d,depth);
 		// What sizes should we choose here?
 		pooldir *ret = new pooldir(nullatom,NULL,pd->VSize(),pd->DSize());
 		if(pd->Copy(ret,depth,cut))
@@ -103,6 +151,28 @@ pooldir *pooldata::CopyAll(const AtomList &d,int depth,bool cut)
 		return NULL;
 }
 
+pooldata *pooldata::Snapshot(const AtomList &d,int depth)
+{
+	pooldata *snap = new pooldata(NULL,root.VSize(),root.DSize());
+	pooldir *sd = snap->root.AddDir(d);
+
+	bool ok;
+	if(image) {
+		size_t id = image->Dir(d);
+		ok = id && image->Copy(id,sd,depth);
+	}
+	else {
+		pooldir *pd = root.GetDir(d);
+		ok = pd && pd->Copy(sd,depth,false);
+	}
+
+	if(!ok) {
+		delete snap;
+		return NULL;
+	}
+	return snap;
+}
+
 
 static const char *CnvFlnm(char *dst,const char *src,int sz)
 {
@@ -118,15 +188,35 @@ static const char *CnvFlnm(char *dst,const char *src,int sz)
 #endif
 }
 
-bool pooldata::LdDir(const AtomList &d,const char *flnm,int depth,bool mkdir)
+bool pooldata::Cached(const char *flnm,bool xml) const
 {
-	pooldir *pd = root.GetDir(d);
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	return t && !journal && poolcache::Has(t,xml);
+}
+
+bool pooldata::LdDir(const AtomList &d,const char *flnm,int depth,bool mkdir,const poolfilter *flt)
+{
+	pooldir *pd = WrDir(d);
 	if(pd) {
 		char tmp[1024]; // CnvFlnm checks for size of string buffer
 		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
 		if(t) {
-			ifstream file(t);
-			return file.good() && pd->LdDir(file,depth,mkdir);
+			// the cache holds whole files, journals need the file data
+			bool build = false;
+			pooldir *c = journal || flt?NULL:poolcache::Get(t,false,build);
+			if(c) return c->Copy(pd,depth,false,mkdir);
+
+			poolfile file;
+			if(!file.Open(t)) return false;
+			if(journal) journal->Load(pooljournal::fmt_txt,d,depth,mkdir,file.Data(),file.Size(),flt);
+			if(build) {
+				c = new pooldir(nullatom,NULL,pd->VSize(),pd->DSize());
+				bool ok = c->LdDir(file.Data(),file.Size(),-1,true) && c->Copy(pd,depth,false,mkdir);
+				poolcache::Put(t,false,c,file.Size());
+				return ok;
+			}
+			return pd->LdDir(file.Data(),file.Size(),depth,mkdir,flt);
 		}
 		else return false;
 	}
@@ -134,47 +224,72 @@ bool pooldata::LdDir(const AtomList &d,const char *flnm,int depth,bool mkdir)
 		return false;
 }
 
+poolloader *pooldata::LdAsync(const AtomList &d,const char *flnm,int depth,bool mkdir,const poolfilter *flt)
+{
+	if(!WrDir(d)) return NULL;
+
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	if(!t) return NULL;
+
+	poolloader *ld = new poolloader(this,d,depth,mkdir,flt);
+	if(ld->Open(t))
+		return ld;
+	else {
+		delete ld;
+		return NULL;
+	}
+}
+
+void pooldata::Written(const char *flnm)
+{
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	// the cache is only used from the main thread, saves can run in the background
+	if(t) poolcache::Drop(t);
+}
+
 bool pooldata::SvDir(const AtomList &d,const char *flnm,int depth,bool absdir)
 {
-	pooldir *pd = root.GetDir(d);
+	bool ret = false;
+	pooldir *pd = SvBegin(d,depth);
 	if(pd) {
 		char tmp[1024]; // CnvFlnm checks for size of string buffer
 		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
 		if(t) {
-			ofstream file(t);
+			poolostream file(t);
 			Atoms tmp;
 			if(absdir) tmp = d;
-			return file.good() && pd->SvDir(file,depth,tmp);
+			ret = file.good() && pd->SvDir(file,depth,tmp);
+			ret = file.Close() && ret;
 		}
-		else return false;
 	}
-	else
-		return false;
+	SvEnd(pd);
+	return ret;
 }
 
-bool pooldata::LdDirXML(const AtomList &d,const char *flnm,int depth,bool mkdir)
+bool pooldata::LdDirXML(const AtomList &d,const char *flnm,int depth,bool mkdir,const poolfilter *flt)
 {
-	pooldir *pd = root.GetDir(d);
+	pooldir *pd = WrDir(d);
 	if(pd) {
 		char tmp[1024]; // CnvFlnm checks for size of string buffer
 		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
 		if(t) {
-			ifstream file(t);
-            bool ret = file.good() != 0;
-            if(ret) {
-                file.getline(tmp,sizeof tmp);
-                ret = !strncmp(tmp,"<?xml",5);
-            }
-/*
-            if(ret) {
-                fl.getline(tmp,sizeof tmp);
-                // DOCTYPE need not be present / only external DOCTYPE is allowed!
-                ret = !strncmp(tmp,"<!DOCTYPE",9);
+            bool build = false;
+            pooldir *c = journal || flt?NULL:poolcache::Get(t,true,build);
+            if(c) return c->Copy(pd,depth,false,mkdir);
+
+			poolfile file;
+            // DOCTYPE need not be present / only external DOCTYPE is allowed!
+            if(!file.Open(t) || file.Size() < 5 || strncmp(file.Data(),"<?xml",5)) return false;
+            if(journal) journal->Load(pooljournal::fmt_xml,d,depth,mkdir,file.Data(),file.Size(),flt);
+            if(build) {
+                c = new pooldir(nullatom,NULL,pd->VSize(),pd->DSize());
+                bool ok = c->LdDirXML(file.Data(),file.Size(),-1,true) && c->Copy(pd,depth,false,mkdir);
+                poolcache::Put(t,true,c,file.Size());
+                return ok;
             }
-*/
-            if(ret)
-                ret = pd->LdDirXML(file,depth,mkdir);
-            return ret;
+            return pd->LdDirXML(file.Data(),file.Size(),depth,mkdir,flt);
 		}
 	}
 
@@ -183,24 +298,258 @@ bool pooldata::LdDirXML(const AtomList &d,const char *flnm,int depth,bool mkdir)
 
 bool pooldata::SvDirXML(const AtomList &d,const char *flnm,int depth,bool absdir)
 {
-	pooldir *pd = root.GetDir(d);
+	bool ret = false;
+	pooldir *pd = SvBegin(d,depth);
 	if(pd) {
 		char tmp[1024]; // CnvFlnm checks for size of string buffer
 		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
 		if(t) {
-			ofstream file(t);
+			poolostream file(t);
 			Atoms tmp;
 			if(absdir) tmp = d;
             if(file.good()) {
                 file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << endl;
                 file << "<!DOCTYPE pool SYSTEM \"http://grrrr.org/ext/pool/pool-0.2.dtd\">" << endl;
                 file << "<pool>" << endl;
-                bool ret = pd->SvDirXML(file,depth,tmp);
+                ret = pd->SvDirXML(file,depth,tmp);
                 file << "</pool>" << endl;
-                return ret;
+                ret = file.Close() && ret;
             }
 		}
 	}
 
-    return false;
+	SvEnd(pd);
+    return ret;
+}
+
+bool pooldata::LdDirBin(const AtomList &d,const char *flnm,int depth,bool mkdir)
+{
+	pooldir *pd = WrDir(d);
+	if(pd) {
+		char tmp[1024]; // CnvFlnm checks for size of string buffer
+		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+		if(t) {
+			poolfile file;
+			if(!file.Open(t)) return false;
+			if(journal) journal->Load(pooljournal::fmt_bin,d,depth,mkdir,file.Data(),file.Size());
+			return pd->LdDirBin(file.Data(),file.Size(),depth,mkdir);
+		}
+	}
+
+	return false;
+}
+
+bool pooldata::SvDirBin(const AtomList &d,const char *flnm,int depth,bool absdir)
+{
+	bool ret = false;
+	pooldir *pd = SvBegin(d,depth);
+	if(pd) {
+		char tmp[1024]; // CnvFlnm checks for size of string buffer
+		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+		if(t) {
+			poolostream file(t,true);
+			Atoms tmp;
+			if(absdir) tmp = d;
+			ret = file.good() && pd->SvDirBin(file,depth,tmp);
+			ret = file.Close() && ret;
+		}
+	}
+
+	SvEnd(pd);
+	return ret;
+}
+
+bool pooldata::LdDirJSON(const AtomList &d,const char *flnm,int depth,bool mkdir)
+{
+	pooldir *pd = WrDir(d);
+	if(pd) {
+		char tmp[1024]; // CnvFlnm checks for size of string buffer
+		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+		if(t) {
+			poolfile file;
+			if(!file.Open(t)) return false;
+			if(journal) journal->Load(pooljournal::fmt_json,d,depth,mkdir,file.Data(),file.Size());
+			return pd->LdDirJSON(file.Data(),file.Size(),depth,mkdir);
+		}
+	}
+
+	return false;
+}
+
+bool pooldata::SvDirJSON(const AtomList &d,const char *flnm,int depth,bool absdir)
+{
+	bool ret = false;
+	pooldir *pd = SvBegin(d,depth);
+	if(pd) {
+		char tmp[1024]; // CnvFlnm checks for size of string buffer
+		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+		if(t) {
+			poolostream file(t);
+			Atoms tmp;
+			if(absdir) tmp = d;
+			ret = file.good() && pd->SvDirJSON(file,depth,tmp);
+			ret = file.Close() && ret;
+		}
+	}
+
+	SvEnd(pd);
+	return ret;
+}
+
+bool pooldata::LdDirCSV(const AtomList &d,const char *flnm,int keycol,int keycols,char delim)
+{
+	pooldir *pd = WrDir(d);
+	if(pd) {
+		char tmp[1024]; // CnvFlnm checks for size of string buffer
+		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+		if(t) {
+			poolfile file;
+			if(!file.Open(t)) return false;
+			if(journal) journal->LoadCSV(d,keycol,keycols,delim,file.Data(),file.Size());
+			return pd->LdDirCSV(file.Data(),file.Size(),keycol,keycols,delim);
+		}
+	}
+
+	return false;
+}
+
+bool pooldata::SvDirCSV(const AtomList &d,const char *flnm,char delim)
+{
+	bool ret = false;
+	pooldir *pd = SvBegin(d,0);
+	if(pd) {
+		char tmp[1024]; // CnvFlnm checks for size of string buffer
+		const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+		if(t) {
+			poolostream file(t);
+			ret = file.good() && pd->SvDirCSV(file,delim);
+			ret = file.Close() && ret;
+		}
+	}
+
+	SvEnd(pd);
+	return ret;
+}
+
+bool pooldata::Open(const char *flnm)
+{
+	// images can't be changed, there's nothing to log
+	if(journal) return false;
+
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	if(!t) return false;
+
+	poolimage *img = new poolimage;
+	if(!img->Open(t)) {
+		delete img;
+		return false;
+	}
+
+	// the image replaces all data
+	Reset();
+	image = img;
+	return true;
+}
+
+bool pooldata::SvImage(const char *flnm)
+{
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	if(!t) return false;
+
+	// images are made from the whole pool
+	pooldir *pd = SvBegin(AtomList(),-1);
+	bool ret = false;
+	if(pd) {
+		ofstream file(t,ios::binary);
+		ret = file.good() && pd->SvDirImg(file);
+	}
+	SvEnd(pd);
+	return ret;
+}
+
+bool pooldata::SvShards(const char *flnm,int groups)
+{
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	if(!t) return false;
+
+	// changes are tracked since the last save to the same folder
+	bool full = !shards || strcmp(shards->Name(),t) || shards->Groups() != groups;
+	if(full) {
+		if(shards) delete shards;
+		shards = new poolshards(t,groups);
+	}
+
+	bool ok;
+	if(image) {
+		pooldir *pd = SvBegin(AtomList(),-1);
+		ok = pd && shards->Save(pd,true);
+		SvEnd(pd);
+	}
+	else {
+		ok = shards->Save(&root,full);
+		if(ok) root.Clean();
+	}
+
+	if(!ok) {
+		// the files are in an unknown state, write them all next time
+		delete shards;
+		shards = NULL;
+	}
+	return ok;
+}
+
+bool pooldata::LdShards(const char *flnm)
+{
+	if(image) return false;
+
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	if(!t) return false;
+
+	bool empty = !root.CntAll() && !root.CntSub() && root.GetMode() == poolstore::mode_hash;
+	poolshards *sh = new poolshards(t);
+	if(!sh->Load(this)) {
+		delete sh;
+		return false;
+	}
+
+	if(empty) {
+		// the pool equals the saved files, so saving there again can start from here
+		if(shards) delete shards;
+		shards = sh;
+		root.Clean();
+	}
+	else
+		delete sh;
+	return true;
+}
+
+bool pooldata::OpenJournal(const char *flnm)
+{
+	CloseJournal();
+	if(image) return false;
+
+	char tmp[1024]; // CnvFlnm checks for size of string buffer
+	const char *t = CnvFlnm(tmp,flnm,sizeof tmp);
+	if(!t) return false;
+
+	// changes made by the replay are not logged again
+	pooljournal *j = new pooljournal;
+	if(!j->Open(t,this)) {
+		delete j;
+		return false;
+	}
+	journal = j;
+	return true;
+}
+
+void pooldata::CloseJournal()
+{
+	if(journal) {
+		delete journal;
+		journal = NULL;
+	}
 }
@@ -0,0 +1,655 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+
+/* read-only pool images
+
+   An image holds a whole pool in a form which is looked up directly within
+   the memory-mapped file, without making values or directories.
+   All numbers are little endian, offsets count from the start of the file.
+
+   header:  magic "POOLi", 3 bytes padding, u32 version, u32 symbol count,
+            u64 offset of the symbol table, u64 offset of the root directory
+   symbols: u64 offset per symbol, pointing to u32 length, bytes, 0
+   atoms:   u32 count, then per atom a type byte and its payload:
+            0 int32, 1 symbol index (u32), 2 float32, 3 float64
+   dir:     u32 value count, u32 value table bits, u32 subdir count, u32 subdir table bits,
+            u64 offset of the mode (0 for hash): mode atoms, u32 chunk count, chunk atoms
+            u32 first value of each bucket (table size+1), u32 value index per bucket entry,
+            u64 value offsets (in the order of the store, for indexed access and fifos),
+            u32 first subdir of each bucket (table size+1), u64 subdir offsets
+   value:   key atoms, data atoms
+   subdir:  u64 dir offset, name atom
+
+   Keys and directory names are hashed by content (integral numbers as integers,
+   symbols by their string) as symbol addresses differ between runs.
+*/
+
+static const char imgmagic[8] = { 'P','O','O','L','i',0,0,0 };
+static const int imgversion = 1;
+static const size_t imgheader = 32,imgdirhead = 24;
+
+enum { img_int = 0,img_sym,img_float,img_double };
+
+static inline unsigned int GetU32(const unsigned char *p)
+{
+	return p[0]|(p[1]<<8)|(p[2]<<16)|((unsigned int)p[3]<<24);
+}
+
+static inline unsigned long long GetU64(const unsigned char *p)
+{
+	return GetU32(p)|((unsigned long long)GetU32(p+4)<<32);
+}
+
+// integer value if the number is integral
+static inline bool ImgInt(const t_atom &a,int &i)
+{
+	if(flext::IsInt(a)) { i = flext::GetInt(a); return true; }
+	if(!flext::IsFloat(a)) return false;
+	double f = flext::GetFloat(a);
+	if(f < -2147483648. || f >= 2147483648.) return false;
+	i = (int)f;
+	return i == f;
+}
+
+static inline unsigned long long ImgMix(unsigned long long h,unsigned long long v)
+{
+	h ^= v;
+	h *= 0x100000001b3ULL;
+	return h^(h>>29);
+}
+
+static unsigned long long ImgHash(const t_atom &a)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	int i;
+	if(flext::IsSymbol(a)) {
+		h = ImgMix(h,img_sym);
+		for(const char *s = flext::GetString(a); *s; ++s) h = ImgMix(h,(unsigned char)*s);
+	}
+	else if(ImgInt(a,i))
+		h = ImgMix(ImgMix(h,img_int),(unsigned int)i);
+	else {
+		union { float f; unsigned int u; } fu;
+		fu.f = (float)flext::GetAFloat(a);
+		h = ImgMix(ImgMix(h,img_float),fu.u);
+	}
+	return h;
+}
+
+static unsigned long long ImgHash(const poolkey &k)
+{
+	unsigned long long h = 0;
+	for(int i = 0; i < k.cnt; ++i) h = h*31+ImgHash(k[i]);
+	return h;
+}
+
+static inline unsigned int ImgBucket(unsigned long long h,int bits)
+{
+	h ^= h>>33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h>>33;
+	return bits?(unsigned int)(h&((1ULL<<bits)-1)):0;
+}
+
+
+class poolimgwriter
+{
+public:
+	poolimgwriter(ostream &o): os(o),pos(0) {}
+
+	void Put(const void *p,size_t n)
+	{
+		buf.append((const char *)p,n);
+		pos += n;
+		if(buf.size() >= 1<<16) Flush();
+	}
+
+	void U32(unsigned int v)
+	{
+		unsigned char b[4] = { (unsigned char)v,(unsigned char)(v>>8),(unsigned char)(v>>16),(unsigned char)(v>>24) };
+		Put(b,4);
+	}
+
+	void U64(unsigned long long v) { U32((unsigned int)v); U32((unsigned int)(v>>32)); }
+
+	void Atom(const t_atom &a);
+	void Atoms(int argc,const t_atom *argv)
+	{
+		U32(argc);
+		for(int i = 0; i < argc; ++i) Atom(argv[i]);
+	}
+	void Atoms(const flext::AtomList &l) { Atoms(l.Count(),l.Atoms()); }
+
+	// bucket table from (bucket,offset) pairs, followed by the offsets ordered by bucket
+	// or, if indexed, by entry indices ordered by bucket and the offsets in their original order
+	void Table(const vector<pair<unsigned int,unsigned long long> > &e,int bits,bool indexed);
+
+	bool Header(unsigned long long root);
+	void Flush() { os.write(buf.data(),buf.size()); buf.clear(); }
+
+	ostream &os;
+	unsigned long long pos;
+
+protected:
+	string buf;
+	map<const t_symbol *,unsigned int> symix;
+	vector<const t_symbol *> syms;
+};
+
+void poolimgwriter::Atom(const t_atom &a)
+{
+	unsigned char t;
+	int i;
+	if(flext::IsSymbol(a)) {
+		const t_symbol *s = flext::GetSymbol(a);
+		map<const t_symbol *,unsigned int>::iterator it = symix.find(s);
+		if(it == symix.end()) {
+			i = (int)syms.size();
+			symix[s] = i;
+			syms.push_back(s);
+		}
+		else
+			i = it->second;
+		t = img_sym; Put(&t,1); U32(i);
+	}
+	else if(ImgInt(a,i)) {
+		t = img_int; Put(&t,1); U32(i);
+	}
+	else if(flext::IsFloat(a)) {
+		double d = flext::GetFloat(a);
+		if((float)d == d) {
+			union { float f; unsigned int u; } fu;
+			fu.f = (float)d;
+			t = img_float; Put(&t,1); U32(fu.u);
+		}
+		else {
+			union { double d; unsigned long long u; } du;
+			du.d = d;
+			t = img_double; Put(&t,1); U64(du.u);
+		}
+	}
+	else {
+		FLEXT_ASSERT(false);
+		t = img_int; Put(&t,1); U32(0);
+	}
+}
+
+void poolimgwriter::Table(const vector<pair<unsigned int,unsigned long long> > &e,int bits,bool indexed)
+{
+	const unsigned int sz = 1<<bits;
+	vector<unsigned int> start(sz+1,0);
+	for(size_t i = 0; i < e.size(); ++i) ++start[e[i].first+1];
+	for(unsigned int b = 0; b < sz; ++b) start[b+1] += start[b];
+	for(unsigned int b = 0; b <= sz; ++b) U32(start[b]);
+
+	vector<size_t> ix(e.size());
+	for(size_t i = 0; i < e.size(); ++i) ix[start[e[i].first]++] = i;
+	if(indexed) {
+		for(size_t i = 0; i < ix.size(); ++i) U32((unsigned int)ix[i]);
+		for(size_t i = 0; i < e.size(); ++i) U64(e[i].second);
+	}
+	else
+		for(size_t i = 0; i < ix.size(); ++i) U64(e[ix[i]].second);
+}
+
+bool poolimgwriter::Header(unsigned long long root)
+{
+	// symbol table at the end
+	vector<unsigned long long> sofs(syms.size());
+	for(size_t i = 0; i < syms.size(); ++i) {
+		const char *s = flext::GetString(syms[i]);
+		unsigned int l = (unsigned int)strlen(s);
+		sofs[i] = pos;
+		U32(l);
+		Put(s,l+1);
+	}
+	unsigned long long symtab = pos;
+	for(size_t i = 0; i < sofs.size(); ++i) U64(sofs[i]);
+	Flush();
+
+	os.seekp(0);
+	Put(imgmagic,sizeof imgmagic);
+	U32(imgversion);
+	U32((unsigned int)syms.size());
+	U64(symtab);
+	U64(root);
+	Flush();
+	return os.good();
+}
+
+
+unsigned long long pooldir::SvDirImgRec(poolimgwriter &wr)
+{
+	typedef vector<pair<unsigned int,unsigned long long> > entries;
+
+	// values
+	int vcnt = CntAll(),vb = Int2Bits(vcnt);
+	entries ve;
+	ve.reserve(vcnt);
+	for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+		poolkey k = ix->Key();
+		ve.push_back(make_pair(ImgBucket(ImgHash(k),vb),wr.pos));
+		wr.Atoms(k.cnt,k.atoms);
+		wr.Atoms(*ix->data);
+	}
+
+	// subdirectories, written before their entries
+	int db = Int2Bits(subcnt);
+	entries de;
+	de.reserve(subcnt);
+	for(int di = 0; di < DTSize(); ++di) {
+		for(pooldir *ix = dirs[di].d; ix; ix = ix->nxt) {
+			unsigned long long sub = ix->SvDirImgRec(wr);
+			de.push_back(make_pair(ImgBucket(ImgHash(ix->dir),db),wr.pos));
+			wr.U64(sub);
+			wr.Atom(ix->dir);
+		}
+	}
+
+	unsigned long long mode = 0;
+	if(GetMode() != poolstore::mode_hash) {
+		Atoms m;
+		GetMode(m);
+		mode = wr.pos;
+		wr.Atoms(m);
+
+		// packed series are copied by their chunks
+		int chunks = vals->Chunks();
+		wr.U32(chunks);
+		for(int ci = 0; ci < chunks; ++ci) {
+			Atoms c;
+			vals->GetChunk(ci,c);
+			wr.Atoms(c);
+		}
+	}
+
+	unsigned long long ofs = wr.pos;
+	wr.U32(vcnt); wr.U32(vb);
+	wr.U32(subcnt); wr.U32(db);
+	wr.U64(mode);
+	wr.Table(ve,vb,true);
+	wr.Table(de,db,false);
+	return ofs;
+}
+
+bool pooldir::SvDirImg(ostream &os)
+{
+	poolimgwriter wr(os);
+	// room for the header
+	char hdr[imgheader] = { 0 };
+	wr.Put(hdr,sizeof hdr);
+	unsigned long long root = SvDirImgRec(wr);
+	return wr.Header(root);
+}
+
+
+poolimage::poolimage():
+	syms(NULL),symcnt(0),vpos(0)
+{
+	ZeroMem(vring,sizeof vring);
+}
+
+poolimage::~poolimage()
+{
+	for(int i = 0; i < POOL_IMGRING; ++i)
+		if(vring[i]) delete vring[i];
+	for(map<size_t,t_atom *>::iterator it = names.begin(); it != names.end(); ++it)
+		delete[] it->second;
+	if(syms) delete[] syms;
+}
+
+bool poolimage::Open(const char *flnm)
+{
+	if(!file.Open(flnm)) return false;
+
+	const unsigned char *p = Data();
+	if(file.Size() < imgheader || memcmp(p,imgmagic,sizeof imgmagic)) {
+		post("pool - file is not a pool image");
+		return false;
+	}
+	int ver = GetU32(p+8);
+	if(ver > imgversion) {
+		post("pool - pool image version %i not supported",ver);
+		return false;
+	}
+
+	symcnt = GetU32(p+12);
+	symtab = (size_t)GetU64(p+16);
+	root = (size_t)GetU64(p+24);
+	if(!Valid(symtab,symcnt*8ULL) || !Valid(root,imgdirhead)) {
+		post("pool - pool image is corrupt");
+		return false;
+	}
+
+	// symbols are only made when needed
+	syms = new const t_symbol *[symcnt];
+	ZeroMem(syms,symcnt*sizeof *syms);
+	return true;
+}
+
+const char *poolimage::SymStr(unsigned int ix) const
+{
+	if(ix >= symcnt) return NULL;
+	size_t o = (size_t)GetU64(Data()+symtab+ix*8);
+	if(!Valid(o,4)) return NULL;
+	unsigned int l = GetU32(Data()+o);
+	return Valid(o+4,l+1ULL) && !Data()[o+4+l]?(const char *)Data()+o+4:NULL;
+}
+
+const t_symbol *poolimage::Sym(unsigned int ix)
+{
+	if(ix >= symcnt) return NULL;
+	if(!syms[ix]) {
+		const char *s = SymStr(ix);
+		if(s) syms[ix] = MakeSymbol(s);
+	}
+	return syms[ix];
+}
+
+size_t poolimage::AtomAt(size_t o,t_atom *a)
+{
+	if(!Valid(o,5)) return 0;
+	const unsigned char *p = Data()+o;
+	switch(*p) {
+	case img_int:
+		if(a) SetInt(*a,(int)GetU32(p+1));
+		return o+5;
+	case img_sym: {
+		const t_symbol *s = a?Sym(GetU32(p+1)):NULL;
+		if(a) {
+			if(!s) return 0;
+			SetSymbol(*a,s);
+		}
+		return o+5;
+	}
+	case img_float:
+		if(a) {
+			union { float f; unsigned int u; } fu;
+			fu.u = GetU32(p+1);
+			SetFloat(*a,fu.f);
+		}
+		return o+5;
+	case img_double:
+		if(!Valid(o,9)) return 0;
+		if(a) {
+			union { double d; unsigned long long u; } du;
+			du.u = GetU64(p+1);
+			SetFloat(*a,(t_float)du.d);
+		}
+		return o+9;
+	default:
+		return 0;
+	}
+}
+
+size_t poolimage::AtomsAt(size_t o,AtomList *l)
+{
+	if(!Valid(o,4)) return 0;
+	unsigned int n = GetU32(Data()+o);
+	if(!Valid(o+4,n*5ULL)) return 0;
+	if(l) (*l)(n);
+	o += 4;
+	for(unsigned int i = 0; o && i < n; ++i)
+		o = AtomAt(o,l?&(*l)[i]:NULL);
+	return o;
+}
+
+bool poolimage::Equal(size_t o,const t_atom &a) const
+{
+	if(!Valid(o,5)) return false;
+	const unsigned char *p = Data()+o;
+	int i;
+	switch(*p) {
+	case img_int:
+		return ImgInt(a,i) && i == (int)GetU32(p+1);
+	case img_sym: {
+		const char *s = IsSymbol(a)?SymStr(GetU32(p+1)):NULL;
+		return s && !strcmp(s,GetString(a));
+	}
+	case img_float: {
+		union { float f; unsigned int u; } fu;
+		fu.u = GetU32(p+1);
+		return IsFloat(a) && GetFloat(a) == fu.f;
+	}
+	case img_double: {
+		if(!Valid(o,9)) return false;
+		union { double d; unsigned long long u; } du;
+		du.u = GetU64(p+1);
+		return IsFloat(a) && GetFloat(a) == (t_float)du.d;
+	}
+	default:
+		return false;
+	}
+}
+
+bool poolimage::DirHead(size_t dir,dirhead &h) const
+{
+	if(!dir || !Valid(dir,imgdirhead)) return false;
+	const unsigned char *p = Data()+dir;
+	h.vcnt = GetU32(p); h.vbits = GetU32(p+4);
+	h.dcnt = GetU32(p+8); h.dbits = GetU32(p+12);
+	h.mode = (size_t)GetU64(p+16);
+	if(h.vbits > 30 || h.dbits > 30) return false;
+
+	h.vtab = dir+imgdirhead;
+	h.vidx = h.vtab+((1ULL<<h.vbits)+1)*4;
+	h.vofs = h.vidx+h.vcnt*4ULL;
+	h.dtab = h.vofs+h.vcnt*8ULL;
+	h.dofs = h.dtab+((1ULL<<h.dbits)+1)*4;
+	return Valid(h.vtab,(h.dofs-h.vtab)+h.dcnt*8ULL);
+}
+
+size_t poolimage::Dir(int argc,const t_atom *argv) const
+{
+	size_t dir = root;
+	for(int i = 0; dir && i < argc; ++i) {
+		dirhead h;
+		if(!DirHead(dir,h)) return 0;
+
+		unsigned int b = ImgBucket(ImgHash(argv[i]),h.dbits);
+		const unsigned char *t = Data()+h.dtab+b*4;
+		unsigned int e = GetU32(t+4);
+		size_t cur = dir;
+		dir = 0;
+		for(unsigned int j = GetU32(t); j < e && j < h.dcnt; ++j) {
+			size_t o = (size_t)GetU64(Data()+h.dofs+j*8ULL);
+			if(Valid(o,8) && Equal(o+8,argv[i])) {
+				// subdirectories lie before their parent, which also rules out cycles
+				size_t sub = (size_t)GetU64(Data()+o);
+				dir = sub < cur?sub:0;
+				break;
+			}
+		}
+	}
+	return dir;
+}
+
+void poolimage::GetMode(size_t dir,AtomList &m)
+{
+	dirhead h;
+	if(DirHead(dir,h) && h.mode && AtomsAt(h.mode,&m)) return;
+	m(1);
+	SetString(m[0],"hash");
+}
+
+int poolimage::CntAll(size_t dir) const
+{
+	dirhead h;
+	return DirHead(dir,h)?h.vcnt:0;
+}
+
+int poolimage::CntSub(size_t dir) const
+{
+	dirhead h;
+	return DirHead(dir,h)?h.dcnt:0;
+}
+
+poolval *poolimage::Value(size_t o)
+{
+	Atoms k,*d = new Atoms;
+	size_t e = AtomsAt(o,&k);
+	if(!e || !AtomsAt(e,d) || !k.Count()) {
+		delete d;
+		return NULL;
+	}
+
+	// materialized values are recycled after a while
+	poolval *&v = vring[vpos];
+	vpos = (vpos+1)%POOL_IMGRING;
+	if(v) delete v;
+	return v = new poolval(k,d);
+}
+
+poolval *poolimage::Ref(size_t dir,const poolkey &key)
+{
+	dirhead h;
+	if(!DirHead(dir,h)) return NULL;
+
+	unsigned int b = ImgBucket(ImgHash(key),h.vbits);
+	const unsigned char *t = Data()+h.vtab+b*4;
+	unsigned int e = GetU32(t+4);
+	for(unsigned int j = GetU32(t); j < e && j < h.vcnt; ++j) {
+		unsigned int ix = GetU32(Data()+h.vidx+j*4ULL);
+		if(ix >= h.vcnt) continue;
+		size_t o = (size_t)GetU64(Data()+h.vofs+ix*8ULL);
+		if(!Valid(o,4) || GetU32(Data()+o) != (unsigned int)key.cnt) continue;
+
+		// compare key atoms
+		size_t a = o+4;
+		int i = 0;
+		for(; a && i < key.cnt && Equal(a,key[i]); ++i) a = AtomAt(a,NULL);
+		if(i == key.cnt) return Value(o);
+	}
+	return NULL;
+}
+
+poolval *poolimage::Refi(size_t dir,int ix)
+{
+	dirhead h;
+	if(!DirHead(dir,h) || ix < 0 || ix >= (int)h.vcnt) return NULL;
+	return Value((size_t)GetU64(Data()+h.vofs+ix*8ULL));
+}
+
+int poolimage::GetAll(size_t dir,Atoms *&keys,Atoms *&lst)
+{
+	dirhead h;
+	if(!DirHead(dir,h)) {
+		keys = lst = NULL;
+		return 0;
+	}
+
+	keys = new Atoms[h.vcnt];
+	lst = new Atoms[h.vcnt];
+	int cnt = 0;
+	for(unsigned int j = 0; j < h.vcnt; ++j) {
+		size_t o = (size_t)GetU64(Data()+h.vofs+j*8ULL);
+		o = AtomsAt(o,&keys[cnt]);
+		if(o && AtomsAt(o,&lst[cnt])) ++cnt;
+	}
+	return cnt;
+}
+
+int poolimage::PrintAll(size_t dir,char *buf,int len)
+{
+	Atoms *k,*l;
+	int cnt = GetAll(dir,k,l);
+	if(!k) return 0;
+
+	int offs = strlen(buf);
+	for(int i = 0; i < cnt; ++i) {
+		k[i].Print(buf+offs,len-offs);
+		strcat(buf+offs," , ");
+		int p = strlen(buf+offs)+offs;
+		l[i].Print(buf+p,len-p);
+		post(buf);
+	}
+	buf[offs] = 0;
+
+	delete[] k;
+	delete[] l;
+	return cnt;
+}
+
+int poolimage::GetSub(size_t dir,const t_atom **&lst)
+{
+	dirhead h;
+	if(!DirHead(dir,h)) {
+		lst = NULL;
+		return 0;
+	}
+
+	// names are made once and kept, as the caller refers to them
+	t_atom *&n = names[dir];
+	if(!n) {
+		n = new t_atom[h.dcnt];
+		for(unsigned int j = 0; j < h.dcnt; ++j) {
+			size_t o = (size_t)GetU64(Data()+h.dofs+j*8ULL);
+			if(!Valid(o,8) || !AtomAt(o+8,&n[j])) SetSymbol(n[j],sym__);
+		}
+	}
+
+	lst = new const t_atom *[h.dcnt];
+	for(unsigned int j = 0; j < h.dcnt; ++j) lst[j] = &n[j];
+	return h.dcnt;
+}
+
+bool poolimage::Copy(size_t dir,pooldir *p,int depth)
+{
+	dirhead h;
+	if(!DirHead(dir,h)) return false;
+
+	unsigned int chunks = 0;
+	if(h.mode) {
+		Atoms m;
+		size_t o = AtomsAt(h.mode,&m);
+		if(o) p->SetMode(m);
+
+		// chunks hold all values of packed series
+		if(o && Valid(o,4)) {
+			chunks = GetU32(Data()+o);
+			o += 4;
+		}
+		for(unsigned int j = 0; o && j < chunks; ++j) {
+			Atoms c;
+			o = AtomsAt(o,&c);
+			if(o) p->AddChunk(c);
+		}
+	}
+
+	p->Reserve(p->CntAll()+h.vcnt,depth?p->CntSub()+h.dcnt:0);
+	for(unsigned int j = 0; !chunks && j < h.vcnt; ++j) {
+		size_t o = (size_t)GetU64(Data()+h.vofs+j*8ULL);
+		Atoms k,*d = new Atoms;
+		o = AtomsAt(o,&k);
+		if(o && AtomsAt(o,d) && k.Count())
+			p->SetVal(k,d);
+		else
+			delete d;
+	}
+
+	bool ok = true;
+	for(unsigned int j = 0; ok && depth && j < h.dcnt; ++j) {
+		size_t o = (size_t)GetU64(Data()+h.dofs+j*8ULL);
+		t_atom n;
+		if(!Valid(o,8) || !AtomAt(o+8,&n)) return false;
+		size_t sub = (size_t)GetU64(Data()+o);
+		if(sub >= dir) return false; // see Dir
+		pooldir *nd = p->AddDir(1,&n);
+		ok = nd && Copy(sub,nd,depth > 0?depth-1:depth);
+	}
+	return ok;
+}
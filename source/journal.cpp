@@ -0,0 +1,676 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <sstream>
+
+#if FLEXT_OS == FLEXT_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+/* journal format
+
+   All integers are unsigned LEB128 varints, signed ones zigzag-encoded.
+
+   file:    magic "POOL" 'j', version, records
+   record:  payload length (32 bit, little endian), payload, checksum (32 bit FNV-1a of the payload, little endian)
+   payload: operation, directory (atoms), operands as listed with the op_ constants below
+   atoms:   count, then per atom a tag with the type in the lower two bits:
+            0 integer (value in the upper bits), 1 symbol (byte length in the upper bits, bytes follow),
+            2 float (32 bit, little endian, follows), 6 double (64 bit, little endian, follows)
+
+   Records are replayed in order on top of the pool contents, so all changes
+   have to go through pooldata. A snapshot record (only first in a file,
+   written by Compact) replaces the contents.
+   A torn record at the end (from a crash while writing) is cut off.
+*/
+
+static const char jnlmagic[5] = { 'P','O','O','L','j' };
+static const int jnlversion = 1;
+
+enum { jnl_int = 0,jnl_sym = 1,jnl_float = 2,jnl_double = 6 };
+
+enum {
+	op_snapshot = 0, // binary pool data (see binary.cpp)
+	op_reset,
+	op_mkdir,        // value count, subdir count
+	op_rmdir,
+	op_set,          // key (atoms), data (atoms), overwrite flag
+	op_clr,          // key (atoms)
+	op_seti,         // index, data (atoms)
+	op_clri,         // index
+	op_clrall,       // flags: 1 recursive, 2 directories only
+	op_mode,         // mode (atoms)
+	op_push,         // data (atoms)
+	op_pop,
+	op_cutall,       // depth+1
+	op_paste,        // depth+1, flags: 1 replace, 2 make dirs, binary pool data
+	op_load,         // format, depth+1, make dirs flag, file data
+	op_loadsel       // format, depth+1, make dirs flag, path (atoms), key pattern (atoms), file data
+};
+
+// time from a change until it is written, with all changes made meanwhile
+#ifndef POOL_JOURNALDELAY
+#define POOL_JOURNALDELAY 0.1
+#endif
+
+// buffered size from which changes are written right away
+#ifndef POOL_JOURNALBUF
+#define POOL_JOURNALBUF (1<<16)
+#endif
+
+static unsigned int Checksum(const char *p,size_t n)
+{
+	unsigned int h = 2166136261u;
+	for(size_t i = 0; i < n; ++i) h = (h^(unsigned char)p[i])*16777619u;
+	return h;
+}
+
+
+class pooljnlreader
+{
+public:
+	pooljnlreader(const char *b,const char *e): ok(true),p((const unsigned char *)b),e((const unsigned char *)e) {}
+
+	unsigned long long Varint()
+	{
+		unsigned long long v = 0;
+		for(int sh = 0; p < e && sh < 64; sh += 7) {
+			unsigned char c = *p++;
+			v |= (unsigned long long)(c&0x7f)<<sh;
+			if(!(c&0x80)) return v;
+		}
+		ok = false;
+		return 0;
+	}
+
+	int Int()
+	{
+		unsigned int z = (unsigned int)Varint();
+		return (int)(z>>1)^-(int)(z&1);
+	}
+
+	bool Atoms(flext::AtomList &l);
+
+	// the rest of the record
+	const char *Rest(size_t &len) { len = e-p; const char *r = (const char *)p; p = e; return r; }
+
+	const char *Pos() const { return (const char *)p; }
+
+	bool ok;
+
+protected:
+	unsigned long long Raw(int bytes)
+	{
+		if(e-p < bytes) { ok = false; return 0; }
+		unsigned long long v = 0;
+		for(int i = 0; i < bytes; ++i) v |= (unsigned long long)*p++<<(i*8);
+		return v;
+	}
+
+	const unsigned char *p,*e;
+	string s;
+};
+
+bool pooljnlreader::Atoms(flext::AtomList &l)
+{
+	unsigned long long n = Varint();
+	if(n > (unsigned long long)(e-p)) ok = false;
+	l(ok?(int)n:0);
+	for(int i = 0; ok && i < l.Count(); ++i) {
+		unsigned long long t = Varint();
+		switch(t&3) {
+		case jnl_int: {
+			unsigned int z = (unsigned int)(t>>2);
+			flext::SetInt(l[i],(int)(z>>1)^-(int)(z&1));
+			break;
+		}
+		case jnl_sym:
+			if((t>>2) <= (unsigned long long)(e-p)) {
+				s.assign((const char *)p,(size_t)(t>>2));
+				p += t>>2;
+				flext::SetString(l[i],s.c_str());
+			}
+			else
+				ok = false;
+			break;
+		default:
+			if(t == jnl_float) {
+				union { float f; unsigned int u; } fu;
+				fu.u = (unsigned int)Raw(4);
+				flext::SetFloat(l[i],fu.f);
+			}
+			else if(t == jnl_double) {
+				union { double d; unsigned long long u; } du;
+				du.u = Raw(8);
+				flext::SetFloat(l[i],(t_float)du.d);
+			}
+			else
+				ok = false;
+		}
+	}
+	return ok;
+}
+
+
+pooljournal::pooljournal():
+	file(NULL),rec(0)
+{
+	tmr.SetCallback(Tick);
+}
+
+pooljournal::~pooljournal()
+{
+	Close();
+}
+
+void pooljournal::Tick(void *data)
+{
+	pooljournal *j = (pooljournal *)data;
+	if(!j->Flush()) post("pool - journal: error writing %s",j->name.c_str());
+}
+
+bool pooljournal::Open(const char *flnm,pooldata *p)
+{
+	Close();
+
+	size_t valid;
+	{
+		poolfile f;
+		if(f.Open(flnm) && f.Size()) {
+			if(!Replay(f.Data(),f.Size(),p,valid)) return false;
+		}
+		else
+			valid = 0;
+	}
+
+	if(valid)
+		// cut off anything after the last complete record
+		file = Truncate(flnm,valid)?fopen(flnm,"ab"):NULL;
+	else {
+		// new journal
+		file = fopen(flnm,"wb");
+		if(file) Header();
+	}
+	if(!file) return false;
+
+	name = flnm;
+	return Flush();
+}
+
+void pooljournal::Close()
+{
+	if(file) {
+		if(!Flush()) post("pool - journal: error writing %s",name.c_str());
+		fclose(file);
+		file = NULL;
+	}
+	tmr.Reset();
+	buf.clear();
+}
+
+bool pooljournal::Flush()
+{
+	tmr.Reset();
+	if(!file) return false;
+	if(buf.empty()) return true;
+
+	bool ok = fwrite(buf.data(),1,buf.size(),file) == buf.size() && !fflush(file);
+	// changes are committed only when they are on disk
+#if FLEXT_OS == FLEXT_OS_WIN
+	ok = ok && !_commit(_fileno(file));
+#else
+	ok = ok && !fsync(fileno(file));
+#endif
+	buf.clear();
+	return ok;
+}
+
+bool pooljournal::Compact(pooldata *p)
+{
+	if(!file) return false;
+
+	// pending changes stay in the old journal should compacting fail
+	if(!Flush()) return false;
+	fclose(file);
+	file = NULL;
+
+	// the snapshot goes to a new file which replaces the journal when complete
+	string tmp = name+".tmp";
+	FILE *f = fopen(tmp.c_str(),"wb");
+	bool ok = f != NULL;
+	if(ok) {
+		ostringstream os(ios::binary);
+		ok = p->root.SvDirBin(os,-1);
+		if(ok) {
+			// without a file, the records are only framed in the buffer
+			Header();
+			Begin(op_snapshot,AtomList());
+			const string &s = os.str();
+			buf.append(s.data(),s.size());
+			End();
+
+			ok = fwrite(buf.data(),1,buf.size(),f) == buf.size() && !fflush(f);
+#if FLEXT_OS == FLEXT_OS_WIN
+			ok = ok && !_commit(_fileno(f));
+#else
+			ok = ok && !fsync(fileno(f));
+#endif
+			buf.clear();
+		}
+		fclose(f);
+
+		// replace the journal in one step
+#if FLEXT_OS == FLEXT_OS_WIN
+		ok = ok && MoveFileEx(tmp.c_str(),name.c_str(),MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH);
+#else
+		ok = ok && !rename(tmp.c_str(),name.c_str());
+#endif
+		if(!ok) remove(tmp.c_str());
+	}
+
+	file = fopen(name.c_str(),"ab");
+	return ok && file;
+}
+
+bool pooljournal::Truncate(const char *flnm,size_t len)
+{
+	FILE *f = fopen(flnm,"r+b");
+	if(!f) return false;
+#if FLEXT_OS == FLEXT_OS_WIN
+	bool ok = !_chsize_s(_fileno(f),len);
+#else
+	bool ok = !ftruncate(fileno(f),len);
+#endif
+	fclose(f);
+	return ok;
+}
+
+void pooljournal::Header()
+{
+	buf.append(jnlmagic,sizeof jnlmagic);
+	Varint(jnlversion);
+}
+
+void pooljournal::Varint(unsigned long long v)
+{
+	for(; v >= 0x80; v >>= 7) buf += (char)((v&0x7f)|0x80);
+	buf += (char)v;
+}
+
+void pooljournal::Int(int i)
+{
+	Varint(((unsigned int)i<<1)^(unsigned int)(i>>31));
+}
+
+void pooljournal::Atom(const t_atom &a)
+{
+	if(IsSymbol(a)) {
+		const char *s = GetString(a);
+		size_t l = strlen(s);
+		Varint(((unsigned long long)l<<2)|jnl_sym);
+		buf.append(s,l);
+	}
+	else if(IsInt(a)) {
+		int i = GetInt(a);
+		Varint(((unsigned long long)(((unsigned int)i<<1)^(unsigned int)(i>>31))<<2)|jnl_int);
+	}
+	else if(IsFloat(a)) {
+		double d = GetFloat(a);
+		float f = (float)d;
+		if(f == d) {
+			union { float f; unsigned int u; } fu;
+			fu.f = f;
+			Varint(jnl_float);
+			for(int i = 0; i < 4; ++i,fu.u >>= 8) buf += (char)(fu.u&0xff);
+		}
+		else {
+			union { double d; unsigned long long u; } du;
+			du.d = d;
+			Varint(jnl_double);
+			for(int i = 0; i < 8; ++i,du.u >>= 8) buf += (char)(du.u&0xff);
+		}
+	}
+	else {
+		FLEXT_ASSERT(false);
+		Varint(jnl_int);
+	}
+}
+
+void pooljournal::Atoms(int argc,const t_atom *argv)
+{
+	Varint(argc);
+	for(int i = 0; i < argc; ++i) Atom(argv[i]);
+}
+
+void pooljournal::Begin(int op,const AtomList &d)
+{
+	// the length is filled in by End
+	rec = buf.size();
+	buf.append(4,0);
+	Varint(op);
+	Atoms(d);
+}
+
+void pooljournal::End()
+{
+	size_t len = buf.size()-rec-4;
+	for(int i = 0; i < 4; ++i) buf[rec+i] = (char)((len>>(i*8))&0xff);
+	unsigned int sum = Checksum(buf.data()+rec+4,len);
+	for(int i = 0; i < 4; ++i,sum >>= 8) buf += (char)(sum&0xff);
+
+	if(!file) return;
+	if(buf.size() >= POOL_JOURNALBUF) {
+		if(!Flush()) post("pool - journal: error writing %s",name.c_str());
+	}
+	else if(rec == 0)
+		// first change since the last write
+		tmr.Delay(POOL_JOURNALDELAY,this);
+}
+
+bool pooljournal::Replay(const char *data,size_t size,pooldata *p,size_t &valid)
+{
+	if(size < sizeof jnlmagic || memcmp(data,jnlmagic,sizeof jnlmagic)) {
+		post("pool - journal: file is not a pool journal");
+		return false;
+	}
+
+	pooljnlreader hd(data+sizeof jnlmagic,data+size);
+	int ver = (int)hd.Varint();
+	if(!hd.ok || ver > jnlversion) {
+		post("pool - journal: version %i not supported",ver);
+		return false;
+	}
+	valid = hd.Pos()-data;
+
+	while(size-valid >= 8) {
+		// record frame
+		const unsigned char *r = (const unsigned char *)data+valid;
+		size_t len = r[0]|(r[1]<<8)|(r[2]<<16)|((size_t)r[3]<<24);
+		if(len > size-valid-8) break;
+		const unsigned char *cs = r+4+len;
+		unsigned int sum = cs[0]|(cs[1]<<8)|(cs[2]<<16)|((unsigned int)cs[3]<<24);
+		if(sum != Checksum((const char *)r+4,len)) break;
+
+		if(!Apply((const char *)r+4,len,p)) {
+			post("pool - journal: unknown or malformed record");
+			return false;
+		}
+		valid += len+8;
+	}
+
+	if(valid < size)
+		post("pool - journal: incomplete record at the end was discarded");
+	return true;
+}
+
+bool pooljournal::Apply(const char *data,size_t len,pooldata *p)
+{
+	pooljnlreader rd(data,data+len);
+	int op = (int)rd.Varint();
+	::Atoms d;
+	if(!rd.Atoms(d)) return false;
+
+	switch(op) {
+	case op_snapshot: {
+		size_t n;
+		const char *b = rd.Rest(n);
+		p->Reset();
+		return p->root.LdDirBin(b,n,-1,true);
+	}
+	case op_reset:
+		p->Reset();
+		break;
+	case op_mkdir: {
+		int vcnt = rd.Int(),dcnt = rd.Int();
+		if(rd.ok) p->MkDir(d,vcnt,dcnt);
+		break;
+	}
+	case op_rmdir:
+		p->RmDir(d);
+		break;
+	case op_set: {
+		::Atoms k,*v = new ::Atoms;
+		bool ok = rd.Atoms(k) && rd.Atoms(*v);
+		int over = (int)rd.Varint();
+		if(ok && rd.ok && p->Set(d,k,v,over != 0)) v = NULL;
+		if(v) delete v;
+		break;
+	}
+	case op_clr: {
+		::Atoms k;
+		if(rd.Atoms(k)) p->Clr(d,k);
+		break;
+	}
+	case op_seti: {
+		int ix = rd.Int();
+		::Atoms *v = new ::Atoms;
+		if(rd.Atoms(*v) && p->Seti(d,ix,v)) v = NULL;
+		if(v) delete v;
+		break;
+	}
+	case op_clri: {
+		int ix = rd.Int();
+		if(rd.ok) p->Clri(d,ix);
+		break;
+	}
+	case op_clrall: {
+		int fl = (int)rd.Varint();
+		if(rd.ok) p->ClrAll(d,(fl&1) != 0,(fl&2) != 0);
+		break;
+	}
+	case op_mode: {
+		::Atoms m;
+		if(rd.Atoms(m)) p->SetMode(d,m);
+		break;
+	}
+	case op_push: {
+		::Atoms *v = new ::Atoms;
+		if(rd.Atoms(*v) && p->PushVal(d,v)) v = NULL;
+		if(v) delete v;
+		break;
+	}
+	case op_pop:
+		delete p->PopVal(d);
+		break;
+	case op_cutall: {
+		int depth = (int)rd.Varint()-1;
+		if(rd.ok) delete p->CopyAll(d,depth,true);
+		break;
+	}
+	case op_paste: {
+		int depth = (int)rd.Varint()-1;
+		int fl = (int)rd.Varint();
+		size_t n;
+		const char *b = rd.Rest(n);
+		if(!rd.ok) return false;
+		pooldata clip(NULL,p->root.VSize(),p->root.DSize());
+		if(!clip.root.LdDirBin(b,n,-1,true)) return false;
+		p->Paste(d,&clip.root,depth,(fl&1) != 0,(fl&2) != 0);
+		break;
+	}
+	case op_load:
+	case op_loadsel: {
+		int fmt = (int)rd.Varint();
+		// CSV data has the key column in place of depth, the delimiter and the number of key columns in place of mkdir
+		int depth = (int)rd.Varint()-1;
+		unsigned long long fl = rd.Varint();
+		bool mkdir = fl != 0;
+		poolfilter flt;
+		if(op == op_loadsel) {
+			::Atoms k;
+			if(!rd.Atoms(flt.path) || !rd.Atoms(k)) return false;
+			if(k.Count()) flt.key = GetString(k[0]);
+		}
+		size_t n;
+		const char *b = rd.Rest(n);
+		if(!rd.ok) return false;
+		pooldir *pd = p->WrDir(d);
+		if(pd) {
+			const poolfilter *f = op == op_loadsel?&flt:NULL;
+			if(fmt == fmt_xml)
+				pd->LdDirXML(b,n,depth,mkdir,f);
+			else if(fmt == fmt_bin)
+				pd->LdDirBin(b,n,depth,mkdir);
+			else if(fmt == fmt_json)
+				pd->LdDirJSON(b,n,depth,mkdir);
+			else if(fmt == fmt_csv)
+				pd->LdDirCSV(b,n,depth,fl>>8?(int)(fl>>8):1,(char)fl);
+			else
+				pd->LdDir(b,n,depth,mkdir,f);
+		}
+		break;
+	}
+	default:
+		return false;
+	}
+	return rd.ok;
+}
+
+void pooljournal::Reset()
+{
+	Begin(op_reset,AtomList());
+	End();
+}
+
+void pooljournal::MkDir(const AtomList &d,int vcnt,int dcnt)
+{
+	Begin(op_mkdir,d);
+	Int(vcnt); Int(dcnt);
+	End();
+}
+
+void pooljournal::RmDir(const AtomList &d)
+{
+	Begin(op_rmdir,d);
+	End();
+}
+
+void pooljournal::Set(const AtomList &d,const poolkey &key,const AtomList *data,bool over)
+{
+	if(!data) {
+		Clr(d,key);
+		return;
+	}
+	Begin(op_set,d);
+	Atoms(key.cnt,key.atoms);
+	Atoms(*data);
+	Varint(over?1:0);
+	End();
+}
+
+void pooljournal::Clr(const AtomList &d,const poolkey &key)
+{
+	Begin(op_clr,d);
+	Atoms(key.cnt,key.atoms);
+	End();
+}
+
+void pooljournal::Seti(const AtomList &d,int ix,const AtomList *data)
+{
+	if(!data) {
+		Clri(d,ix);
+		return;
+	}
+	Begin(op_seti,d);
+	Int(ix);
+	Atoms(*data);
+	End();
+}
+
+void pooljournal::Clri(const AtomList &d,int ix)
+{
+	Begin(op_clri,d);
+	Int(ix);
+	End();
+}
+
+void pooljournal::ClrAll(const AtomList &d,bool rec,bool dironly)
+{
+	Begin(op_clrall,d);
+	Varint((rec?1:0)|(dironly?2:0));
+	End();
+}
+
+void pooljournal::SetMode(const AtomList &d,const AtomList &m)
+{
+	Begin(op_mode,d);
+	Atoms(m);
+	End();
+}
+
+void pooljournal::Push(const AtomList &d,const AtomList *data)
+{
+	Begin(op_push,d);
+	Atoms(*data);
+	End();
+}
+
+void pooljournal::Pop(const AtomList &d)
+{
+	Begin(op_pop,d);
+	End();
+}
+
+void pooljournal::CutAll(const AtomList &d,int depth)
+{
+	Begin(op_cutall,d);
+	Varint(depth+1);
+	End();
+}
+
+void pooljournal::Paste(const AtomList &d,const pooldir *clip,int depth,bool repl,bool mkdir)
+{
+	ostringstream os(ios::binary);
+	// saving doesn't change the clip
+	const_cast<pooldir *>(clip)->SvDirBin(os,-1);
+
+	Begin(op_paste,d);
+	Varint(depth+1);
+	Varint((repl?1:0)|(mkdir?2:0));
+	const string &s = os.str();
+	buf.append(s.data(),s.size());
+	End();
+}
+
+void pooljournal::Load(int fmt,const AtomList &d,int depth,bool mkdir,const char *data,size_t len,const poolfilter *flt)
+{
+	bool sel = flt && !flt->Empty();
+	Begin(sel?op_loadsel:op_load,d);
+	Varint(fmt);
+	Varint(depth+1);
+	Varint(mkdir?1:0);
+	if(sel) {
+		// the whole data is logged, the selection is made again on replay
+		Atoms(flt->path);
+		t_atom k;
+		SetString(k,flt->key.c_str());
+		Atoms(flt->key.empty()?0:1,&k);
+	}
+	buf.append(data,len);
+	End();
+}
+
+void pooljournal::LoadCSV(const AtomList &d,int keycol,int keycols,char delim,const char *data,size_t len)
+{
+	Begin(op_load,d);
+	Varint(fmt_csv);
+	Varint(keycol+1);
+	Varint((unsigned char)delim|((unsigned long long)keycols<<8));
+	buf.append(data,len);
+	End();
+}
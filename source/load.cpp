@@ -0,0 +1,1056 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+
+#if FLEXT_OS == FLEXT_OS_WIN
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+poolfile::~poolfile()
+{
+	Close();
+}
+
+bool poolfile::Open(const char *flnm)
+{
+	if(!Map(flnm)) return false;
+
+	int kind = ZipKind(data,size);
+	if(kind) {
+		char *buf;
+		size_t len;
+		bool ok = Unzip(kind,data,size,buf,len);
+		Close();
+		if(!ok) return false;
+		data = buf;
+		size = len;
+	}
+	return true;
+}
+
+bool poolfile::Map(const char *flnm)
+{
+	Close();
+
+#if FLEXT_OS == FLEXT_OS_WIN
+	HANDLE f = CreateFile(flnm,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+	if(f == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER sz;
+	bool ok = GetFileSizeEx(f,&sz) != 0;
+	if(ok && sz.QuadPart) {
+		HANDLE m = CreateFileMapping(f,NULL,PAGE_READONLY,0,0,NULL);
+		if(m) {
+			data = (const char *)MapViewOfFile(m,FILE_MAP_READ,0,0,0);
+			CloseHandle(m);
+		}
+		ok = data != NULL;
+		size = (size_t)sz.QuadPart;
+	}
+	CloseHandle(f);
+	if(ok) mapped = true;
+	return ok;
+#else
+	int fd = open(flnm,O_RDONLY);
+	if(fd < 0) return false;
+
+	struct stat st;
+	bool ok = fstat(fd,&st) == 0;
+	if(ok && st.st_size) {
+		void *m = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		if(m != MAP_FAILED) {
+			data = (const char *)m;
+			size = st.st_size;
+			mapped = true;
+#ifdef MADV_SEQUENTIAL
+			madvise(m,size,MADV_SEQUENTIAL);
+#endif
+		}
+		else {
+			// not mappable (e.g. a pipe) -> read it all
+			char *buf = (char *)malloc(st.st_size);
+			ssize_t rd = buf?read(fd,buf,st.st_size):-1;
+			if(rd == st.st_size) {
+				data = buf;
+				size = rd;
+			}
+			else {
+				if(buf) free(buf);
+				ok = false;
+			}
+		}
+	}
+	close(fd);
+	return ok;
+#endif
+}
+
+void poolfile::Close()
+{
+	if(data) {
+		if(!mapped)
+			free((void *)data);
+		else
+#if FLEXT_OS == FLEXT_OS_WIN
+			UnmapViewOfFile(data);
+#else
+			munmap((void *)data,size);
+#endif
+	}
+	data = NULL;
+	size = 0;
+	mapped = false;
+}
+
+
+bool poolfilter::Dir(int argc,const t_atom *argv) const
+{
+	int n = path.Count();
+	if(argc < n) return false;
+	for(int i = 0; i < n; ++i) {
+		// numbers are equal regardless of their type, as with the parser
+		const t_atom &a = argv[i],&b = path[i];
+		if(CanbeFloat(a) && CanbeFloat(b)?GetAFloat(a) != GetAFloat(b):compare(a,b) != 0) return false;
+	}
+	return true;
+}
+
+void poolfilter::Text(string &s,const t_atom &a)
+{
+	if(IsSymbol(a))
+		s += GetString(a);
+	else {
+		char tmp[32];
+		if(IsInt(a))
+			sprintf(tmp,"%i",GetInt(a));
+		else
+			sprintf(tmp,"%g",GetFloat(a));
+		s += tmp;
+	}
+}
+
+bool poolfilter::Key(const AtomList &k) const
+{
+	if(key.empty()) return true;
+	string s;
+	for(int i = 0; i < k.Count(); ++i) {
+		if(i) s += ' ';
+		Text(s,k[i]);
+	}
+	return Match(key.c_str(),s.c_str());
+}
+
+bool poolfilter::Match(const char *pat,const char *s)
+{
+	// backtrack to the last * only
+	const char *star = NULL,*ss = NULL;
+	while(*s) {
+		if(*pat == '*') {
+			star = pat++;
+			ss = s;
+		}
+		else if(*pat == '?' || *pat == *s) {
+			++pat;
+			++s;
+		}
+		else if(star) {
+			pat = star+1;
+			s = ++ss;
+		}
+		else
+			return false;
+	}
+	while(*pat == '*') ++pat;
+	return !*pat;
+}
+
+
+/* parser for the text format written by pooldir::SvDir
+
+   A line holds directory, key and value atoms separated by commas.
+   Symbols are enclosed in quotes, whitespace, commas, quotes and backslashes
+   within them are escaped with a backslash.
+   Unquoted tokens are numbers if they parse as such (like strtod), else symbols.
+
+   Large files are cut into pieces at line boundaries which are parsed
+   concurrently. Symbols are only created when the lines of a piece are stored
+   in file order, as the symbol table is not thread-safe.
+*/
+
+// file size from which pieces are parsed concurrently
+#ifndef POOL_PARSEPIECE
+#define POOL_PARSEPIECE (1<<20)
+#endif
+
+// piece size for incremental loading
+#ifndef POOL_LOADPIECE
+#define POOL_LOADPIECE (1<<16)
+#endif
+
+// parsed pieces held ahead of storing
+#ifndef POOL_LOADAHEAD
+#define POOL_LOADAHEAD 4
+#endif
+
+// entries stored between checks of the time budget
+#define POOL_LOADSLICE 64
+
+static inline bool _isspace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+// find delimiter not escaped by a backslash, return e if there is none
+// escapes are looked for back to s (default: p)
+static const char *FindDelim(const char *p,const char *e,char del,const char *s = NULL)
+{
+	if(!s) s = p;
+	for(;;) {
+		const char *f = (const char *)memchr(p,del,e-p);
+		if(!f) return e;
+
+		// escaped if preceded by an odd number of backslashes
+		int n = 0;
+		for(const char *b = f; b > s && b[-1] == '\\'; --b) ++n;
+		if(!(n&1)) return f;
+		p = f+1;
+	}
+}
+
+// start of the line following the one at p
+static inline const char *NextLine(const char *buf,const char *p,const char *e)
+{
+	const char *eol = FindDelim(p,e,'\n',buf);
+	return eol < e?eol+1:e;
+}
+
+static const double pow10tab[] = {
+	1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,
+	1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+};
+
+// decimal number with exactly representable mantissa and power of ten, false otherwise
+static bool FastNumber(const char *p,const char *e,double &res)
+{
+	bool neg = false;
+	if(p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+
+	unsigned long long m = 0;
+	int digs = 0,exp = 0;
+	for(; p < e && *p >= '0' && *p <= '9'; ++p,++digs) m = m*10+(*p-'0');
+	if(p < e && *p == '.') {
+		for(++p; p < e && *p >= '0' && *p <= '9'; ++p,++digs,--exp) m = m*10+(*p-'0');
+	}
+	if(!digs || digs > 18) return false;
+
+	if(p < e && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool eneg = false;
+		if(p < e && (*p == '-' || *p == '+')) eneg = *p++ == '-';
+		if(p == e) return false;
+		int x = 0;
+		for(; p < e && *p >= '0' && *p <= '9' && x < 1000; ++p) x = x*10+(*p-'0');
+		exp += eneg?-x:x;
+	}
+	if(p != e) return false;
+
+	// both operands exact -> correctly rounded result
+	if(m > (1ULL<<53) || exp < -22 || exp > 22) return false;
+	double d = (double)m;
+	d = exp < 0?d/pow10tab[-exp]:d*pow10tab[exp];
+	res = neg?-d:d;
+	return true;
+}
+
+// integer of a number stored as float, if integral (range checked before the conversion)
+static inline bool IntNumber(float f,int &i)
+{
+	if(f < -2147483648. || f >= 2147483648.) return false;
+	i = (int)f;
+	return i == f;
+}
+
+class poolparser
+{
+public:
+	// parse all lines within [p,e)
+	// lines deeper than depth (if >= 0) or not selected by flt (if given) are skipped before their values are parsed
+	void Parse(const char *p,const char *e,int depth = -1,const poolfilter *flt = NULL);
+
+	// number of lines (including blank ones)
+	int Count() const { return lcnt; }
+	// number of non-blank lines
+	int Entries() const { return (int)lines.size(); }
+	// line number (counted from 1) of an entry
+	int Line(int i) const { return lines[i].line; }
+	// number of consecutive entries within the same directory starting with entry i,
+	// 0 if the previous entry is within that directory
+	int Run(int i) const { return lines[i].run; }
+	// byte range of an entry (with its line end), relative to the start of the parsed text
+	size_t Begin(int i) const { return lines[i].beg; }
+	size_t End(int i) const { return lines[i].lend; }
+
+	// make atoms of an entry, false if the line is malformed
+	bool Get(int i,flext::AtomList &d,flext::AtomList &k,flext::AtomList &v) const
+	{
+		const entry &l = lines[i];
+		if(!l.ok) return false;
+		Get(l.dir,l.key,d);
+		Get(l.key,l.val,k);
+		// symbols of values may become pool-owned strings, not those of modes and chunks (without key)
+		Get(l.val,l.end,v,l.val != l.key);
+		return true;
+	}
+
+protected:
+	// atom as parsed, the symbol is kept as an offset into strs
+	struct atom
+	{
+		enum { tp_int,tp_float,tp_sym } tp;
+		union { int i; float f; size_t s; };
+	};
+
+	// atom ranges of directory, key and values
+	struct entry
+	{
+		int line,run;
+		bool ok;
+		size_t dir,key,val,end;
+		size_t beg,lend;
+	};
+
+	void Atoms(const char *p,const char *e) { while((p = Atom(p,e)) != NULL) {} }
+	const char *Atom(const char *p,const char *e);
+	void Get(size_t b,size_t e,flext::AtomList &l,bool val = false) const;
+	// are the directories of the entries the same?
+	bool SameDir(const entry &a,const entry &b) const;
+	// atom as text (symbols without quotes), appended to s
+	void Text(const atom &a,string &s) const;
+	bool Equal(const atom &a,const t_atom &b) const;
+	// selection of directory and key
+	bool Dir(const entry &l,const poolfilter &flt) const;
+	bool Key(const entry &l,const poolfilter &flt);
+
+	vector<char> tok,strs;
+	vector<atom> atoms;
+	vector<entry> lines;
+	int lcnt;
+	string ktxt;
+};
+
+void poolparser::Parse(const char *p,const char *e,int depth,const poolfilter *flt)
+{
+	tok.clear(); strs.clear();
+	atoms.clear(); lines.clear();
+	lcnt = 0;
+	int run = -1;
+	const char *s = p;
+
+	while(p < e) {
+		const char *eol = FindDelim(p,e,'\n');
+		const char *c1 = FindDelim(p,eol,',');
+		const char *c2 = c1 < eol?FindDelim(c1+1,eol,','):eol;
+
+		entry l;
+		l.line = ++lcnt;
+		l.run = 0;
+		l.ok = c2 < eol;
+		l.dir = l.key = l.val = l.end = atoms.size();
+		l.beg = p-s;
+		l.lend = (eol < e?eol+1:e)-s;
+		if(l.ok) {
+			size_t ns = strs.size();
+			Atoms(p,c1);
+			l.key = atoms.size();
+			bool sel = (depth < 0 || (int)(l.key-l.dir) <= depth) && (!flt || Dir(l,*flt));
+			if(sel) {
+				Atoms(c1+1,c2);
+				l.val = atoms.size();
+				sel = !flt || Key(l,*flt);
+			}
+			if(!sel) {
+				atoms.resize(l.dir);
+				strs.resize(ns);
+				p = eol+1;
+				continue;
+			}
+			Atoms(c2+1,eol);
+			l.end = atoms.size();
+
+			if(run >= 0 && SameDir(lines[run],l))
+				lines[run].run++;
+			else
+				run = (int)lines.size(),l.run = 1;
+			lines.push_back(l);
+		}
+		else {
+			// tolerate blank lines
+			const char *c = p;
+			while(c < eol && _isspace(*c)) ++c;
+			if(c < eol) lines.push_back(l);
+		}
+
+		p = eol+1;
+	}
+}
+
+const char *poolparser::Atom(const char *p,const char *e)
+{
+	while(p < e && _isspace(*p)) ++p;
+	if(p == e) return NULL;
+
+	bool issymbol = *p == '"';
+	if(issymbol) ++p;
+
+	// scan token
+	const char *s = p;
+	bool escapes = false;
+	for(; p < e; ++p) {
+		char c = *p;
+		if(c == '\\') {
+			escapes = true;
+			if(++p == e) break;
+		}
+		else if(_isspace(c) || (issymbol && c == '"'))
+			break;
+	}
+	const char *te = p < e?p:e;
+	if(issymbol && p < e && *p == '"') ++p;
+
+	if(escapes) {
+		// unescape
+		tok.clear();
+		for(const char *c = s; c < te; ++c) {
+			if(*c == '\\' && ++c == te) break;
+			tok.push_back(*c);
+		}
+	}
+	else
+		tok.assign(s,te);
+
+	atom a;
+	if(!issymbol) {
+		double d;
+		bool num = !tok.empty() && FastNumber(&tok[0],&tok[0]+tok.size(),d);
+		if(!num) {
+			// leave exotic forms (hex, inf, nan) to the library
+			tok.push_back(0);
+			char *endp;
+			d = strtod(&tok[0],&endp);
+			num = !*endp && endp != &tok[0];
+			tok.pop_back();
+		}
+		if(num) {
+			float f = (float)d;
+			if(IntNumber(f,a.i))
+				a.tp = atom::tp_int;
+			else
+				a.tp = atom::tp_float,a.f = f;
+			atoms.push_back(a);
+			return p;
+		}
+	}
+
+	a.tp = atom::tp_sym;
+	a.s = strs.size();
+	strs.insert(strs.end(),tok.begin(),tok.end());
+	strs.push_back(0);
+	atoms.push_back(a);
+	return p;
+}
+
+bool poolparser::SameDir(const entry &a,const entry &b) const
+{
+	if(a.key-a.dir != b.key-b.dir) return false;
+	for(size_t i = 0; i < a.key-a.dir; ++i) {
+		const atom &x = atoms[a.dir+i],&y = atoms[b.dir+i];
+		if(x.tp != y.tp) return false;
+		if(x.tp == atom::tp_int?x.i != y.i:(x.tp == atom::tp_float?x.f != y.f:strcmp(&strs[x.s],&strs[y.s]) != 0))
+			return false;
+	}
+	return true;
+}
+
+void poolparser::Text(const atom &a,string &s) const
+{
+	if(a.tp == atom::tp_sym)
+		s += &strs[a.s];
+	else {
+		// numbers as for loaded atoms, so that patterns match the same in all formats
+		t_atom n;
+		if(a.tp == atom::tp_int)
+			flext::SetInt(n,a.i);
+		else
+			flext::SetFloat(n,a.f);
+		poolfilter::Text(s,n);
+	}
+}
+
+bool poolparser::Equal(const atom &a,const t_atom &b) const
+{
+	if(a.tp == atom::tp_sym)
+		return flext::IsSymbol(b) && !strcmp(&strs[a.s],flext::GetString(b));
+	else if(!flext::CanbeFloat(b))
+		return false;
+	else
+		return (a.tp == atom::tp_int?(float)a.i:a.f) == flext::GetAFloat(b);
+}
+
+bool poolparser::Dir(const entry &l,const poolfilter &flt) const
+{
+	int n = flt.path.Count();
+	if((int)(l.key-l.dir) < n) return false;
+	for(int i = 0; i < n; ++i)
+		if(!Equal(atoms[l.dir+i],flt.path[i])) return false;
+	return true;
+}
+
+bool poolparser::Key(const entry &l,const poolfilter &flt)
+{
+	// lines without key (directory mode, chunks) are not subject to the pattern
+	if(flt.key.empty() || l.val == l.key) return true;
+	ktxt.clear();
+	for(size_t i = l.key; i < l.val; ++i) {
+		if(i > l.key) ktxt += ' ';
+		Text(atoms[i],ktxt);
+	}
+	return flt.Key(ktxt.c_str());
+}
+
+void poolparser::Get(size_t b,size_t e,flext::AtomList &l,bool val) const
+{
+	l((int)(e-b));
+	for(size_t i = b; i < e; ++i) {
+		const atom &a = atoms[i];
+		t_atom &t = l[(int)(i-b)];
+		if(a.tp == atom::tp_int)
+			flext::SetInt(t,a.i);
+		else if(a.tp == atom::tp_float)
+			flext::SetFloat(t,a.f);
+		else if(val)
+			poolstrings::Set(t,&strs[a.s]);
+		else
+			flext::SetString(t,&strs[a.s]);
+	}
+}
+
+
+void pooldir::LdLines(const poolparser &ps,int line,int depth,poolcursor &cur,int from,int to)
+{
+	if(to < 0 || to > ps.Entries()) to = ps.Entries();
+	for(int i = from; i < to; ++i) {
+		int ln = line+ps.Line(i);
+		Atoms d,k,*v = new Atoms;
+		if(ps.Get(i,d,k,*v)) {
+			if(depth < 0 || d.Count() <= depth) {
+				pooldir *nd = cur.Dir(d);
+				if(nd) {
+					// size the table for a run of values in this directory
+					if(ps.Run(i) > 1) nd->Reserve(nd->CntAll()+ps.Run(i),0);
+
+                    if(k.Count()) {
+	    				nd->SetVal(k,v); v = NULL;
+                    }
+                    else if(v->Count() && IsSymbol((*v)[0]) && !strcmp(GetString((*v)[0]),"chunk")) {
+                        // no key, packed values of a series
+                        if(!nd->AddChunk(Atoms(v->Count()-1,v->Atoms()+1)))
+                            post("pool - file format invalid: bad value chunk in line %i",ln);
+                    }
+                    else if(v->Count() && !nd->SetMode(*v))
+                        // no key, but data -> directory mode
+                        post("pool - file format invalid: unknown directory mode in line %i",ln);
+				}
+	#ifdef FLEXT_DEBUG
+				else
+					post("pool - directory was not found",ln);
+	#endif
+			}
+		}
+		else
+			post("pool - format mismatch encountered, skipped line %i",ln);
+
+		if(v) delete v;
+	}
+}
+
+bool pooldir::LdDir(const char *buf,size_t len,int depth,bool mkdir,const poolfilter *flt)
+{
+	const char *p = buf,*end = buf+len;
+	int line = 0;
+	poolcursor cur(this,mkdir);
+
+#ifdef POOL_THREADS
+	int thrs = len > POOL_PARSEPIECE?(int)thread::hardware_concurrency():1;
+	if(thrs > 1) {
+		vector<poolparser> ps(thrs);
+		vector<const char *> pcs(thrs+1);
+		vector<thread> th;
+		th.reserve(thrs);
+
+		while(p < end) {
+			// cut next pieces at line boundaries
+			int n = 0;
+			for(pcs[0] = p; n < thrs && p < end; pcs[++n] = p)
+				p = end-p > POOL_PARSEPIECE?NextLine(buf,p+POOL_PARSEPIECE,end):end;
+
+			for(int i = 1; i < n; ++i) {
+				try { th.push_back(thread(&poolparser::Parse,&ps[i],pcs[i],pcs[i+1],depth,flt)); }
+				catch(...) { ps[i].Parse(pcs[i],pcs[i+1],depth,flt); }
+			}
+			ps[0].Parse(pcs[0],pcs[1],depth,flt);
+			for(size_t i = 0; i < th.size(); ++i) th[i].join();
+			th.clear();
+
+			// store in file order
+			for(int i = 0; i < n; ++i) {
+				LdLines(ps[i],line,depth,cur);
+				line += ps[i].Count();
+			}
+		}
+		return true;
+	}
+#endif
+
+	poolparser ps;
+	while(p < end) {
+		const char *e = end-p > POOL_PARSEPIECE?NextLine(buf,p+POOL_PARSEPIECE,end):end;
+		ps.Parse(p,e,depth,flt);
+		LdLines(ps,line,depth,cur);
+		line += ps.Count();
+		p = e;
+	}
+	return true;
+}
+
+
+/* loader for CSV tables (saved by pooldir::SvDirCSV)
+
+   A row is a value: the field in the key column is its key, the other fields are its atoms.
+   Fields in double quotes (doubled within) are symbols, unquoted fields which read as numbers are numbers.
+   Blanks around unquoted fields are dropped, rows with empty key fields (like blank lines) are skipped.
+   Rows are stored as they are scanned, into a table sized for all of them beforehand.
+*/
+
+// atom for an unquoted field, a number if it reads as one (like poolparser::Atom does)
+static void CSVAtom(const char *c,const char *e,t_atom &a,string &tok,bool val)
+{
+	while(c < e && (*c == ' ' || *c == '\t')) ++c;
+	while(e > c && (e[-1] == ' ' || e[-1] == '\t')) --e;
+
+	double d;
+	bool num = c < e && FastNumber(c,e,d);
+	if(!num) tok.assign(c,e);
+	if(!num && c < e && ((*c >= '0' && *c <= '9') || *c == '-' || *c == '+' || *c == '.')) {
+		// leave exotic forms (hex, exponents out of range) to the library, words like "nan" stay symbols
+		char *endp;
+		d = strtod(tok.c_str(),&endp);
+		num = !*endp;
+	}
+	if(num) {
+		float f = (float)d;
+		int i;
+		if(IntNumber(f,i))
+			flext::SetInt(a,i);
+		else
+			flext::SetFloat(a,f);
+	}
+	else if(val)
+		poolstrings::Set(a,tok.c_str());
+	else
+		flext::SetString(a,tok.c_str());
+}
+
+bool pooldir::LdDirCSV(const char *buf,size_t len,int keycol,int keycols,char delim)
+{
+	const char *c = buf,*e = buf+len;
+	// byte order mark
+	if(len >= 3 && !memcmp(c,"\xef\xbb\xbf",3)) c += 3;
+
+	// one value per line, the table is sized for all of them at once
+	int rows = 1;
+	for(const char *l = c; (l = (const char *)memchr(l,'\n',e-l)) != NULL; ++l) ++rows;
+	Reserve(CntAll()+rows,0);
+
+	// characters ending an unquoted field
+	bool stop[256];
+	memset(stop,0,sizeof stop);
+	stop[(unsigned char)delim] = stop['\n'] = stop['\r'] = true;
+
+	vector<t_atom> row,key;
+	string tok;
+	while(c < e) {
+		if(*c == '\n' || *c == '\r') {
+			++c;
+			continue;
+		}
+
+		row.clear();
+		key.clear();
+		bool blank = false;
+		for(int col = 0;; ++col) {
+			bool iskey = col >= keycol && col < keycol+keycols;
+			const char *r = c;
+			while(c < e && (*c == ' ' || *c == '\t') && *c != delim) ++c;
+
+			t_atom a;
+			if(c < e && *c == '"') {
+				tok.clear();
+				for(r = ++c;; ) {
+					c = (const char *)memchr(c,'"',e-c);
+					if(!c) {
+						post("pool - CSV format invalid: unterminated quotes");
+						return false;
+					}
+					tok.append(r,c-r);
+					if(++c == e || *c != '"') break;
+					// escaped quote, kept with the following run
+					r = c++;
+				}
+				while(c < e && (*c == ' ' || *c == '\t') && *c != delim) ++c;
+				if(c < e && !stop[(unsigned char)*c]) {
+					post("pool - CSV format invalid: characters after closing quotes");
+					return false;
+				}
+				if(!iskey)
+					poolstrings::Set(a,tok.c_str());
+				else
+					flext::SetString(a,tok.c_str());
+			}
+			else {
+				while(c < e && !stop[(unsigned char)*c]) ++c;
+				CSVAtom(r,c,a,tok,!iskey);
+				// empty symbols are saved quoted, an empty key field is missing
+				if(iskey && flext::IsSymbol(a) && !*flext::GetString(a)) blank = true;
+			}
+
+			if(iskey)
+				key.push_back(a);
+			else
+				row.push_back(a);
+
+			if(c < e && *c == delim)
+				++c;
+			else
+				break;
+		}
+
+		// rows too short for the key columns or with blank key fields are skipped
+		if((int)key.size() == keycols && !blank) {
+			poolkey k(keycols,&key[0]);
+			SetVal(k,new Atoms((int)row.size(),row.empty()?NULL:&row[0]));
+		}
+	}
+	return true;
+}
+
+#ifdef POOL_THREADS
+// files held parsed ahead of storing, per parsing thread
+#ifndef POOL_FILESAHEAD
+#define POOL_FILESAHEAD 2
+#endif
+
+// a file of a multi-file load
+struct poolldfile
+{
+	poolldfile(): ok(false) {}
+
+	void Parse(const char *flnm)
+	{
+		ok = file.Open(flnm);
+		if(ok) ps.Parse(file.Data(),file.Data()+file.Size());
+	}
+
+	poolfile file;
+	poolparser ps;
+	bool ok;
+};
+
+// files parsed by worker threads, handed over in order
+struct poolldfiles
+{
+	poolldfiles(const vector<string> &f,size_t ahead): flnms(f),files(f.size(),NULL),next(0),stored(0),ahead(ahead),stop(false) {}
+
+	void Run()
+	{
+		for(;;) {
+			size_t i;
+			{
+				unique_lock<mutex> lock(mtx);
+				while(!stop && next < flnms.size() && next >= stored+ahead) cond.wait(lock);
+				if(stop || next >= flnms.size()) return;
+				i = next++;
+			}
+
+			poolldfile *f = new poolldfile;
+			f->Parse(flnms[i].c_str());
+
+			{
+				lock_guard<mutex> lock(mtx);
+				files[i] = f;
+			}
+			cond.notify_all();
+		}
+	}
+
+	// wait for file i (and allow parsing further ones)
+	poolldfile *Get(size_t i)
+	{
+		unique_lock<mutex> lock(mtx);
+		stored = i;
+		cond.notify_all();
+		while(!files[i]) cond.wait(lock);
+		poolldfile *f = files[i];
+		files[i] = NULL;
+		return f;
+	}
+
+	void Stop()
+	{
+		{
+			lock_guard<mutex> lock(mtx);
+			stop = true;
+		}
+		cond.notify_all();
+	}
+
+	const vector<string> &flnms;
+	vector<poolldfile *> files;
+	size_t next,stored,ahead;
+	bool stop;
+	mutex mtx;
+	condition_variable cond;
+};
+#endif
+
+bool pooldata::LdDirs(const AtomList &d,const vector<string> &flnms,int depth,bool mkdir)
+{
+	pooldir *pd = WrDir(d);
+	if(!pd) return false;
+
+	bool ok = true;
+
+#ifdef POOL_THREADS
+	int thrs = (int)thread::hardware_concurrency();
+	if(thrs > (int)flnms.size()) thrs = (int)flnms.size();
+	if(thrs > 1) {
+		poolldfiles lf(flnms,thrs*POOL_FILESAHEAD);
+		vector<thread> th;
+		for(int i = 0; i < thrs; ++i) {
+			try { th.push_back(thread(&poolldfiles::Run,&lf)); }
+			catch(...) { break; }
+		}
+
+		if(!th.empty()) {
+			// store in the given order
+			poolcursor cur(pd,mkdir);
+			for(size_t i = 0; i < flnms.size(); ++i) {
+				poolldfile *f = lf.Get(i);
+				if(f->ok) {
+					if(journal) journal->Load(pooljournal::fmt_txt,d,depth,mkdir,f->file.Data(),f->file.Size());
+					pd->LdLines(f->ps,0,depth,cur);
+				}
+				else
+					ok = false;
+				delete f;
+			}
+			lf.Stop();
+			for(size_t i = 0; i < th.size(); ++i) th[i].join();
+			return ok;
+		}
+	}
+#endif
+
+	for(size_t i = 0; i < flnms.size(); ++i) {
+		poolfile file;
+		if(file.Open(flnms[i].c_str())) {
+			if(journal) journal->Load(pooljournal::fmt_txt,d,depth,mkdir,file.Data(),file.Size());
+			pd->LdDir(file.Data(),file.Size(),depth,mkdir);
+		}
+		else
+			ok = false;
+	}
+	return ok;
+}
+
+
+struct poolloader::piece
+{
+	poolparser ps;
+	size_t begin,end;
+};
+
+poolloader::poolloader(pooldata *p,const AtomList &d,int dp,bool mk,const poolfilter *flt):
+	data(p),dir(d),depth(dp),mkdir(mk),ok(true),
+	ppos(0),pos(0),line(0),
+	cur(NULL),ix(0)
+#ifdef POOL_THREADS
+	,stop(false),eof(false)
+#endif
+{
+	if(flt) filter = *flt;
+}
+
+poolloader::~poolloader()
+{
+	Cancel();
+	if(cur) delete cur;
+	for(size_t i = 0; i < parsed.size(); ++i) delete parsed[i];
+}
+
+bool poolloader::Open(const char *flnm)
+{
+	if(!file.Open(flnm)) return false;
+
+#ifdef POOL_THREADS
+	try { thr = thread(&poolloader::Run,this); }
+	catch(...) {} // parse in Step then
+#endif
+	return true;
+}
+
+void poolloader::Cancel()
+{
+#ifdef POOL_THREADS
+	if(thr.joinable()) {
+		{
+			lock_guard<mutex> lock(mtx);
+			stop = true;
+		}
+		cond.notify_all();
+		thr.join();
+	}
+#endif
+	// parse position at the end
+	ppos = file.Size();
+}
+
+poolloader::piece *poolloader::Parse()
+{
+	const char *buf = file.Data(),*end = buf+file.Size();
+	const char *p = buf+ppos;
+	if(p >= end) return NULL;
+
+	const char *e = end-p > POOL_LOADPIECE?NextLine(buf,p+POOL_LOADPIECE,end):end;
+	piece *pc = new piece;
+	pc->ps.Parse(p,e,depth,filter.Empty()?NULL:&filter);
+	pc->begin = ppos;
+	pc->end = ppos = e-buf;
+	return pc;
+}
+
+#ifdef POOL_THREADS
+void poolloader::Run()
+{
+	for(;;) {
+		piece *pc = Parse();
+
+		unique_lock<mutex> lock(mtx);
+		if(!pc) break;
+		while(!stop && parsed.size() >= POOL_LOADAHEAD) cond.wait(lock);
+		if(stop) {
+			delete pc;
+			break;
+		}
+		parsed.push_back(pc);
+	}
+
+	lock_guard<mutex> lock(mtx);
+	eof = true;
+}
+#endif
+
+poolloader::piece *poolloader::Next()
+{
+#ifdef POOL_THREADS
+	if(thr.joinable()) {
+		piece *pc = NULL;
+		{
+			lock_guard<mutex> lock(mtx);
+			if(!parsed.empty()) {
+				pc = parsed.front();
+				parsed.pop_front();
+			}
+		}
+		if(pc) cond.notify_all();
+		return pc;
+	}
+#endif
+	return Parse();
+}
+
+bool poolloader::Parsed()
+{
+#ifdef POOL_THREADS
+	if(thr.joinable()) {
+		lock_guard<mutex> lock(mtx);
+		return eof && parsed.empty();
+	}
+#endif
+	return ppos >= file.Size();
+}
+
+bool poolloader::Step(double budget)
+{
+	if(!ok) return false;
+
+	// the directory is looked up anew, as the pool may have changed in between
+	pooldir *pd = data->WrDir(dir);
+	if(!pd) {
+		Cancel();
+		ok = false;
+		return false;
+	}
+
+	poolcursor cc(pd,mkdir);
+	double t0 = GetOSTime();
+	do {
+		if(!cur) {
+			cur = Next();
+			if(!cur) {
+				if(!Parsed()) return true; // wait for the parser
+#ifdef POOL_THREADS
+				if(thr.joinable()) thr.join();
+#endif
+				return false;
+			}
+			ix = 0;
+		}
+
+		int n = cur->ps.Entries();
+		int to = n-ix > POOL_LOADSLICE?ix+POOL_LOADSLICE:n;
+		pooljournal *jnl = data->Journal();
+		if(jnl && to > ix) {
+			// log the lines as they are stored
+			const poolparser &ps = cur->ps;
+			jnl->Load(pooljournal::fmt_txt,dir,depth,mkdir,file.Data()+cur->begin+ps.Begin(ix),ps.End(to-1)-ps.Begin(ix),&filter);
+		}
+		pd->LdLines(cur->ps,line,depth,cc,ix,to);
+		ix = to;
+
+		if(ix < n)
+			pos = cur->begin+(size_t)((double)(cur->end-cur->begin)*ix/n);
+		else {
+			line += cur->ps.Count();
+			pos = cur->end;
+			delete cur;
+			cur = NULL;
+		}
+	} while(GetOSTime()-t0 < budget);
+	return true;
+}
@@ -9,12 +9,27 @@ WARRANTIES, see the file, "license.txt," in this distribution.
 #include "pool.h"
 #include <string>
 #include <map>
+#include <list>
+#include <string.h>
+
+#ifdef POOL_THREADS
+#include <atomic>
+#endif
 
 #define POOL_VERSION "0.2.3"
 
 #define VCNT 32
 #define DCNT 8
 
+// interval for checking on background jobs (seconds), about a scheduler tick
+#define JOBPOLL 0.001
+
+// default time for storing loaded data per tick (microseconds)
+#define BUDGET 500
+
+// interval for checking on a watched file (seconds)
+#define WATCHPOLL 0.25
+
 
 class pool:
 	public flext_base
@@ -82,6 +97,17 @@ protected:
 	void m_cntrec(int argc,const t_atom *argv);	// also subdirectories
 	void m_cntsub(int argc,const t_atom *argv);	// only subdirectories
 
+	// queue directories
+	void m_dirmode(int argc,const t_atom *argv);	// set/get storage mode of current dir
+	void m_push(int argc,const t_atom *argv);	// append value
+	void m_pop() { pop(true); }	// get and remove oldest value
+	void m_peek() { pop(false); }	// get oldest value
+	void m_len() { m_cntall(); }	// count values
+
+	// time series directories
+	void m_getat(int argc,const t_atom *argv);	// get latest value at or before time
+	void m_getrange(int argc,const t_atom *argv);	// get values within time range
+
 	// print directories
 	void m_printall();   // print values in current dir
 	void m_printrec(int argc,const t_atom *argv,bool fromroot = false);   // print values recursively
@@ -99,35 +125,66 @@ protected:
 	void m_copyrec(int argc,const t_atom *argv) { copyrec(thisTag(),argc,argv,false); }   // cut directory (and subdirs) into clipboard
 
 	// load/save from/to file
-    void m_load(int argc,const t_atom *argv) { load(argc,argv,false); }
-	void m_save(int argc,const t_atom *argv) { save(argc,argv,false); }
-	void m_loadx(int argc,const t_atom *argv) { load(argc,argv,true); } // XML
-	void m_savex(int argc,const t_atom *argv) { save(argc,argv,true); } // XML
+    void m_load(int argc,const t_atom *argv) { load(argc,argv,file_txt); }
+	void m_save(int argc,const t_atom *argv) { save(argc,argv,file_txt); }
+	void m_loadx(int argc,const t_atom *argv) { load(argc,argv,file_xml); } // XML
+	void m_savex(int argc,const t_atom *argv) { save(argc,argv,file_xml); } // XML
+	void m_loadb(int argc,const t_atom *argv) { load(argc,argv,file_bin); } // binary
+	void m_saveb(int argc,const t_atom *argv) { save(argc,argv,file_bin); } // binary
+	void m_loadj(int argc,const t_atom *argv) { load(argc,argv,file_json); } // JSON
+	void m_savej(int argc,const t_atom *argv) { save(argc,argv,file_json); } // JSON
+	void m_open(int argc,const t_atom *argv);    // serve pool read-only from image
+	void m_saveimg(int argc,const t_atom *argv); // save pool image
+	void m_loadshard(int argc,const t_atom *argv); // load pool from a folder of files
+	void m_saveshard(int argc,const t_atom *argv); // save pool to a folder of files (changed ones only), optionally in groups
+	void m_journal(int argc,const t_atom *argv); // log changes to a journal file (none: stop)
+	void m_compact(); // fold journal into a snapshot
+	void m_cancel(); // cancel background loads
+	void m_watch(int argc,const t_atom *argv); // load file and apply its changes whenever it is written (none: stop)
+	void m_loadcsv(int argc,const t_atom *argv); // load table rows into current dir, keyed by one or more columns
+	void m_savecsv(int argc,const t_atom *argv); // save values in current dir as table rows
 
 	// load directories
-	void m_lddir(int argc,const t_atom *argv) { lddir(argc,argv,false); }   // load values into current dir
-	void m_ldrec(int argc,const t_atom *argv) { ldrec(argc,argv,false); }   // load values recursively
-	void m_ldxdir(int argc,const t_atom *argv) { lddir(argc,argv,true); }   // load values into current dir (XML)
-	void m_ldxrec(int argc,const t_atom *argv) { ldrec(argc,argv,true); }   // load values recursively (XML)
+	void m_lddir(int argc,const t_atom *argv) { lddir(argc,argv,file_txt); }   // load values into current dir
+	void m_ldrec(int argc,const t_atom *argv) { ldrec(argc,argv,file_txt); }   // load values recursively
+	void m_ldxdir(int argc,const t_atom *argv) { lddir(argc,argv,file_xml); }   // load values into current dir (XML)
+	void m_ldxrec(int argc,const t_atom *argv) { ldrec(argc,argv,file_xml); }   // load values recursively (XML)
+	void m_ldbdir(int argc,const t_atom *argv) { lddir(argc,argv,file_bin); }   // load values into current dir (binary)
+	void m_ldbrec(int argc,const t_atom *argv) { ldrec(argc,argv,file_bin); }   // load values recursively (binary)
+	void m_ldjdir(int argc,const t_atom *argv) { lddir(argc,argv,file_json); }   // load values into current dir (JSON)
+	void m_ldjrec(int argc,const t_atom *argv) { ldrec(argc,argv,file_json); }   // load values recursively (JSON)
 
 	// save directories
-	void m_svdir(int argc,const t_atom *argv) { svdir(argc,argv,false); }   // save values in current dir
-	void m_svrec(int argc,const t_atom *argv) { svrec(argc,argv,false); }   // save values recursively
-	void m_svxdir(int argc,const t_atom *argv) { svdir(argc,argv,true); }   // save values in current dir (XML)
-	void m_svxrec(int argc,const t_atom *argv) { svrec(argc,argv,true); }   // save values recursively (XML)
+	void m_svdir(int argc,const t_atom *argv) { svdir(argc,argv,file_txt); }   // save values in current dir
+	void m_svrec(int argc,const t_atom *argv) { svrec(argc,argv,file_txt); }   // save values recursively
+	void m_svxdir(int argc,const t_atom *argv) { svdir(argc,argv,file_xml); }   // save values in current dir (XML)
+	void m_svxrec(int argc,const t_atom *argv) { svrec(argc,argv,file_xml); }   // save values recursively (XML)
+	void m_svbdir(int argc,const t_atom *argv) { svdir(argc,argv,file_bin); }   // save values in current dir (binary)
+	void m_svbrec(int argc,const t_atom *argv) { svrec(argc,argv,file_bin); }   // save values recursively (binary)
+	void m_svjdir(int argc,const t_atom *argv) { svdir(argc,argv,file_json); }   // save values in current dir (JSON)
+	void m_svjrec(int argc,const t_atom *argv) { svrec(argc,argv,file_json); }   // save values recursively (JSON)
 
 private:
 	static bool KeyChk(const t_atom &a);
+	bool KeyChk(int argc,const t_atom *argv) const;
+	int KeyLen() const { return keylen > 1?keylen:1; }
 	static bool ValChk(int argc,const t_atom *argv);
 	static bool ValChk(const AtomList &l) { return ValChk(l.Count(),l.Atoms()); }
+	static bool CSVDelim(const t_atom &a,char &delim);
 	void ToOutAtom(int ix,const t_atom &a);
+	void ToOutKey(int ix,const poolkey &k);
+	void ToOutVal(int ix,const AtomList &l);
 
     static const t_symbol *sym_echo;
     static const t_symbol *sym_error;
+    static const t_symbol *sym_loadprogress;
+    static const t_symbol *sym_reload;
 
     enum get_t { get_norm,get_cnt,get_print };
+    enum file_t { file_txt,file_xml,file_bin,file_json };
 
 	void set(int argc,const t_atom *argv,bool over);
+	void pop(bool cut);
 	void getdir(const t_symbol *tag);
 	int getrec(const t_symbol *tag,int level,int order,bool rev,get_t how /*= get_norm*/,const AtomList &rdir);
 	int getsub(const t_symbol *tag,int level,int order,bool rev,get_t how /*= get_norm*/,const AtomList &rdir);
@@ -137,17 +194,31 @@ private:
 	void copyall(const t_symbol *tag,bool cut,int lvls);
 	void copyrec(const t_symbol *tag,int argc,const t_atom *argv,bool cut);
 
-	void load(int argc,const t_atom *argv,bool xml);
-	void save(int argc,const t_atom *argv,bool xml);
-	void lddir(int argc,const t_atom *argv,bool xml);   // load values into current dir
-	void ldrec(int argc,const t_atom *argv,bool xml);   // load values recursively
-	void svdir(int argc,const t_atom *argv,bool xml);   // save values in current dir
-	void svrec(int argc,const t_atom *argv,bool xml);   // save values recursively
+	void load(int argc,const t_atom *argv,file_t fmt);
+	void save(int argc,const t_atom *argv,file_t fmt);
+	void lddir(int argc,const t_atom *argv,file_t fmt);   // load values into current dir
+	void ldrec(int argc,const t_atom *argv,file_t fmt);   // load values recursively
+	void svdir(int argc,const t_atom *argv,file_t fmt);   // save values in current dir
+	void svrec(int argc,const t_atom *argv,file_t fmt);   // save values recursively
+
+	bool LdDir(const AtomList &d,const char *flnm,file_t fmt,int depth,bool mkdir = true);
+	bool SvDir(const AtomList &d,const char *flnm,file_t fmt,int depth,bool absdir) { pl->Written(flnm); return SvDir(pl,d,flnm,fmt,depth,absdir); }
+	static bool SvDir(pooldata *p,const AtomList &d,const char *flnm,file_t fmt,int depth,bool absdir);
+	// save a snapshot in the background, false if that's not possible
+	bool SvAsync(const AtomList &d,const string &flnm,file_t fmt,int depth,bool absdir);
+	// load in steps in the background, false if that's not possible
+	bool LdAsync(const AtomList &d,const string &flnm,file_t fmt,int depth,bool mkdir);
 
 	void echodir() { if(echo) getdir(sym_echo); }
 
-	bool absdir,echo;
+	bool absdir,echo,async;
+	bool ownstr; // symbols of loaded values kept as pool-owned strings
+	int budget;
+	// selection for loading text and XML files: directory path and key pattern
+	Atoms loaddir;
+	const t_symbol *loadkey;
 	int vcnt,dcnt;
+	int keylen; // number of atoms forming a key
 	pooldata *pl;
 	Atoms curdir;
 	pooldir *clip;
@@ -165,14 +236,69 @@ private:
 
 	string MakeFilename(const char *fn) const;
 
+#ifdef POOL_THREADS
+	// save running in the background
+	struct svjob {
+		svjob(): data(NULL),ok(false),done(false) {}
+		~svjob() { if(data) delete data; }
+
+		pooldata *data; // snapshot
+		Atoms dir;
+		string file;
+		file_t fmt;
+		int depth;
+		bool absdir,ok;
+		const t_symbol *tag;
+		thread thr;
+		atomic<bool> done;
+	};
+
+	static void SvRun(svjob *j);
+
+	std::list<svjob *> jobs;
+#endif
+
+	// load running in the background
+	struct ldjob {
+		ldjob(): ld(NULL),pos(0) {}
+		~ldjob() { if(ld) delete ld; }
+
+		poolloader *ld;
+		const t_symbol *tag;
+		size_t pos; // last reported
+	};
+
+	std::list<ldjob *> loads;
+	void StopLoads(bool report);
+
+	Timer jobtmr;
+	bool JobsIdle() const;
+	// start polling before adding a job
+	void StartJobs() { if(JobsIdle()) jobtmr.Periodic(JOBPOLL); }
+
+	void m_jobs(void *);
+	FLEXT_CALLBACK_T(m_jobs)
+
+	// watched file, see poolwatch
+	poolwatch *watch;
+	Timer watchtmr;
+	void m_watchtick(void *);
+	FLEXT_CALLBACK_T(m_watchtick)
+
 	FLEXT_CALLVAR_V(mg_pool,ms_pool)
 	FLEXT_ATTRGET_V(curdir)
 	FLEXT_CALLSET_V(ms_curdir)
 	FLEXT_ATTRVAR_B(absdir)
 	FLEXT_ATTRVAR_B(echo)
+	FLEXT_ATTRVAR_B(async)
+	FLEXT_ATTRVAR_B(ownstr)
+	FLEXT_ATTRVAR_I(budget)
+	FLEXT_ATTRVAR_V(loaddir)
+	FLEXT_ATTRVAR_S(loadkey)
 	FLEXT_CALLGET_B(mg_priv)
 	FLEXT_ATTRVAR_I(vcnt)
 	FLEXT_ATTRVAR_I(dcnt)
+	FLEXT_ATTRVAR_I(keylen)
 
 	FLEXT_CALLBACK(m_help)
 
@@ -208,6 +334,13 @@ private:
 	FLEXT_CALLBACK(m_cntall)
 	FLEXT_CALLBACK_V(m_cntrec)
 	FLEXT_CALLBACK_V(m_cntsub)
+	FLEXT_CALLBACK_V(m_dirmode)
+	FLEXT_CALLBACK_V(m_push)
+	FLEXT_CALLBACK(m_pop)
+	FLEXT_CALLBACK(m_peek)
+	FLEXT_CALLBACK(m_len)
+	FLEXT_CALLBACK_V(m_getat)
+	FLEXT_CALLBACK_V(m_getrange)
 	FLEXT_CALLBACK(m_printall)
 	FLEXT_CALLBACK_V(m_printrec)
 	FLEXT_CALLBACK(m_printroot)
@@ -234,13 +367,35 @@ private:
 	FLEXT_CALLBACK_V(m_ldxrec)
 	FLEXT_CALLBACK_V(m_svxdir)
 	FLEXT_CALLBACK_V(m_svxrec)
+	FLEXT_CALLBACK_V(m_loadb)
+	FLEXT_CALLBACK_V(m_saveb)
+	FLEXT_CALLBACK_V(m_open)
+	FLEXT_CALLBACK_V(m_saveimg)
+	FLEXT_CALLBACK_V(m_loadshard)
+	FLEXT_CALLBACK_V(m_saveshard)
+	FLEXT_CALLBACK_V(m_journal)
+	FLEXT_CALLBACK(m_compact)
+	FLEXT_CALLBACK_V(m_watch)
+	FLEXT_CALLBACK_V(m_loadcsv)
+	FLEXT_CALLBACK_V(m_savecsv)
+	FLEXT_CALLBACK(m_cancel)
+	FLEXT_CALLBACK_V(m_ldbdir)
+	FLEXT_CALLBACK_V(m_ldbrec)
+	FLEXT_CALLBACK_V(m_svbdir)
+	FLEXT_CALLBACK_V(m_svbrec)
+	FLEXT_CALLBACK_V(m_loadj)
+	FLEXT_CALLBACK_V(m_savej)
+	FLEXT_CALLBACK_V(m_ldjdir)
+	FLEXT_CALLBACK_V(m_ldjrec)
+	FLEXT_CALLBACK_V(m_svjdir)
+	FLEXT_CALLBACK_V(m_svjrec)
 };
 
 FLEXT_NEW_V("pool",pool)
 
 
 pool::PoolMap pool::poolmap;	
-const t_symbol *pool::sym_echo,*pool::sym_error;
+const t_symbol *pool::sym_echo,*pool::sym_error,*pool::sym_loadprogress,*pool::sym_reload;
 const t_symbol *pool::holdname;
 
 
@@ -252,14 +407,23 @@ void pool::setup(t_classid c)
 
     sym_echo = MakeSymbol("echo");
     sym_error = MakeSymbol("error");
+    sym_loadprogress = MakeSymbol("loadprogress");
+    sym_reload = MakeSymbol("reload");
+    poolstore::Setup();
 
 	FLEXT_CADDATTR_VAR(c,"pool",mg_pool,ms_pool);
 	FLEXT_CADDATTR_VAR(c,"curdir",curdir,ms_curdir);
 	FLEXT_CADDATTR_VAR1(c,"absdir",absdir);
 	FLEXT_CADDATTR_VAR1(c,"echodir",echo);
+	FLEXT_CADDATTR_VAR1(c,"async",async);
+	FLEXT_CADDATTR_VAR1(c,"budget",budget);
+	FLEXT_CADDATTR_VAR1(c,"loaddir",loaddir);
+	FLEXT_CADDATTR_VAR1(c,"loadkey",loadkey);
+	FLEXT_CADDATTR_VAR1(c,"ownstrings",ownstr);
 	FLEXT_CADDATTR_GET(c,"private",mg_priv);
 	FLEXT_CADDATTR_VAR1(c,"valcnt",vcnt);
 	FLEXT_CADDATTR_VAR1(c,"dircnt",dcnt);
+	FLEXT_CADDATTR_VAR1(c,"keylen",keylen);
 
 	FLEXT_CADDMETHOD_(c,0,"help",m_help);
 	FLEXT_CADDMETHOD_(c,0,"reset",m_reset);
@@ -294,6 +458,14 @@ void pool::setup(t_classid c)
 	FLEXT_CADDMETHOD_(c,0,"cntrec",m_cntrec);
 	FLEXT_CADDMETHOD_(c,0,"cntsub",m_cntsub);
 
+	FLEXT_CADDMETHOD_(c,0,"dirmode",m_dirmode);
+	FLEXT_CADDMETHOD_(c,0,"push",m_push);
+	FLEXT_CADDMETHOD_(c,0,"pop",m_pop);
+	FLEXT_CADDMETHOD_(c,0,"peek",m_peek);
+	FLEXT_CADDMETHOD_(c,0,"len",m_len);
+	FLEXT_CADDMETHOD_(c,0,"getat",m_getat);
+	FLEXT_CADDMETHOD_(c,0,"getrange",m_getrange);
+
 	FLEXT_CADDMETHOD_(c,0,"printall",m_printall);
 	FLEXT_CADDMETHOD_(c,0,"printrec",m_printrec);
 	FLEXT_CADDMETHOD_(c,0,"printroot",m_printroot);
@@ -320,13 +492,36 @@ void pool::setup(t_classid c)
 	FLEXT_CADDMETHOD_(c,0,"ldxrec",m_ldxrec);
 	FLEXT_CADDMETHOD_(c,0,"svxdir",m_svxdir);
 	FLEXT_CADDMETHOD_(c,0,"svxrec",m_svxrec);
+	FLEXT_CADDMETHOD_(c,0,"loadb",m_loadb);
+	FLEXT_CADDMETHOD_(c,0,"saveb",m_saveb);
+	FLEXT_CADDMETHOD_(c,0,"open",m_open);
+	FLEXT_CADDMETHOD_(c,0,"saveimg",m_saveimg);
+	FLEXT_CADDMETHOD_(c,0,"loadshard",m_loadshard);
+	FLEXT_CADDMETHOD_(c,0,"saveshard",m_saveshard);
+	FLEXT_CADDMETHOD_(c,0,"journal",m_journal);
+	FLEXT_CADDMETHOD_(c,0,"compact",m_compact);
+	FLEXT_CADDMETHOD_(c,0,"watch",m_watch);
+	FLEXT_CADDMETHOD_(c,0,"cancel",m_cancel);
+	FLEXT_CADDMETHOD_(c,0,"ldbdir",m_ldbdir);
+	FLEXT_CADDMETHOD_(c,0,"ldbrec",m_ldbrec);
+	FLEXT_CADDMETHOD_(c,0,"svbdir",m_svbdir);
+	FLEXT_CADDMETHOD_(c,0,"svbrec",m_svbrec);
+	FLEXT_CADDMETHOD_(c,0,"loadj",m_loadj);
+	FLEXT_CADDMETHOD_(c,0,"savej",m_savej);
+	FLEXT_CADDMETHOD_(c,0,"ldjdir",m_ldjdir);
+	FLEXT_CADDMETHOD_(c,0,"ldjrec",m_ldjrec);
+	FLEXT_CADDMETHOD_(c,0,"svjdir",m_svjdir);
+	FLEXT_CADDMETHOD_(c,0,"svjrec",m_svjrec);
+	FLEXT_CADDMETHOD_(c,0,"loadcsv",m_loadcsv);
+	FLEXT_CADDMETHOD_(c,0,"savecsv",m_savecsv);
 }
 
 pool::pool(int argc,const t_atom *argv):
-	absdir(true),echo(false),
+	absdir(true),echo(false),async(false),ownstr(false),budget(BUDGET),loadkey(sym__),
     pl(NULL),
 	clip(NULL),
-	vcnt(VCNT),dcnt(DCNT)
+	vcnt(VCNT),dcnt(DCNT),keylen(1),
+	watch(NULL)
 {
 	holdname = argc >= 1 && IsSymbol(argv[0])?GetSymbol(argv[0]):NULL;
 
@@ -335,10 +530,22 @@ pool::pool(int argc,const t_atom *argv):
 	AddOutAnything();
 	AddOutList();
 	AddOutAnything();
+
+	FLEXT_ADDTIMER(jobtmr,m_jobs);
+	FLEXT_ADDTIMER(watchtmr,m_watchtick);
 }
 
 pool::~pool()
 {
+#ifdef POOL_THREADS
+	// background saves work on their own snapshots, let them finish
+	for(std::list<svjob *>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		(*it)->thr.join();
+		delete *it;
+	}
+#endif
+
+	if(watch) delete watch;
 	FreePool();
 }
 
@@ -377,6 +584,8 @@ void pool::SetPool(const t_symbol *s)
 
 void pool::FreePool()
 {
+	StopLoads(false);
+
 	curdir(); // reset current directory
 
 	if(pl) {
@@ -506,14 +715,19 @@ void pool::m_rmdir(int argc,const t_atom *argv,bool abs)
 
 void pool::set(int argc,const t_atom *argv,bool over)
 {
-	if(!argc || !KeyChk(argv[0])) 
+	int kl = KeyLen();
+	if(!KeyChk(argc,argv)) 
 		post("%s - %s: invalid key",thisName(),GetString(thisTag()));
-	else if(!ValChk(argc-1,argv+1)) {
+	else if(!ValChk(argc-kl,argv+kl)) {
 		post("%s - %s: invalid data values",thisName(),GetString(thisTag()));
 	}
-	else 
-		if(!pl->Set(curdir,argv[0],new AtomList(argc-1,argv+1),over))
+	else {
+		AtomList *data = new AtomList(argc-kl,argv+kl);
+		if(!pl->Set(curdir,poolkey(kl,argv),data,over)) {
+			delete data;
 			post("%s - %s: value couldn't be set",thisName(),GetString(thisTag()));
+		}
+	}
 
 	echodir();
 }
@@ -534,13 +748,13 @@ void pool::m_seti(int argc,const t_atom *argv)
 
 void pool::m_clr(int argc,const t_atom *argv)
 {
-	if(!argc || !KeyChk(argv[0]))
+	if(!KeyChk(argc,argv))
 		post("%s - %s: invalid key",thisName(),GetString(thisTag()));
 	else {
-		if(argc > 1) 
+		if(argc > KeyLen()) 
 			post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
 
-		if(!pl->Clr(curdir,argv[0]))
+		if(!pl->Clr(curdir,poolkey(KeyLen(),argv)))
 			post("%s - %s: value couldn't be cleared",thisName(),GetString(thisTag()));
 	}
 
@@ -585,13 +799,13 @@ void pool::m_clrsub()
 
 void pool::m_get(int argc,const t_atom *argv)
 {
-	if(!argc || !KeyChk(argv[0]))
+	if(!KeyChk(argc,argv))
 		post("%s - %s: invalid key",thisName(),GetString(thisTag()));
 	else {
-		if(argc > 1) 
+		if(argc > KeyLen()) 
 			post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
 
-		poolval *r = pl->Ref(curdir,argv[0]);
+		poolval *r = pl->Ref(curdir,poolkey(KeyLen(),argv));
 
 		ToSysAnything(3,thisTag(),0,NULL);
 		if(absdir)
@@ -599,8 +813,8 @@ void pool::m_get(int argc,const t_atom *argv)
 		else
 			ToSysList(2,0,NULL);
 		if(r) {
-			ToOutAtom(1,r->key);
-			ToSysList(0,*r->data);
+			ToOutKey(1,r->Key());
+			ToOutVal(0,*r->data);
 		}
 		else {
 			ToSysBang(1);
@@ -624,8 +838,91 @@ void pool::m_geti(int ix)
 		else
 			ToSysList(2,0,NULL);
 		if(r) {
-			ToOutAtom(1,r->key);
-			ToSysList(0,*r->data);
+			ToOutKey(1,r->Key());
+			ToOutVal(0,*r->data);
+		}
+		else {
+			ToSysBang(1);
+			ToSysBang(0);
+		}
+	}
+
+	echodir();
+}
+
+void pool::m_dirmode(int argc,const t_atom *argv)
+{
+	if(argc) {
+		if(!pl->SetMode(curdir,AtomList(argc,argv)))
+			post("%s - %s: invalid mode or directory",thisName(),GetString(thisTag()));
+	}
+	else {
+		// report mode through attribute outlet
+		Atoms m;
+		if(pl->GetMode(curdir,m))
+		    ToOutAnything(GetOutAttr(),thisTag(),m.Count(),m.Atoms());
+		else
+			post("%s - %s: directory not found",thisName(),GetString(thisTag()));
+	}
+
+	echodir();
+}
+
+void pool::m_push(int argc,const t_atom *argv)
+{
+	if(!ValChk(argc,argv))
+		post("%s - %s: invalid data values",thisName(),GetString(thisTag()));
+	else {
+		AtomList *data = new Atoms(argc,argv);
+		if(!pl->PushVal(curdir,data)) {
+			delete data;
+			post("%s - %s: directory is not a queue",thisName(),GetString(thisTag()));
+		}
+	}
+
+	echodir();
+}
+
+void pool::pop(bool cut)
+{
+	poolval *r = cut?pl->PopVal(curdir):pl->Refi(curdir,0);
+
+	ToSysAnything(3,thisTag(),0,NULL);
+	if(absdir)
+		ToSysList(2,curdir);
+	else
+		ToSysList(2,0,NULL);
+	if(r) {
+		ToOutKey(1,r->Key());
+		ToOutVal(0,*r->data);
+		if(cut) delete r;
+	}
+	else {
+		ToSysBang(1);
+		ToSysBang(0);
+	}
+
+	echodir();
+}
+
+void pool::m_getat(int argc,const t_atom *argv)
+{
+	if(!argc || !CanbeFloat(argv[0]))
+		post("%s - %s: invalid time",thisName(),GetString(thisTag()));
+	else {
+		if(argc > 1) 
+			post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+
+		poolval *r = pl->RefAt(curdir,GetAFloat(argv[0]));
+
+		ToSysAnything(3,thisTag(),0,NULL);
+		if(absdir)
+			ToSysList(2,curdir);
+		else
+			ToSysList(2,0,NULL);
+		if(r) {
+			ToOutKey(1,r->Key());
+			ToOutVal(0,*r->data);
 		}
 		else {
 			ToSysBang(1);
@@ -636,6 +933,38 @@ void pool::m_geti(int ix)
 	echodir();
 }
 
+void pool::m_getrange(int argc,const t_atom *argv)
+{
+	if(argc < 2 || !CanbeFloat(argv[0]) || !CanbeFloat(argv[1]))
+		post("%s - %s: invalid time range",thisName(),GetString(thisTag()));
+	else {
+		if(argc > 2) 
+			post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+
+		Atoms *k;
+		Atoms *r;
+		int cnt = pl->GetRange(curdir,GetAFloat(argv[0]),GetAFloat(argv[1]),k,r);
+		if(cnt < 0)
+			post("%s - %s: error retrieving values",thisName(),GetString(thisTag()));
+		else {
+			for(int i = 0; i < cnt; ++i) {
+				ToSysAnything(3,thisTag(),0,NULL);
+				if(absdir)
+					ToSysList(2,curdir);
+				else
+					ToSysList(2,0,NULL);
+				ToOutKey(1,k[i]);
+				ToOutVal(0,r[i]);
+			}
+			delete[] k;
+			delete[] r;
+		}
+		ToSysBang(3);
+	}
+
+	echodir();
+}
+
 
 // ---- some sorting stuff ----------------------------------
 
@@ -647,7 +976,14 @@ inline void swap(t_atom *a,t_atom *b) { t_atom *c = a; a = b; b = c; }
 
 inline bool smaller(const Atoms &a,const Atoms &b,int index) 
 { 
-	if(a.Count()-1 < index)
+	if(index < 0) {
+		// whole lists (tuple keys)
+		for(int i = 0; i < a.Count() && i < b.Count(); ++i)
+			if(a[i] < b[i]) return true;
+			else if(b[i] < a[i]) return false;
+		return a.Count() < b.Count();
+	}
+	else if(a.Count()-1 < index)
 		return true;
 	else if(b.Count()-1 < index)
 		return false;
@@ -707,7 +1043,7 @@ static void orderpairs(T1 *keys,T2 *atoms,int count,int index,bool rev)
 	if(index)
 		heapsort(atoms,keys,count,index-1,rev);
 	else
-		heapsort(keys,atoms,count,0,rev);
+		heapsort(keys,atoms,count,-1,rev);
 }
 
 // ---- sorting stuff ends ----------------------------------
@@ -727,7 +1063,7 @@ int pool::getrec(const t_symbol *tag,int level,int order,bool rev,get_t how,cons
 			ret = pl->PrintAll(gldir);
 			break;
 		case get_norm: {
-			t_atom *k;
+			Atoms *k;
 			Atoms *r;
 			int cnt = pl->GetAll(gldir,k,r);
 			if(!k) {
@@ -743,8 +1079,8 @@ int pool::getrec(const t_symbol *tag,int level,int order,bool rev,get_t how,cons
 				for(int i = 0; i < cnt; ++i) {
 					ToSysAnything(3,tag,0,NULL);
 					ToSysList(2,absdir?gldir:rdir);
-					ToOutAtom(1,k[i]);
-					ToSysList(0,r[i]);
+					ToOutKey(1,k[i]);
+					ToOutVal(0,r[i]);
 				}
 				delete[] k;
 				delete[] r;
@@ -1109,14 +1445,14 @@ void pool::m_clrclip()
 
 void pool::copy(const t_symbol *tag,int argc,const t_atom *argv,bool cut)
 {
-	if(!argc || !KeyChk(argv[0]))
+	if(!KeyChk(argc,argv))
 		post("%s - %s: invalid key",thisName(),GetString(tag));
 	else {
-		if(argc > 1) 
+		if(argc > KeyLen()) 
 			post("%s - %s: superfluous arguments ignored",thisName(),GetString(tag));
 
 		m_clrclip();
-		clip = pl->Copy(curdir,argv[0],cut);
+		clip = pl->Copy(curdir,poolkey(KeyLen(),argv),cut);
 
 		if(!clip)
 			post("%s - %s: Copying into clipboard failed",thisName(),GetString(tag));
@@ -1154,7 +1490,7 @@ void pool::copyrec(const t_symbol *tag,int argc,const t_atom *argv,bool cut)
 	copyall(tag,cut,lvls);
 }
 
-void pool::load(int argc,const t_atom *argv,bool xml)
+void pool::load(int argc,const t_atom *argv,file_t fmt)
 {
     const char *flnm = NULL;
 	if(argc > 0) {
@@ -1167,7 +1503,12 @@ void pool::load(int argc,const t_atom *argv,bool xml)
 		post("%s - %s: no filename given",thisName(),GetString(thisTag()));
 	else {
 		string file(MakeFilename(flnm));
-        ok = xml?pl->LoadXML(file.c_str()):pl->Load(file.c_str());
+		if(async && LdAsync(AtomList(),file,fmt,-1,true)) {
+			// result is output when done
+			echodir();
+			return;
+		}
+        ok = LdDir(AtomList(),file.c_str(),fmt,-1);
 		if(!ok)
 			post("%s - %s: error loading data",thisName(),GetString(thisTag()));
 	}
@@ -1178,7 +1519,7 @@ void pool::load(int argc,const t_atom *argv,bool xml)
 	echodir();
 }
 
-void pool::save(int argc,const t_atom *argv,bool xml)
+void pool::save(int argc,const t_atom *argv,file_t fmt)
 {
 	const char *flnm = NULL;
 	if(argc > 0) {
@@ -1191,7 +1532,12 @@ void pool::save(int argc,const t_atom *argv,bool xml)
 		post("%s - %s: no filename given",thisName(),GetString(thisTag()));
 	else {
 		string file(MakeFilename(flnm));
-        ok = xml?pl->SaveXML(file.c_str()):pl->Save(file.c_str());
+		if(async && SvAsync(AtomList(),file,fmt,-1,true)) {
+			// result is output when done
+			echodir();
+			return;
+		}
+        ok = SvDir(AtomList(),file.c_str(),fmt,-1,true);
 		if(!ok)
 			post("%s - %s: error saving data",thisName(),GetString(thisTag()));
 	}
@@ -1202,7 +1548,288 @@ void pool::save(int argc,const t_atom *argv,bool xml)
 	echodir();
 }
 
-void pool::lddir(int argc,const t_atom *argv,bool xml)
+void pool::m_open(int argc,const t_atom *argv)
+{
+    const char *flnm = NULL;
+	if(argc > 0) {
+		if(argc > 1) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+	}
+
+    bool ok = false;
+	if(!flnm) 
+		post("%s - %s: no filename given",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+        ok = pl->Open(file.c_str());
+		if(ok)
+			curdir();
+		else
+			post("%s - %s: error opening image",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+
+	echodir();
+}
+
+void pool::m_saveimg(int argc,const t_atom *argv)
+{
+	const char *flnm = NULL;
+	if(argc > 0) {
+		if(argc > 1) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+	}
+
+    bool ok = false;
+	if(!flnm) 
+		post("%s - %s: no filename given",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+        ok = pl->SvImage(file.c_str());
+		if(!ok)
+			post("%s - %s: error saving image",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+}
+
+void pool::m_loadshard(int argc,const t_atom *argv)
+{
+    const char *flnm = NULL;
+	if(argc > 0) {
+		if(argc > 1) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+	}
+
+    bool ok = false;
+	if(!flnm) 
+		post("%s - %s: no folder given",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+		poolstrings::Use strs(ownstr);
+        ok = pl->LdShards(file.c_str());
+		if(!ok)
+			post("%s - %s: error loading data",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+
+	echodir();
+}
+
+void pool::m_saveshard(int argc,const t_atom *argv)
+{
+	const char *flnm = NULL;
+	int groups = 0;
+	if(argc >= 1) {
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+
+		if(argc >= 2) {
+			if(CanbeInt(argv[1]) && GetAInt(argv[1]) >= 0) groups = GetAInt(argv[1]);
+			else
+				post("%s - %s: invalid groups argument - set to 0",thisName(),GetString(thisTag()));
+
+			if(argc > 2) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+		}
+	}
+
+    bool ok = false;
+	if(!flnm) 
+		post("%s - %s: no folder given",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+        ok = pl->SvShards(file.c_str(),groups);
+		if(!ok)
+			post("%s - %s: error saving data",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+}
+
+void pool::m_journal(int argc,const t_atom *argv)
+{
+	const char *flnm = NULL;
+	if(argc > 0) {
+		if(argc > 1) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+	}
+
+    bool ok = false;
+	if(!flnm) {
+		pl->CloseJournal();
+		ok = true;
+	}
+	else if(pl->Private())
+		post("%s - %s: only named pools can be journaled",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+        ok = pl->OpenJournal(file.c_str());
+		if(ok)
+			curdir();
+		else
+			post("%s - %s: error opening journal",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+
+	echodir();
+}
+
+void pool::m_compact()
+{
+	bool ok = false;
+	if(!pl->Journal())
+		post("%s - %s: pool is not journaled",thisName(),GetString(thisTag()));
+	else {
+		ok = pl->Compact();
+		if(!ok)
+			post("%s - %s: error compacting journal",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+}
+
+void pool::m_watch(int argc,const t_atom *argv)
+{
+	const char *flnm = NULL;
+	if(argc > 0) {
+		if(argc > 1) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+	}
+
+	if(watch) {
+		watchtmr.Reset();
+		delete watch;
+		watch = NULL;
+	}
+
+    bool ok = true;
+	if(flnm) {
+		string file(MakeFilename(flnm));
+		watch = new poolwatch;
+		poolstrings::Use strs(ownstr);
+		ok = watch->Open(file.c_str(),pl) >= 0;
+		if(ok)
+			watchtmr.Periodic(WATCHPOLL);
+		else {
+			post("%s - %s: error loading data",thisName(),GetString(thisTag()));
+			delete watch;
+			watch = NULL;
+		}
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+
+	echodir();
+}
+
+void pool::m_watchtick(void *)
+{
+	if(!watch || !watch->Changed()) return;
+
+	poolstrings::Use strs(ownstr);
+	int cnt = watch->Reload(pl);
+	if(cnt < 0)
+		post("%s - reload: error loading %s",thisName(),watch->Name());
+	else if(cnt) {
+		// changes are reported with their number
+		t_atom at; SetInt(at,cnt);
+		ToOutAnything(GetOutAttr(),sym_reload,1,&at);
+	}
+}
+
+bool pool::CSVDelim(const t_atom &a,char &delim)
+{
+	if(!IsSymbol(a)) return false;
+	// a comma or semicolon can't be part of a message
+	const char *s = GetString(a);
+	if(!strcmp(s,"comma")) delim = ',';
+	else if(!strcmp(s,"semicolon")) delim = ';';
+	else if(!strcmp(s,"tab")) delim = '\t';
+	else if(!strcmp(s,"space")) delim = ' ';
+	else if(s[0] && !s[1] && s[0] != '"' && s[0] != '\n' && s[0] != '\r') delim = s[0];
+	else return false;
+	return true;
+}
+
+void pool::m_loadcsv(int argc,const t_atom *argv)
+{
+	const char *flnm = NULL;
+	int keycol = 0,keycols = KeyLen();
+	char delim = ',';
+	if(argc > 0) {
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+		if(argc > 1) {
+			if(CanbeInt(argv[1]) && GetAInt(argv[1]) >= 0)
+				keycol = GetAInt(argv[1]);
+			else
+				post("%s - %s: invalid key column, using 0",thisName(),GetString(thisTag()));
+		}
+		if(argc > 2 && !CSVDelim(argv[2],delim))
+			post("%s - %s: invalid delimiter, using comma",thisName(),GetString(thisTag()));
+		if(argc > 3) {
+			// tuple keys
+			if(CanbeInt(argv[3]) && GetAInt(argv[3]) >= 1)
+				keycols = GetAInt(argv[3]);
+			else
+				post("%s - %s: invalid number of key columns, using %i",thisName(),GetString(thisTag()),keycols);
+		}
+		if(argc > 4) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+	}
+
+    bool ok = false;
+	if(!flnm)
+		post("%s - %s: no filename given",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+		poolstrings::Use strs(ownstr);
+        ok = pl->LdDirCSV(curdir,file.c_str(),keycol,keycols,delim);
+		if(!ok)
+			post("%s - %s: error loading data",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+
+	echodir();
+}
+
+void pool::m_savecsv(int argc,const t_atom *argv)
+{
+	const char *flnm = NULL;
+	char delim = ',';
+	if(argc > 0) {
+		if(IsString(argv[0])) flnm = GetString(argv[0]);
+		if(argc > 1 && !CSVDelim(argv[1],delim))
+			post("%s - %s: invalid delimiter, using comma",thisName(),GetString(thisTag()));
+		if(argc > 2) post("%s - %s: superfluous arguments ignored",thisName(),GetString(thisTag()));
+	}
+
+    bool ok = false;
+	if(!flnm)
+		post("%s - %s: no filename given",thisName(),GetString(thisTag()));
+	else {
+		string file(MakeFilename(flnm));
+        ok = pl->SvDirCSV(curdir,file.c_str(),delim);
+		if(!ok)
+			post("%s - %s: error saving data",thisName(),GetString(thisTag()));
+	}
+
+    t_atom at; SetBool(at,ok);
+    ToOutAnything(GetOutAttr(),thisTag(),1,&at);
+
+	echodir();
+}
+
+void pool::lddir(int argc,const t_atom *argv,file_t fmt)
 {
 	const char *flnm = NULL;
 	if(argc > 0) {
@@ -1215,7 +1842,12 @@ void pool::lddir(int argc,const t_atom *argv,bool xml)
 		post("%s - %s: invalid filename",thisName(),GetString(thisTag()));
 	else {
 		string file(MakeFilename(flnm));
-        ok = xml?pl->LdDirXML(curdir,file.c_str(),0):pl->LdDir(curdir,file.c_str(),0);
+		if(async && LdAsync(curdir,file,fmt,0,true)) {
+			// result is output when done
+			echodir();
+			return;
+		}
+        ok = LdDir(curdir,file.c_str(),fmt,0);
 		if(!ok) 
 			post("%s - %s: directory couldn't be loaded",thisName(),GetString(thisTag()));
 	}
@@ -1226,7 +1858,7 @@ void pool::lddir(int argc,const t_atom *argv,bool xml)
 	echodir();
 }
 
-void pool::ldrec(int argc,const t_atom *argv,bool xml)
+void pool::ldrec(int argc,const t_atom *argv,file_t fmt)
 {
 	const char *flnm = NULL;
 	int depth = -1;
@@ -1254,7 +1886,12 @@ void pool::ldrec(int argc,const t_atom *argv,bool xml)
 		post("%s - %s: invalid filename",thisName(),GetString(thisTag()));
 	else {
 		string file(MakeFilename(flnm));
-        ok = xml?pl->LdDirXML(curdir,file.c_str(),depth,mkdir):pl->LdDir(curdir,file.c_str(),depth,mkdir);
+		if(async && LdAsync(curdir,file,fmt,depth,mkdir)) {
+			// result is output when done
+			echodir();
+			return;
+		}
+        ok = LdDir(curdir,file.c_str(),fmt,depth,mkdir);
         if(!ok) 
 		    post("%s - %s: directory couldn't be saved",thisName(),GetString(thisTag()));
 	}
@@ -1265,7 +1902,7 @@ void pool::ldrec(int argc,const t_atom *argv,bool xml)
 	echodir();
 }
 
-void pool::svdir(int argc,const t_atom *argv,bool xml)
+void pool::svdir(int argc,const t_atom *argv,file_t fmt)
 {
 	const char *flnm = NULL;
 	if(argc > 0) {
@@ -1278,7 +1915,12 @@ void pool::svdir(int argc,const t_atom *argv,bool xml)
 		post("%s - %s: invalid filename",thisName(),GetString(thisTag()));
 	else {
 		string file(MakeFilename(flnm));
-        ok = xml?pl->SvDirXML(curdir,file.c_str(),0,absdir):pl->SvDir(curdir,file.c_str(),0,absdir);
+		if(async && SvAsync(curdir,file,fmt,0,absdir)) {
+			// result is output when done
+			echodir();
+			return;
+		}
+        ok = SvDir(curdir,file.c_str(),fmt,0,absdir);
         if(!ok) 
 		    post("%s - %s: directory couldn't be saved",thisName(),GetString(thisTag()));
 	}
@@ -1289,7 +1931,7 @@ void pool::svdir(int argc,const t_atom *argv,bool xml)
 	echodir();
 }
 
-void pool::svrec(int argc,const t_atom *argv,bool xml)
+void pool::svrec(int argc,const t_atom *argv,file_t fmt)
 {
 	const char *flnm = NULL;
 	if(argc > 0) {
@@ -1302,7 +1944,12 @@ void pool::svrec(int argc,const t_atom *argv,bool xml)
 		post("%s - %s: invalid filename",thisName(),GetString(thisTag()));
 	else {
 		string file(MakeFilename(flnm));
-        ok = xml?pl->SvDirXML(curdir,file.c_str(),-1,absdir):pl->SvDir(curdir,file.c_str(),-1,absdir);
+		if(async && SvAsync(curdir,file,fmt,-1,absdir)) {
+			// result is output when done
+			echodir();
+			return;
+		}
+        ok = SvDir(curdir,file.c_str(),fmt,-1,absdir);
         if(!ok) 
 		    post("%s - %s: directory couldn't be saved",thisName(),GetString(thisTag()));
 	}
@@ -1313,6 +1960,163 @@ void pool::svrec(int argc,const t_atom *argv,bool xml)
 	echodir();
 }
 
+bool pool::LdDir(const AtomList &d,const char *flnm,file_t fmt,int depth,bool mkdir)
+{
+	poolstrings::Use strs(ownstr);
+	poolfilter flt(loaddir,GetString(loadkey));
+	const poolfilter *f = flt.Empty()?NULL:&flt;
+	switch(fmt) {
+	case file_xml: return pl->LdDirXML(d,flnm,depth,mkdir,f);
+	case file_bin: return pl->LdDirBin(d,flnm,depth,mkdir);
+	case file_json: return pl->LdDirJSON(d,flnm,depth,mkdir);
+	default: return pl->LdDir(d,flnm,depth,mkdir,f);
+	}
+}
+
+bool pool::SvDir(pooldata *p,const AtomList &d,const char *flnm,file_t fmt,int depth,bool absdir)
+{
+	switch(fmt) {
+	case file_xml: return p->SvDirXML(d,flnm,depth,absdir);
+	case file_bin: return p->SvDirBin(d,flnm,depth,absdir);
+	case file_json: return p->SvDirJSON(d,flnm,depth,absdir);
+	default: return p->SvDir(d,flnm,depth,absdir);
+	}
+}
+
+#ifdef POOL_THREADS
+
+void pool::SvRun(svjob *j)
+{
+	j->ok = SvDir(j->data,j->dir,j->file.c_str(),j->fmt,j->depth,j->absdir);
+	j->done = true;
+}
+
+bool pool::SvAsync(const AtomList &d,const string &flnm,file_t fmt,int depth,bool absdir)
+{
+	// the pool stays writable, the worker only sees the snapshot
+	pooldata *snap = pl->Snapshot(d,depth);
+	if(!snap) return false;
+	pl->Written(flnm.c_str());
+
+	svjob *j = new svjob;
+	j->data = snap;
+	j->dir = d;
+	j->file = flnm;
+	j->fmt = fmt;
+	j->depth = depth;
+	j->absdir = absdir;
+	j->tag = thisTag();
+	try { j->thr = thread(SvRun,j); }
+	catch(...) {
+		delete j;
+		return false;
+	}
+
+	StartJobs();
+	jobs.push_back(j);
+	return true;
+}
+
+#else
+
+bool pool::SvAsync(const AtomList &d,const string &flnm,file_t fmt,int depth,bool absdir) { return false; }
+
+#endif
+
+bool pool::LdAsync(const AtomList &d,const string &flnm,file_t fmt,int depth,bool mkdir)
+{
+	// only text files are stored in steps
+	if(fmt != file_txt) return false;
+
+	poolfilter flt(loaddir,GetString(loadkey));
+	// files parsed before (with the same string setting) are copied at once
+	poolstrings::Use strs(ownstr);
+	if(flt.Empty() && pl->Cached(flnm.c_str(),false)) return false;
+	poolloader *ld = pl->LdAsync(d,flnm.c_str(),depth,mkdir,flt.Empty()?NULL:&flt);
+	if(!ld) return false;
+
+	ldjob *j = new ldjob;
+	j->ld = ld;
+	j->tag = thisTag();
+	StartJobs();
+	loads.push_back(j);
+	return true;
+}
+
+void pool::StopLoads(bool report)
+{
+	for(std::list<ldjob *>::iterator it = loads.begin(); it != loads.end(); ++it) {
+		ldjob *j = *it;
+		if(report) {
+			post("%s - %s: loading cancelled",thisName(),GetString(j->tag));
+			t_atom at; SetBool(at,false);
+			ToOutAnything(GetOutAttr(),j->tag,1,&at);
+		}
+		delete j;
+	}
+	loads.clear();
+}
+
+void pool::m_cancel() { StopLoads(true); }
+
+bool pool::JobsIdle() const
+{
+#ifdef POOL_THREADS
+	if(!jobs.empty()) return false;
+#endif
+	return loads.empty();
+}
+
+void pool::m_jobs(void *)
+{
+#ifdef POOL_THREADS
+	for(std::list<svjob *>::iterator it = jobs.begin(); it != jobs.end(); ) {
+		svjob *j = *it;
+		if(!j->done) { ++it; continue; }
+
+		j->thr.join();
+		if(!j->ok)
+			post("%s - %s: error saving data",thisName(),GetString(j->tag));
+
+		t_atom at; SetBool(at,j->ok);
+		ToOutAnything(GetOutAttr(),j->tag,1,&at);
+
+		delete j;
+		it = jobs.erase(it);
+	}
+#endif
+
+	// loads share the time budget
+	double tm = loads.empty()?0:budget*1.e-6/loads.size();
+	poolstrings::Use strs(ownstr);
+	for(std::list<ldjob *>::iterator it = loads.begin(); it != loads.end(); ) {
+		ldjob *j = *it;
+		bool more = j->ld->Step(tm);
+
+		if(j->ld->Pos() != j->pos) {
+			j->pos = j->ld->Pos();
+			// a fraction, byte positions of large files are not exact as floats
+			size_t sz = j->ld->Size();
+			t_atom at;
+			SetFloat(at,sz?(float)((double)j->pos/sz):1);
+			ToOutAnything(GetOutAttr(),sym_loadprogress,1,&at);
+		}
+		if(more) { ++it; continue; }
+
+		bool ok = j->ld->Ok();
+		if(!ok)
+			post("%s - %s: error loading data",thisName(),GetString(j->tag));
+
+		t_atom at; SetBool(at,ok);
+		ToOutAnything(GetOutAttr(),j->tag,1,&at);
+
+		delete j;
+		it = loads.erase(it);
+	}
+
+	if(JobsIdle()) jobtmr.Reset();
+}
+
 
 
 bool pool::KeyChk(const t_atom &a)
@@ -1320,6 +2124,15 @@ bool pool::KeyChk(const t_atom &a)
 	return IsSymbol(a) || IsFloat(a) || IsInt(a);
 }
 
+bool pool::KeyChk(int argc,const t_atom *argv) const
+{
+	int kl = KeyLen();
+	if(argc < kl) return false;
+	for(int i = 0; i < kl; ++i)
+		if(!KeyChk(argv[i])) return false;
+	return true;
+}
+
 bool pool::ValChk(int argc,const t_atom *argv)
 {
 	for(int i = 0; i < argc; ++i) {
@@ -1341,6 +2154,26 @@ void pool::ToOutAtom(int ix,const t_atom &a)
 		post("%s - %s type not supported!",thisName(),GetString(thisTag()));
 }
 
+void pool::ToOutKey(int ix,const poolkey &k)
+{
+	if(k.Single())
+		ToOutAtom(ix,k[0]);
+	else
+		ToSysList(ix,k.cnt,k.atoms);
+}
+
+void pool::ToOutVal(int ix,const AtomList &l)
+{
+	if(poolstrings::Any(l)) {
+		// pool-owned strings become symbols only now
+		Atoms r(l);
+		poolstrings::Real(r);
+		ToSysList(ix,r);
+	}
+	else
+		ToSysList(ix,l);
+}
+
 
 
 pooldata *pool::GetPool(const t_symbol *s)
@@ -10,100 +10,12 @@ WARRANTIES, see the file, "license.txt," in this distribution.
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <fstream>
 #include <vector>
 
 #if FLEXT_OS == FLEXT_OS_WIN
 #include <windows.h> // for charset conversion functions
-#else
-static bool WCStoUTF8(char *sdst,const wchar_t *src,int dstlen)
-{
-    unsigned char *dst = (unsigned char *)sdst;
-    unsigned char *max = dst+dstlen;
-    for(;;) {
-        wchar_t ud = *(src++);
-        if(ud < 128) {
-            if(dst+1 >= max) return false;
-            *(dst++) = (unsigned char)ud;
-        }
-        else if(ud < 2048) {
-            if(dst+2 >= max) return false;
-            *(dst++) = 192+(unsigned char)(ud/64);
-            *(dst++) = 128+(unsigned char)(ud%64);
-        }
-        else if(ud < 65535) {
-            if(dst+3 >= max) return false;
-            *(dst++) = 224+(unsigned char)(ud/4096);
-            *(dst++) = 128+(unsigned char)((ud/64)%64);
-            *(dst++) = 128+(unsigned char)(ud%64);
-        }
-        else if(ud < 2097151) {
-            if(dst+4 >= max) return false;
-            *(dst++) = 240+(unsigned char)(ud/262144);
-            *(dst++) = 128+(unsigned char)((ud/4096)%64);
-            *(dst++) = 128+(unsigned char)((ud/64)%64);
-            *(dst++) = 128+(unsigned char)(ud%64);
-        }
-        else if(ud < 67108863) {
-            if(dst+5 >= max) return false;
-            *(dst++) = 248+(unsigned char)(ud/16777216);
-            *(dst++) = 128+(unsigned char)((ud/262144)%64);
-            *(dst++) = 128+(unsigned char)((ud/4096)%64);
-            *(dst++) = 128+(unsigned char)((ud/64)%64);
-            *(dst++) = 128+(unsigned char)(ud%64);
-        }
-        else {
-            if(dst+6 >= max) return false;
-            *(dst++) = 252+(unsigned char)(ud/1073741824);
-            *(dst++) = 128+(unsigned char)((ud/16777216)%64);
-            *(dst++) = 128+(unsigned char)((ud/262144)%64);
-            *(dst++) = 128+(unsigned char)((ud/4096)%64);
-            *(dst++) = 128+(unsigned char)((ud/64)%64);
-            *(dst++) = 128+(unsigned char)(ud%64);
-        }
-        if(!ud) break;
-    }
-    return true;
-}
-
-static bool UTF8toWCS(wchar_t *dst,const char *ssrc,int dstlen)
-{
-    const unsigned char *src = (const unsigned char *)ssrc;
-    wchar_t *max = dst+dstlen;
-    for(;;) {
-        if(*src < 128) {
-            *dst = *(src++);
-            if(!*dst) break;
-        }
-        else if(*src < 224) {
-            *dst = wchar_t(src[0]-192)*64+wchar_t(src[1]-128);
-            src += 2;
-        }
-        else if(*src < 240) {
-            *dst = wchar_t(src[0]-224)*4096+wchar_t(src[1]-128)*64+wchar_t(src[2]-128);
-            src += 3;
-        }
-        else if(*src < 248) {
-            *dst = wchar_t(src[0]-240)*262144+wchar_t(src[1]-128)*4096+wchar_t(src[2]-128)*64+wchar_t(src[3]-128);
-            src += 4;
-        }
-        else if(*src < 252) {
-            *dst = wchar_t(src[0]-248)*16777216+wchar_t(src[1]-128)*262144+wchar_t(src[2]-128)*4096+wchar_t(src[3]-128)*64+wchar_t(src[4]-128);
-            src += 5;
-        }
-        else if(*src < 254) {
-            *dst = wchar_t(src[0]-252)*1073741824+wchar_t(src[1]-128)*16777216+wchar_t(src[2]-128)*262144+wchar_t(src[3]-128)*4096+wchar_t(src[4]-128)*64+wchar_t(src[5]-128);
-            src += 6;
-        }
-        else
-			// invalid string
-            return false;
-
-        if(++dst >= max) return false;
-    }
-    return true;
-}
-
 #endif
 
 using namespace std;
@@ -113,6 +25,7 @@ using namespace std;
 inline int compare(int a,int b) { return a == b?0:(a < b?-1:1); }
 inline int compare(float a,float b) { return a == b?0:(a < b?-1:1); }
 
+// by name, pool-owned strings aren't in the symbol table
 static int compare(const t_symbol *a,const t_symbol *b) 
 {
 	if(a == b)
@@ -121,7 +34,7 @@ static int compare(const t_symbol *a,const t_symbol *b)
 		return strcmp(flext::GetString(a),flext::GetString(b));
 }
 
-static int compare(const t_atom &a,const t_atom &b) 
+int compare(const t_atom &a,const t_atom &b) 
 {
 	if(flext::GetType(a) == flext::GetType(b)) {
 		switch(flext::GetType(a)) {
@@ -146,37 +59,78 @@ static int compare(const t_atom &a,const t_atom &b)
 		return flext::GetType(a) < flext::GetType(b)?-1:1;
 }
 
+int compare(const poolkey &a,const poolkey &b)
+{
+	// tuples are ordered element-wise, shorter ones first
+	int n = a.cnt < b.cnt?a.cnt:b.cnt;
+	for(int i = 0; i < n; ++i) {
+		int c = compare(a[i],b[i]);
+		if(c) return c;
+	}
+	return compare(a.cnt,b.cnt);
+}
 
-poolval::poolval(const t_atom &k,AtomList *d):
-	data(d),nxt(NULL)
+unsigned long KeyHash(const poolkey &k)
 {
-	SetAtom(key,k);
+	unsigned long h = flext::AtomHash(k[0]);
+	for(int i = 1; i < k.cnt; ++i)
+		h = h*31+flext::AtomHash(k[i]);
+	return h;
+}
+
+
+poolval::poolval(const poolkey &k,AtomList *d):
+	xkey(NULL),kcnt(k.cnt),data(d),nxt(NULL)
+{
+	SetAtom(key,k[0]);
+	if(kcnt > 1) {
+		xkey = new t_atom[kcnt];
+		for(int i = 0; i < kcnt; ++i) SetAtom(xkey[i],k[i]);
+	}
+	poolstrings::Acquire(data);
 }
 
 poolval::~poolval()
 {
-	if(data) delete data;
+	if(data) {
+		poolstrings::Release(data);
+		delete data;
+	}
+	if(xkey) delete[] xkey;
 
     FLEXT_ASSERT(nxt == NULL);
 }
 
 poolval &poolval::Set(AtomList *d)
 {
-	if(data) delete data;
+	poolstrings::Acquire(d);
+	if(data) {
+		poolstrings::Release(data);
+		delete data;
+	}
 	data = d;
 	return *this;
 }
 
+flext::AtomList *poolval::Take()
+{
+	AtomList *d = data;
+	poolstrings::Release(d);
+	data = NULL;
+	return d;
+}
+
 poolval *poolval::Dup() const
 {
-	return new poolval(key,data?new Atoms(*data):NULL); 
+	return new poolval(Key(),data?new Atoms(*data):NULL); 
 }
 
 
 pooldir::pooldir(const t_atom &d,pooldir *p,int vcnt,int dcnt):
-	parent(p),nxt(NULL),vals(NULL),dirs(NULL),
+	parent(p),nxt(NULL),vals(NULL),dirs(NULL),dtbits(0),subcnt(0),
 	vbits(Int2Bits(vcnt)),dbits(Int2Bits(dcnt)),
-	vsize(1<<vbits),dsize(1<<dbits)
+	vsize(1<<vbits),dsize(1<<dbits),
+	changed(false),dirty(false)
 {
 	Reset();
 	CopyAtom(&dir,&d);
@@ -184,6 +138,8 @@ pooldir::pooldir(const t_atom &d,pooldir *p,int vcnt,int dcnt):
 
 pooldir::~pooldir()
 {
+	// removal is marked by the one unlinking the directory
+	parent = NULL;
 	Reset(false);
 		
     FLEXT_ASSERT(nxt == NULL);
@@ -191,8 +147,11 @@ pooldir::~pooldir()
 
 void pooldir::Clear(bool rec,bool dironly)
 {
+	// only changed if something is removed
+	if((rec && HasDirs()) || (!dironly && HasVals())) Touch();
+
 	if(rec && dirs) { 
-        for(int i = 0; i < dsize; ++i) {
+        for(int i = 0; i < DTSize(); ++i) {
             pooldir *d = dirs[i].d,*d1; 
             if(d) {
                 do {
@@ -200,48 +159,89 @@ void pooldir::Clear(bool rec,bool dironly)
                     d->nxt = NULL;
                     delete d;
                 } while((d = d1) != NULL);
-                dirs[i].d = NULL; 
-                dirs[i].cnt = 0;
             }
         }
+        // table will be allocated again on demand
+        delete[] dirs; dirs = NULL;
+        dtbits = subcnt = 0;
 	}
-	if(!dironly && vals) { 
-        for(int i = 0; i < vsize; ++i) {
-            poolval *v = vals[i].v,*v1;
-            if(v) {
-                do {
-                    v1 = v->nxt;
-                    v->nxt = NULL;
-                    delete v;
-                } while((v = v1) != NULL);
-                vals[i].v = NULL; 
-                vals[i].cnt = 0;
-            }
-        }
-    }
+	if(!dironly && vals) vals->Clear();
 }
 
 void pooldir::Reset(bool realloc)
 {
 	Clear(true,false);
 
-	if(dirs) delete[] dirs; 
-	if(vals) delete[] vals;
+	if(vals) delete vals;
+	vals = realloc?poolstore::New(vbits):NULL;
+}
 
-	if(realloc) {
-		dirs = new direntry[dsize];
-		ZeroMem(dirs,dsize*sizeof *dirs);
-		vals = new valentry[vsize];
-		ZeroMem(vals,vsize*sizeof *vals);
+void pooldir::DRehash(int bits)
+{
+	direntry *odirs = dirs;
+	int osize = DTSize();
+
+	dtbits = bits;
+	dirs = new direntry[1<<bits];
+	ZeroMem(dirs,(1<<bits)*sizeof *dirs);
+
+	for(int i = 0; i < osize; ++i) {
+		pooldir *d = odirs[i].d,*d1;
+		for(; d; d = d1) {
+			d1 = d->nxt;
+
+			// insert into sorted chain
+			int dix = DIdx(d->dir);
+			pooldir *prv = NULL,*ix = dirs[dix].d;
+			for(; ix && compare(d->dir,ix->dir) > 0; prv = ix,ix = ix->nxt) {}
+			d->nxt = ix;
+			if(prv) prv->nxt = d;
+			else dirs[dix].d = d;
+			dirs[dix].cnt++;
+		}
 	}
-	else 
-		dirs = NULL,vals = NULL;
+	if(odirs) delete[] odirs;
+}
+
+bool pooldir::SetMode(int argc,const t_atom *argv)
+{
+	poolstore *nvals = poolstore::New(argc,argv,vbits);
+	if(!nvals) return false;
+
+	if(nvals->Mode() == poolstore::mode_series) {
+		// series can only hold numeric keys, don't lose any values
+		for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+			if(ix->xkey || !CanbeFloat(ix->key)) {
+				post("pool - series: keys must be numeric, mode not changed");
+				delete nvals;
+				return false;
+			}
+		}
+	}
+
+	Touch();
+
+	// transfer existing values in their current order
+	bool seq = nvals->Mode() == poolstore::mode_fifo;
+	for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+		// sequential stores renumber the values, keys could address existing slots
+		if(seq)
+			nvals->Push(ix->Take());
+		else
+			nvals->Set(ix->Key(),ix->Take(),true);
+	}
+
+	delete vals;
+	vals = nvals;
+	return true;
 }
 
 pooldir *pooldir::AddDir(int argc,const t_atom *argv,int vcnt,int dcnt)
 {
 	if(!argc) return this;
 
+	if(!dirs) DRehash(0);
+
 	int c = 1,dix = DIdx(argv[0]);
 	pooldir *prv = NULL,*ix = dirs[dix].d;
 	for(; ix; prv = ix,ix = ix->nxt) {
@@ -257,6 +257,11 @@ pooldir *pooldir::AddDir(int argc,const t_atom *argv,int vcnt,int dcnt)
 		else dirs[dix].d = nd;
 		dirs[dix].cnt++;
 		ix = nd;
+		nd->Touch();
+
+		if(++subcnt > POOL_SMALLCNT && dtbits < dbits)
+			// outgrown the single chain
+			DRehash(dbits);
 	}
 
 	return ix->AddDir(argc-1,argv+1);
@@ -265,6 +270,7 @@ pooldir *pooldir::AddDir(int argc,const t_atom *argv,int vcnt,int dcnt)
 pooldir *pooldir::GetDir(int argc,const t_atom *argv,bool rmv)
 {
 	if(!argc) return this;
+	if(!dirs) return NULL;
 
 	int c = 1,dix = DIdx(argv[0]);
 	pooldir *prv = NULL,*ix = dirs[dix].d;
@@ -283,7 +289,9 @@ pooldir *pooldir::GetDir(int argc,const t_atom *argv,bool rmv)
 			if(prv) prv->nxt = nd;
 			else dirs[dix].d = nd;
 			dirs[dix].cnt--;
+			subcnt--;
 			ix->nxt = NULL;
+			Touch();
 			return ix;
 		}
 		else 
@@ -302,141 +310,77 @@ bool pooldir::DelDir(int argc,const t_atom *argv)
 		return false;
 }
 
-void pooldir::SetVal(const t_atom &key,AtomList *data,bool over)
+void pooldir::Mark()
 {
-    int c = 1,vix = VIdx(key);
-	poolval *prv = NULL,*ix = vals[vix].v;
-	for(; ix; prv = ix,ix = ix->nxt) {
-		c = compare(key,ix->key);
-		if(c <= 0) break;
-	}
+	changed = true;
+	// directories above a dirty one are dirty already
+	for(pooldir *d = this; d && !d->dirty; d = d->parent) d->dirty = true;
+}
 
-	if(c || !ix) {
-		// no existing data found
-	
-		if(data) {
-			poolval *nv = new poolval(key,data);
-			nv->nxt = ix;
-
-			if(prv) prv->nxt = nv;
-			else vals[vix].v = nv;
-			vals[vix].cnt++;
-		}
-	}
-	else if(over) { 
-		// data exists... only set if overwriting enabled
-		
-		if(data)
-			ix->Set(data);
-		else {
-			// delete key
-		
-			poolval *nv = ix->nxt;
-			if(prv) prv->nxt = nv;
-			else vals[vix].v = nv;
-			vals[vix].cnt--;
-			ix->nxt = NULL;
-			delete ix;
-		}
-	}
+void pooldir::Clean()
+{
+	if(!dirty) return;
+	changed = dirty = false;
+	for(int di = 0; di < DTSize(); ++di)
+		for(pooldir *ix = dirs[di].d; ix; ix = ix->nxt) ix->Clean();
 }
 
-bool pooldir::SetVali(int rix,AtomList *data)
+void pooldir::Reserve(int vcnt,int dcnt)
 {
-    poolval *prv = NULL,*ix = NULL;
-    int vix;
-	for(vix = 0; vix < vsize; ++vix) 
-		if(rix > vals[vix].cnt) rix -= vals[vix].cnt;
-		else {
-			ix = vals[vix].v;
-			for(; ix && rix; prv = ix,ix = ix->nxt) --rix;
-			if(ix && !rix) break;
-		}  
+	if(vcnt) vals->Reserve(vcnt);
 
-	if(ix) { 
-		// data exists... overwrite it
-		
-		if(data)
-			ix->Set(data);
-		else {
-			// delete key
-		
-			poolval *nv = ix->nxt;
-			if(prv) prv->nxt = nv;
-			else vals[vix].v = nv;
-			vals[vix].cnt--;
-			ix->nxt = NULL;
-			delete ix;
-		}
-        return true;
-	}
-    else
-        return false;
+	// no single chain for that many subdirectories
+	if(dcnt > POOL_SMALLCNT && Int2Bits(dcnt) > dtbits)
+		DRehash(Int2Bits(dcnt));
 }
 
-poolval *pooldir::RefVal(const t_atom &key)
+void pooldir::SetVal(const poolkey &key,AtomList *data,bool over)
 {
-	int c = 1,vix = VIdx(key);
-	poolval *ix = vals[vix].v;
-	for(; ix; ix = ix->nxt) {
-		c = compare(key,ix->key);
-		if(c <= 0) break;
-	}
+	Touch();
+	vals->Set(key,data,over);
+}
+
+bool pooldir::SetVali(int rix,AtomList *data)
+{
+	Touch();
+	return vals->Seti(rix,data);
+}
 
-	return c || !ix?NULL:ix;
+poolval *pooldir::RefVal(const poolkey &key)
+{
+	return vals->Ref(key);
 }
 
 poolval *pooldir::RefVali(int rix)
 {
-	for(int vix = 0; vix < vsize; ++vix) 
-		if(rix > vals[vix].cnt) rix -= vals[vix].cnt;
-		else {
-			poolval *ix = vals[vix].v;
-			for(; ix && rix; ix = ix->nxt) --rix;
-			if(ix && !rix) return ix;
-		}
-	return NULL;
+	return vals->Refi(rix);
 }
 
-flext::AtomList *pooldir::PeekVal(const t_atom &key)
+flext::AtomList *pooldir::PeekVal(const poolkey &key)
 {
 	poolval *ix = RefVal(key);
 	return ix?ix->data:NULL;
 }
 
-flext::AtomList *pooldir::GetVal(const t_atom &key,bool cut)
+flext::AtomList *pooldir::GetVal(const poolkey &key,bool cut)
 {
-	int c = 1,vix = VIdx(key);
-	poolval *prv = NULL,*ix = vals[vix].v;
-	for(; ix; prv = ix,ix = ix->nxt) {
-		c = compare(key,ix->key);
-		if(c <= 0) break;
+	if(cut) {
+		poolval *ix = vals->Cut(key);
+		if(!ix) return NULL;
+		Touch();
+		AtomList *ret = ix->Take();
+		delete ix;
+		return ret;
 	}
-
-	if(c || !ix) 
-		return NULL;
 	else {
-		AtomList *ret;
-		if(cut) {
-			poolval *nv = ix->nxt;
-			if(prv) prv->nxt = nv;
-			else vals[vix].v = nv;
-			vals[vix].cnt--;
-			ix->nxt = NULL;
-			ret = ix->data; ix->data = NULL;
-			delete ix;
-		}
-		else
-			ret = new Atoms(*ix->data);
-		return ret;
+		poolval *ix = vals->Ref(key);
+		return ix?new Atoms(*ix->data):NULL;
 	}
 }
 
 int pooldir::CntAll() const
 {
-	int cnt = 0;
-	for(int vix = 0; vix < vsize; ++vix) cnt += vals[vix].cnt;
-	return cnt;
+	return vals->Count();
 }
 
 int pooldir::PrintAll(char *buf,int len) const
@@ -444,17 +388,14 @@ int pooldir::PrintAll(char *buf,int len) const
     int offs = strlen(buf);
 
     int cnt = 0;
-    for(int vix = 0; vix < vsize; ++vix) {
-		poolval *ix = vals[vix].v;
-        for(int i = 0; ix; ++i,ix = ix->nxt) {
-			PrintAtom(ix->key,buf+offs,len-offs);
-            strcat(buf+offs," , ");
-            int l = strlen(buf+offs)+offs;
-			ix->data->Print(buf+l,len-l);
-            post(buf);
-        }
-        cnt += vals[vix].cnt;
-    }
+	for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix),++cnt) {
+		poolkey k = ix->Key();
+		PrintList(k.cnt,k.atoms,buf+offs,len-offs);
+		strcat(buf+offs," , ");
+		int l = strlen(buf+offs)+offs;
+		ix->data->Print(buf+l,len-l);
+		post(buf);
+	}
     
     buf[offs] = 0;
 
@@ -466,35 +407,28 @@ int pooldir::GetKeys(AtomList &keys)
 	int cnt = CntAll();
 	keys(cnt);
 
-	for(int vix = 0; vix < vsize; ++vix) {
-		poolval *ix = vals[vix].v;
-		for(int i = 0; ix; ++i,ix = ix->nxt) 
-			SetAtom(keys[i],ix->key);
-	}
+	int i = 0;
+	for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) 
+		SetAtom(keys[i++],ix->key);
 	return cnt;
 }
 
-int pooldir::GetAll(t_atom *&keys,Atoms *&lst,bool cut)
+int pooldir::GetAll(Atoms *&keys,Atoms *&lst,bool cut)
 {
 	int cnt = CntAll();
-	keys = new t_atom[cnt];
+	keys = new Atoms[cnt];
 	lst = new Atoms[cnt];
 
-	for(int i = 0,vix = 0; vix < vsize; ++vix) {
-		poolval *ix = vals[vix].v;
-		for(; ix; ++i) {
-			SetAtom(keys[i],ix->key);
-			lst[i] = *ix->data;
-
-			if(cut) {
-				poolval *t = ix;
-				vals[vix].v = ix = ix->nxt;
-				vals[vix].cnt--;				
-				t->nxt = NULL; delete t;
-			}
-			else
-				ix = ix->nxt;
-		}
+	int i = 0;
+	for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix),++i) {
+		poolkey k = ix->Key();
+		keys[i](k.cnt,k.atoms);
+		lst[i] = *ix->data;
+	}
+
+	if(cut && cnt) {
+		Touch();
+		vals->Clear();
 	}
 	return cnt;
 }
@@ -502,9 +436,7 @@ int pooldir::GetAll(t_atom *&keys,Atoms *&lst,bool cut)
 
 int pooldir::CntSub() const
 {
-	int cnt = 0;
-	for(int dix = 0; dix < dsize; ++dix) cnt += dirs[dix].cnt;
-	return cnt;
+	return subcnt;
 }
 
 
@@ -519,19 +451,30 @@ int pooldir::GetSub(const t_atom **&lst)
 	return cnt;
 }
 
+int pooldir::GetSub(pooldir **&lst)
+{
+	const int cnt = CntSub();
+	lst = new pooldir *[cnt];
+	for(int i = 0,dix = 0; i < cnt; ++dix) {
+		pooldir *ix = dirs[dix].d;
+		for(; ix; ix = ix->nxt) lst[i++] = ix;
+	}
+	return cnt;
+}
+
 
 bool pooldir::Paste(const pooldir *p,int depth,bool repl,bool mkdir)
 {
 	bool ok = true;
 
-	for(int vi = 0; vi < p->vsize; ++vi) {
-		for(poolval *ix = p->vals[vi].v; ix; ix = ix->nxt) {
-			SetVal(ix->key,new Atoms(*ix->data),repl);
-		}
+	Reserve(CntAll()+p->CntAll(),depth && mkdir?CntSub()+p->CntSub():0);
+
+	for(poolval *ix = p->vals->Next(NULL); ix; ix = p->vals->Next(ix)) {
+		SetVal(ix->Key(),new Atoms(*ix->data),repl);
 	}
 
 	if(ok && depth) {
-		for(int di = 0; di < p->dsize; ++di) {
+		for(int di = 0; di < p->DTSize(); ++di) {
 			for(pooldir *dix = p->dirs[di].d; ok && dix; dix = dix->nxt) {
 				pooldir *ndir = mkdir?AddDir(1,&dix->dir):GetDir(1,&dix->dir);
 				if(ndir) { 
@@ -544,34 +487,48 @@ bool pooldir::Paste(const pooldir *p,int depth,bool repl,bool mkdir)
 	return ok;
 }
 
-bool pooldir::Copy(pooldir *p,int depth,bool cut)
+bool pooldir::Copy(pooldir *p,int depth,bool cut,bool mkdir)
 {
 	bool ok = true;
 
-	if(cut) {
-		for(int vi = 0; vi < vsize; ++vi) {
-			for(poolval *ix = vals[vi].v; ix; ix = ix->nxt)
-				p->SetVal(ix->key,ix->data);
-			vals[vi].cnt = 0;
-			vals[vi].v = NULL;
+	if(GetMode() != poolstore::mode_hash) {
+		Atoms m;
+		GetMode(m);
+		p->SetMode(m);
+	}
+
+	p->Reserve(p->CntAll()+CntAll(),depth?p->CntSub()+CntSub():0);
+
+	int chunks = vals->Chunks();
+	if(chunks) {
+		// packed series hold all values in chunks, storing them one by one would thin them out again
+		for(int ci = 0; ci < chunks; ++ci) {
+			Atoms c;
+			vals->GetChunk(ci,c);
+			p->AddChunk(c);
+		}
+		if(cut) Clear(false);
+	}
+	else if(cut) {
+		for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+			p->SetVal(ix->Key(),ix->Take());
 		}
+		Clear(false);
 	}
 	else {
-		for(int vi = 0; vi < vsize; ++vi) {
-			for(poolval *ix = vals[vi].v; ix; ix = ix->nxt) {
-				p->SetVal(ix->key,new Atoms(*ix->data));
-			}
+		for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+			p->SetVal(ix->Key(),new Atoms(*ix->data));
 		}
 	}
 
 	if(ok && depth) {
-		for(int di = 0; di < dsize; ++di) {
+		for(int di = 0; di < DTSize(); ++di) {
 			for(pooldir *dix = dirs[di].d; ok && dix; dix = dix->nxt) {
-				pooldir *ndir = p->AddDir(1,&dix->dir);
+				pooldir *ndir = mkdir?p->AddDir(1,&dix->dir):p->GetDir(1,&dix->dir);
 				if(ndir)
-					ok = dix->Copy(ndir,depth > 0?depth-1:depth,cut);
+					ok = dix->Copy(ndir,depth > 0?depth-1:depth,cut,mkdir);
 				else
-					ok = false;
+					ok = !mkdir;
 			}
 		}
 	}
@@ -581,572 +538,1286 @@ bool pooldir::Copy(pooldir *p,int depth,bool cut)
 
 static bool _isspace(char c) { return c > 0 && isspace(c); }
 
-static const char *ReadAtom(const char *c,t_atom &a,bool utf8)
+// are all characters of [s,s+n) ASCII? checks a machine word at a time
+static bool IsASCII(const char *s,size_t n)
 {
-	// skip leading whitespace (NON-ASCII character are < 0)
-	while(*c && _isspace(*c)) ++c;
-	if(!*c) return NULL;
-
-	char tmp[1024];
-    char *m = tmp; // write position
-
-    bool issymbol;
-    if(*c == '"') {
-        issymbol = true;
-        ++c;
+    const char *e = s+n;
+    for(; e-s >= (ptrdiff_t)sizeof(size_t); s += sizeof(size_t)) {
+        size_t w;
+        memcpy(&w,s,sizeof w);
+        if(w&((size_t)-1/0xff*0x80)) return false;
     }
-    else
-        issymbol = false;
+    for(; s < e; ++s)
+        if(*s&0x80) return false;
+    return true;
+}
 
-    // go to next whitespace
-    for(bool escaped = false;; ++c)
-        if(*c == '\\') {
-            if(escaped) {
-                *m++ = *c;
-                escaped = false;
-            }
-            else
-                escaped = true;
-        }
-        else if(*c == '"' && issymbol && !escaped) {
-            // end of string
-            ++c;
-            FLEXT_ASSERT(!*c || _isspace(*c));
-            *m = 0;
-            break;
-        }
-        else if(!*c || (_isspace(*c) && !escaped)) {
-            *m = 0;
-            break;
+// is [s,s+n) well-formed UTF-8? (no overlong forms, surrogates or code points beyond U+10FFFF)
+static bool ValidUTF8(const char *ss,size_t n)
+{
+    const unsigned char *s = (const unsigned char *)ss,*e = s+n;
+    while(s < e) {
+        unsigned char c = *s++;
+        if(c < 0x80) continue;
+
+        int more;
+        unsigned char lo = 0x80,hi = 0xbf; // range of the second byte
+        if(c < 0xc2) return false;
+        else if(c < 0xe0) more = 1;
+        else if(c < 0xf0) {
+            more = 2;
+            if(c == 0xe0) lo = 0xa0;
+            else if(c == 0xed) hi = 0x9f;
         }
-        else {
-            *m++ = *c;
-            escaped = false;
+        else if(c < 0xf5) {
+            more = 3;
+            if(c == 0xf0) lo = 0x90;
+            else if(c == 0xf4) hi = 0x8f;
         }
+        else return false;
 
-    // save character and set delimiter
+        if(e-s < more || *s < lo || *s > hi) return false;
+        for(++s; --more; ++s)
+            if((*s&0xc0) != 0x80) return false;
+    }
+    return true;
+}
 
-    float fres;
-    // first try float
-#if 0
-    if(!issymbol && sscanf(tmp,"%f",&fres) == 1) {
+// convert symbol text from UTF-8 to the system encoding
+// symbols are UTF-8 already, except on Windows
+static bool FromUTF8(string &s)
+{
+    if(IsASCII(s.data(),s.size())) return true;
+#if FLEXT_OS == FLEXT_OS_WIN
+    vector<wchar_t> wtmp(s.size()+1);
+    int err = MultiByteToWideChar(CP_UTF8,MB_ERR_INVALID_CHARS,s.data(),(int)s.size(),&wtmp[0],(int)wtmp.size());
+    if(!err) return false;
+    vector<char> tmp(err*2+1);
+    err = WideCharToMultiByte(CP_ACP,0,&wtmp[0],err,&tmp[0],(int)tmp.size(),NULL,FALSE);
+    if(!err) return false;
+    s.assign(&tmp[0],err);
+    return true;
 #else
-    char *endp;
-    // see if it's a float - thanks to Frank Barknecht
-    fres = (float)strtod(tmp,&endp);   
-    if(!issymbol && !*endp && endp != tmp) { 
+    return ValidUTF8(s.data(),s.size());
 #endif
-        int ires = (int)fres; // try a cast
-        if(fres == ires)
-            flext::SetInt(a,ires);
-        else
-            flext::SetFloat(a,fres);
-    }
-    // no, it's a symbol
-    else {
-		const char *c;
-        if(utf8) {
+}
+
+// symbol text in UTF-8, using tmp for conversion if necessary, NULL if it can't be converted
+static const char *ToUTF8(const char *c,string &tmp)
+{
+    size_t n = strlen(c);
+    if(IsASCII(c,n)) return c;
 #if FLEXT_OS == FLEXT_OS_WIN
-            wchar_t wtmp[1024];
-            int err = MultiByteToWideChar(CP_UTF8,0,tmp,strlen(tmp),wtmp,1024);
-            if(!err) return NULL;
-            err = WideCharToMultiByte(CP_ACP,0,wtmp,err,tmp,1024,NULL,FALSE);
-            if(!err) return NULL;
-            tmp[err] = 0;
-			c = tmp;
+    vector<wchar_t> wtmp(n+1);
+    int err = MultiByteToWideChar(CP_ACP,0,c,(int)n,&wtmp[0],(int)wtmp.size());
+    if(!err) return NULL;
+    vector<char> utmp(err*3+1);
+    err = WideCharToMultiByte(CP_UTF8,0,&wtmp[0],err,&utmp[0],(int)utmp.size(),NULL,FALSE);
+    if(!err) return NULL;
+    tmp.assign(&utmp[0],err);
+    return tmp.c_str();
 #else
-            wchar_t wtmp[1024];
-			size_t len = mbstowcs(wtmp,tmp,1024);
-			if(len < 0) return NULL;
-			if(!WCStoUTF8(tmp,wtmp,sizeof(tmp))) return NULL;
-			c = tmp;
+    return ValidUTF8(c,n)?c:NULL;
 #endif
-		}
-		else 
-			c = tmp;
-        flext::SetString(a,c);
-	}
+}
+
+// read an atom from [c,e), tok is used as scratch buffer
+// returns the position after the atom, NULL if there is none or the symbol can't be converted
+// symbols of values (val set) may become pool-owned strings
+static const char *ReadAtom(const char *c,const char *e,t_atom &a,string &tok,bool utf8,bool val = false)
+{
+	// skip leading whitespace (NON-ASCII character are < 0)
+	while(c < e && _isspace(*c)) ++c;
+	if(c == e) return NULL;
 
-	return c;
+    bool issymbol = *c == '"';
+    if(issymbol) ++c;
+
+    // go to next whitespace or end of string, copying runs between escapes
+    tok.clear();
+    const char *r = c;
+    for(; c < e; ++c) {
+        if(*c == '\\') {
+            tok.append(r,c-r);
+            if(++c == e) break;
+            r = c;
+        }
+        else if(_isspace(*c) || (issymbol && *c == '"'))
+            break;
+    }
+    tok.append(r,c-r);
+    if(issymbol && c < e && *c == '"') ++c;
+
+    if(!issymbol) {
+        // see if it's a float - thanks to Frank Barknecht
+        char *endp;
+        float fres = (float)strtod(tok.c_str(),&endp);   
+        if(!*endp && endp != tok.c_str()) { 
+            int ires = (int)fres; // try a cast
+            if(fres == ires)
+                flext::SetInt(a,ires);
+            else
+                flext::SetFloat(a,fres);
+            return c;
+        }
+    }
+
+    // no, it's a symbol
+    if(utf8 && !FromUTF8(tok)) return NULL;
+    if(val)
+        poolstrings::Set(a,tok.c_str());
+    else
+        flext::SetString(a,tok.c_str());
+    return c;
 }
 
-static bool ParseAtoms(const char *tmp,flext::AtomList &l,bool utf8)
+static bool ParseAtoms(const char *c,const char *e,flext::AtomList &l,bool utf8,bool val = false)
 {
-    FLEXT_ASSERT(tmp);
     vector<t_atom> atoms;
-    while(*tmp) {
+    string tok;
+    for(;;) {
+        while(c < e && _isspace(*c)) ++c;
+        if(c == e) break;
+
         t_atom at;
-		tmp = ReadAtom(tmp,at,utf8);
-        if(!tmp) break;
+		c = ReadAtom(c,e,at,tok,utf8,val);
+        if(!c) return false;
         atoms.push_back(at);
     }
-    l(atoms.size(),&atoms[0]);
+    l(atoms.size(),atoms.empty()?NULL:&atoms[0]);
     return true;
 }
 
-static bool ParseAtoms(string &s,flext::AtomList &l,bool utf8) 
-{ 
-    return ParseAtoms((char *)s.c_str(),l,utf8); 
-}
+// size of the output buffer, before it is written to the stream
+#define POOL_WRBUF (1<<16)
 
-static bool ReadAtoms(istream &is,flext::AtomList &l,char del,bool utf8)
+// buffered output of lines, written to the stream in large blocks
+class poolwriter
 {
-    vector<char> tmp;
-    for(;;) {
-        char c = is.get();
-        if(is.eof() || c == del) break;
-        tmp.push_back(c);
-    }
-    tmp.push_back(0); // end-of-string marker
+public:
+	poolwriter(ostream &s): os(s) { buf.reserve(POOL_WRBUF+1024); }
 
-	return is.good() && ParseAtoms(&tmp[0],l,utf8);
-}
+	void Line()
+	{
+		buf += '\n';
+		if(buf.size() >= POOL_WRBUF) Flush();
+	}
 
-static bool WriteAtom(ostream &os,const t_atom &a,bool utf8)
-{
-	if(flext::IsFloat(a))
-		os << flext::GetFloat(a);
-    else if(flext::IsInt(a))
-		os << flext::GetInt(a);
-    else if(flext::IsSymbol(a)) {
-        const char *c = flext::GetString(a);
-        if(utf8) {
-#if FLEXT_OS == FLEXT_OS_WIN
-            char tmp[1024];
-            wchar_t wtmp[1024];
-            int err = MultiByteToWideChar(CP_ACP,0,c,strlen(c),wtmp,sizeof(wtmp)/sizeof(*wtmp));
-            if(!err) return false;
-            err = WideCharToMultiByte(CP_UTF8,0,wtmp,err,tmp,sizeof(tmp),NULL,FALSE);
-            if(!err) return false;
-            tmp[err] = 0;
-            c = tmp;
-#else
-            char tmp[1024];
-            wchar_t wtmp[1024];
-			if(!UTF8toWCS(wtmp,c,sizeof(wtmp)/sizeof(*wtmp))) return false;
-			size_t len = wcstombs(tmp,wtmp,sizeof(tmp));
-			if(len < 0) return false;
-            c = tmp;
-#endif
-        }
+	void Indent(int cnt) { buf.append(cnt,'\t'); }
 
-        os << '"';
-        for(; *c; ++c) {
-			// escape some special characters
-            if(_isspace(*c) || *c == '\\' || *c == ',' || *c == '"')
-                os << '\\';
-	        os << *c;
-        }
-        os << '"';
+	bool Flush()
+	{
+		os.write(buf.data(),buf.size());
+		buf.clear();
+		return os.good();
 	}
-    else
-        FLEXT_ASSERT(false);
-    return true;
+
+	string buf;
+
+protected:
+	ostream &os;
+};
+
+static void PutInt(string &s,int i)
+{
+	char tmp[16],*e = tmp+sizeof tmp,*c = e;
+	unsigned int u = i < 0?0u-(unsigned int)i:(unsigned int)i;
+	do *--c = (char)('0'+u%10); while(u /= 10);
+	if(i < 0) *--c = '-';
+	s.append(c,e-c);
 }
 
-static void WriteAtoms(ostream &os,const flext::AtomList &l,bool utf8)
+static void PutFloat(string &s,t_float f)
 {
-	for(int i = 0; i < l.Count(); ++i) {
-		WriteAtom(os,l[i],utf8);
-		if(i < l.Count()-1) os << ' ';
+	if(f != 0 && f > -1e6 && f < 1e6 && f == (int)f) {
+		// integral values are written like ints (as %g does)
+		PutInt(s,(int)f);
+		return;
+	}
+
+	// shortest precision from the default (6) upwards that reads back to the same value
+	const int maxprec = sizeof(t_float) > 4?17:9;
+	char tmp[32];
+	int len = 0;
+	for(int prec = 6; prec <= maxprec; ++prec) {
+		len = snprintf(tmp,sizeof tmp,"%.*g",prec,(double)f);
+		if(f != f || (t_float)strtod(tmp,NULL) == f) break;
 	}
+	s.append(tmp,len);
 }
 
-bool pooldir::LdDir(istream &is,int depth,bool mkdir)
+static bool PutAtom(string &s,const t_atom &a,bool utf8)
 {
-	for(int i = 1; !is.eof(); ++i) {
-		Atoms d,k,*v = new Atoms;
-		bool r = 
-            ReadAtoms(is,d,',',false) && 
-            ReadAtoms(is,k,',',false) &&
-            ReadAtoms(is,*v,'\n',false);
-
-		if(r) {
-			if(depth < 0 || d.Count() <= depth) {
-				pooldir *nd = mkdir?AddDir(d):GetDir(d);
-				if(nd) {
-                    if(k.Count() == 1) {
-	    				nd->SetVal(k[0],v); v = NULL;
-                    }
-                    else if(k.Count() > 1)
-                        post("pool - file format invalid: key must be a single word");
-				}
-	#ifdef FLEXT_DEBUG
-				else
-					post("pool - directory was not found",i);
-	#endif
-			}
+	if(flext::IsFloat(a))
+		PutFloat(s,flext::GetFloat(a));
+	else if(flext::IsInt(a))
+		PutInt(s,flext::GetInt(a));
+	else if(flext::IsSymbol(a)) {
+		const char *c = flext::GetString(a);
+		string tmp;
+		if(utf8 && !(c = ToUTF8(c,tmp))) return false;
+
+		s += '"';
+		for(;;) {
+			// copy runs of plain characters, escape some special characters
+			const char *r = c;
+			while(*c && !_isspace(*c) && *c != '\\' && *c != ',' && *c != '"') ++c;
+			s.append(r,c-r);
+			if(!*c) break;
+			s += '\\';
+			s += *c++;
 		}
-		else if(!is.eof())
-			post("pool - format mismatch encountered, skipped line %i",i);
-
-		if(v) delete v;
+		s += '"';
 	}
+	else
+		FLEXT_ASSERT(false);
 	return true;
 }
 
-bool pooldir::SvDir(ostream &os,int depth,const AtomList &dir)
+static void PutAtoms(string &s,int argc,const t_atom *argv,bool utf8)
+{
+	for(int i = 0; i < argc; ++i) {
+		if(i) s += ' ';
+		PutAtom(s,argv[i],utf8);
+	}
+}
+
+static void PutAtoms(string &s,const flext::AtomList &l,bool utf8) { PutAtoms(s,l.Count(),l.Atoms(),utf8); }
+
+void pooldir::SvDirRec(poolwriter &wr,int depth,const string &path)
 {
+	string &s = wr.buf;
     int cnt = 0;
-	for(int vi = 0; vi < vsize; ++vi) {
-		for(poolval *ix = vals[vi].v; ix; ix = ix->nxt) {
-			WriteAtoms(os,dir,false);
-			os << " , ";
-			WriteAtom(os,ix->key,false);
-			os << " , ";
-			WriteAtoms(os,*ix->data,false);
-			os << endl;
+    if(GetMode() != poolstore::mode_hash) {
+        // mode is stored as a line without key, prior to the values
+        Atoms m;
+        GetMode(m);
+		s += path;
+		s += " , , ";
+		PutAtoms(s,m,false);
+		wr.Line();
+        ++cnt;
+    }
+    if(vals->Chunks()) {
+        // packed series: one keyless line per chunk
+        for(int ci = 0; ci < vals->Chunks(); ++ci) {
+            Atoms c;
+            vals->GetChunk(ci,c);
+		    s += path;
+		    s += " , , chunk ";
+		    PutAtoms(s,c,false);
+		    wr.Line();
             ++cnt;
-		}
+        }
+    }
+	else for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+		s += path;
+		s += " , ";
+		poolkey k = ix->Key();
+		PutAtoms(s,k.cnt,k.atoms,false);
+		s += " , ";
+		PutAtoms(s,*ix->data,false);
+		wr.Line();
+        ++cnt;
 	}
     if(!cnt) {
         // no key/value pairs present -> force empty directory
-		WriteAtoms(os,dir,false);
-		os << " , ," << endl;
+		s += path;
+		s += " , ,";
+		wr.Line();
     }
 	if(depth) {
-        // save sub-directories
+        // save sub-directories, extending the formatted path in place
 		int nd = depth > 0?depth-1:-1;
-		for(int di = 0; di < dsize; ++di) {
+		string sub(path);
+		for(int di = 0; di < DTSize(); ++di) {
 			for(pooldir *ix = dirs[di].d; ix; ix = ix->nxt) {
-				ix->SvDir(os,nd,Atoms(dir).Append(ix->dir));
+				sub.resize(path.size());
+				if(!path.empty()) sub += ' ';
+				PutAtom(sub,ix->dir,false);
+				ix->SvDirRec(wr,nd,sub);
 			}
 		}
 	}
-	return true;
 }
 
-class xmltag {
-public:
-    string tag,attr;
-    bool Ok() const { return tag.length() > 0; }
-    bool operator ==(const char *t) const { return !tag.compare(t); }
-
-    void Clear() 
-    { 
-#if defined(_MSC_VER) && (_MSC_VER < 0x1200)
-        // incomplete STL implementation
-        tag = ""; attr = ""; 
-#else
-        tag.clear(); attr.clear(); 
-#endif
-    }
+bool pooldir::SvDir(ostream &os,int depth,const AtomList &dir)
+{
+	string path;
+	PutAtoms(path,dir,false);
+	poolwriter wr(os);
+	SvDirRec(wr,depth,path);
+	return wr.Flush();
+}
 
-    enum { t_start,t_end,t_empty } type;
-};
+/* tokenizer for the XML format written by pooldir::SvDirXML (see pool-0.2.dtd)
+
+   The file is scanned in memory, tags and character data are returned
+   as ranges of the buffer, so there is no limit on their length.
+   Comments and processing instructions are skipped.
+   Character data may contain < within quoted symbols, which may in turn
+   contain quotes escaped with a backslash.
+*/
 
-static bool gettag(istream &is,xmltag &tag)
+class poolxmlreader
 {
-    static const char *commstt = "<!--",*commend = "-->";
+public:
+	poolxmlreader(const char *buf,size_t len): p(buf),e(buf+len) {}
 
-    for(;;) {
-        // eat whitespace
-        while(_isspace(is.peek())) is.get();
+	enum token { tk_end,tk_start,tk_close,tk_empty,tk_text };
 
-        // no tag begin -> break
-        if(is.peek() != '<') break;
-        is.get(); // swallow <
+	// next tag or character data
+	token Next();
 
-        char tmp[1024],*t = tmp;
+	// is the name of the last tag t?
+	bool Is(const char *t) const { size_t l = strlen(t); return (size_t)(te-tb) == l && !memcmp(tb,t,l); }
 
-        // parse for comment start
-        const char *c = commstt;
-        while(*++c) {
-            if(*c != is.peek()) break;
-            *(t++) = is.get();
-        }
+	// tag name or character data of the last token
+	const char *tb,*te;
 
-        if(!*c) { // is comment
-            char cmp[2] = {0,0}; // set to some unusual initial value
+protected:
+	// go behind the next occurrence of s, to the end if there is none
+	bool Skip(const char *s);
 
-            for(int ic = 0; ; ic = (++ic)%2) {
-                char c = is.get();
-                if(c == '>') {
-                    // if third character is > then check also the former two
-                    int i;
-                    for(i = 0; i < 2 && cmp[(ic+i)%2] == commend[i]; ++i) {}
-                    if(i == 2) break; // match: comment end found!
-                }
-                else
-                    cmp[ic] = c;
-            }
-        }
-        else {
-            // parse until > with consideration of "s
-            bool intx = false;
-            for(;;) {
-                *t = is.get();
-                if(*t == '"') intx = !intx;
-                else if(*t == '>' && !intx) {
-                    *t = 0;
-                    break;
-                }
-                t++;
-            }
-
-            // look for tag slashes
+	const char *p,*e;
+};
 
-            char *tb = tmp,*te = t-1,*tf;
+bool poolxmlreader::Skip(const char *s)
+{
+	size_t n = strlen(s);
+	for(; (size_t)(e-p) >= n; ++p)
+		if(*p == *s && !memcmp(p,s,n)) {
+			p += n;
+			return true;
+		}
+	p = e;
+	return false;
+}
 
-            for(; _isspace(*tb); ++tb) {}
-            if(*tb == '/') { 
-                // slash at the beginning -> end tag
-                tag.type = xmltag::t_end;
-                for(++tb; _isspace(*tb); ++tb) {}
-            }
-            else {
-                for(; _isspace(*te); --te) {}
-                if(*te == '/') { 
-                    // slash at the end -> empty tag
-                    for(--te; _isspace(*te); --te) {}
-                    tag.type = xmltag::t_empty;
-                }
-                else 
-                    // no slash -> begin tag
-                    tag.type = xmltag::t_start;
-            }
+poolxmlreader::token poolxmlreader::Next()
+{
+	for(;;) {
+		while(p < e && _isspace(*p)) ++p;
+		if(p == e) return tk_end;
+
+		if(*p != '<') {
+			// character data up to the next tag outside of quotes
+			bool intx = false;
+			for(tb = p; p < e; ++p) {
+				if(*p == '\\') {
+					if(p+1 < e) ++p;
+				}
+				else if(*p == '"') intx = !intx;
+				else if(*p == '<' && !intx) break;
+			}
+			te = p;
+			return tk_text;
+		}
 
-            // copy tag text without slashes
-            for(tf = tb; tf <= te && *tf && !_isspace(*tf); ++tf) {}
-            tag.tag.assign(tb,tf-tb);
-            while(_isspace(*tf)) ++tf;
-            tag.attr.assign(tf,te-tf+1);
+		if(e-p >= 4 && !memcmp(p,"<!--",4)) {
+			p += 4;
+			if(!Skip("-->")) return tk_end;
+			continue;
+		}
+		if(e-p >= 2 && p[1] == '?') {
+			p += 2;
+			if(!Skip("?>")) return tk_end;
+			continue;
+		}
 
-            return true;
-        }
-    }
+		// parse until > with consideration of "s
+		const char *s = ++p;
+		bool intx = false;
+		for(; p < e && (intx || *p != '>'); ++p)
+			if(*p == '"') intx = !intx;
+		if(p == e) return tk_end;
+		const char *t = p++;
+
+		// look for tag slashes
+		token tk;
+		while(s < t && _isspace(*s)) ++s;
+		while(t > s && _isspace(t[-1])) --t;
+		if(s < t && *s == '/') {
+			// slash at the beginning -> end tag
+			tk = tk_close;
+			for(++s; s < t && _isspace(*s); ++s) {}
+		}
+		else if(t > s && t[-1] == '/') {
+			// slash at the end -> empty tag
+			tk = tk_empty;
+			for(--t; t > s && _isspace(t[-1]); --t) {}
+		}
+		else 
+			// no slash -> begin tag
+			tk = tk_start;
 
-    tag.Clear();
-    return false;
+		// tag name without attributes
+		for(tb = te = s; te < t && !_isspace(*te); ++te) {}
+		if(tb < te) return tk;
+	}
 }
 
-static void getvalue(istream &is,string &s)
+// parse state of a directory level
+struct poolxmllevel
 {
-    char tmp[1024],*t = tmp; 
-    bool intx = false;
-    for(;;) {
-        char c = is.peek();
-        if(c == '"') intx = !intx;
-        else if(c == '<' && !intx) break;
-        *(t++) = is.get();
-    }
-    *t = 0;
-    s = tmp;
-}
+	poolxmllevel(): inval(false),inkey(false),indata(false),inmode(false),inchunk(false),cntval(0) {}
+
+    bool inval,inkey,indata,inmode,inchunk;
+    int cntval;
+};
 
-bool pooldir::LdDirXMLRec(istream &is,int depth,bool mkdir,AtomList &d)
+bool pooldir::LdDirXML(const char *buf,size_t len,int depth,bool mkdir,const poolfilter *flt)
 {
-    Atoms k,v;
-    bool inval = false,inkey = false,indata = false;
-    int cntval = 0;
+	poolxmlreader rd(buf,len);
+	poolcursor cur(this,mkdir);
+
+	// directory path, with an empty symbol as long as the key of the last level is not given,
+	// and the parse state for each level (plus the pool level) in place of recursion
+	vector<t_atom> d;
+	vector<poolxmllevel> lvls;
+    Atoms k,v,m;
+    string tok;
+
+	for(;;) {
+        poolxmlreader::token tk = rd.Next();
+        if(tk == poolxmlreader::tk_end) break;
+
+        if(lvls.empty()) {
+            // outside of the pool element
+            if(tk == poolxmlreader::tk_text) break;
+
+            if(rd.Is("pool")) {
+                if(tk == poolxmlreader::tk_start)
+                    lvls.push_back(poolxmllevel());
+                else
+                    post("pool - pool not initialized yet");
+            }
+            else if(rd.Is("!DOCTYPE")) {
+                // ignore
+            }
+#ifdef FLEXT_DEBUG
+            else {
+                post("pool - unknown XML tag '%s'",string(rd.tb,rd.te).c_str());
+            }
+#endif
+            continue;
+        }
 
-	while(!is.eof()) {
-        xmltag tag;
-        gettag(is,tag);
-        if(!tag.Ok()) {
+        poolxmllevel &l = lvls.back();
+        int dcnt = (int)d.size();
+        const t_atom *dlst = dcnt?&d[0]:NULL;
+        // contents of other directories are skipped without parsing them
+        bool sel = (depth < 0 || dcnt <= depth) && (!flt || flt->Dir(dcnt,dlst));
+
+        if(tk == poolxmlreader::tk_text) {
             // look for value
-            string s;
-            getvalue(is,s);
-
-            if(s.length() &&
-                (
-                    (!inval && inkey && d.Count()) ||  /* dir */
-                    (inval && (inkey || indata)) /* value */
-                )
+            if(
+                (!l.inval && l.inkey && dcnt) ||  /* dir */
+                (!l.inval && (l.inmode || l.inchunk)) || /* mode or chunk */
+                (l.inval && (l.inkey || l.indata)) /* value */
             ) {
                 bool ret = true;
-                if(indata) {
+                if(l.inmode || l.inchunk) {
+                    if(m.Count())
+                        post("pool - XML load: dir mode or chunk already given, ignoring new data");
+                    else if(sel)
+                        ret = ParseAtoms(rd.tb,rd.te,m,true);
+                }
+                else if(l.indata) {
                     if(v.Count())
                         post("pool - XML load: value data already given, ignoring new data");
-                    else
-                        ret = ParseAtoms(s,v,true);
+                    else if(sel && (!flt || !k.Count() || flt->Key(k)))
+                        ret = ParseAtoms(rd.tb,rd.te,v,true,true);
                 }
                 else // inkey
-                    if(inval) {
+                    if(l.inval) {
                         if(k.Count())
                             post("pool - XML load, value key already given, ignoring new key");
                         else
-                            ret = ParseAtoms(s,k,true);
+                            ret = ParseAtoms(rd.tb,rd.te,k,true);
                     }
                     else {
-                        t_atom &dkey = d[d.Count()-1];
-                        FLEXT_ASSERT(IsSymbol(dkey));
-                        const char *ds = GetString(dkey);
-                        FLEXT_ASSERT(ds);
-                        if(*ds) 
+                        t_atom &dkey = d.back();
+                        if(!IsSymbol(dkey) || GetSymbol(dkey) != sym__)
                             post("pool - XML load: dir key already given, ignoring new key");
                         else
-                            ReadAtom(s.c_str(),dkey,true);
-
-                        ret = true;
+                            ret = ReadAtom(rd.tb,rd.te,dkey,tok,true) != NULL;
                     }
-                if(!ret) post("pool - error interpreting XML value (%s)",s.c_str());
+                if(!ret) post("pool - error interpreting XML value (%s)",string(rd.tb,rd.te).c_str());
             }
             else
                 post("pool - error reading XML data");
         }
-        else if(tag == "dir") {
-            if(tag.type == xmltag::t_start) {
+        else if(rd.Is("dir")) {
+            if(tk == poolxmlreader::tk_start) {
                 // warn if last directory key was not given
-                if(d.Count() && GetSymbol(d[d.Count()-1]) == sym__)
+                if(dcnt && IsSymbol(d.back()) && GetSymbol(d.back()) == sym__)
                     post("pool - XML load: dir key must be given prior to subdirs, ignoring items");
 
-                Atoms dnext(d.Count()+1);
-                // copy existing dir
-                dnext.Set(d.Count(),d.Atoms(),0,false);
-                // initialize current dir key as empty
-                SetSymbol(dnext[d.Count()],sym__);
-
-                // read next level
-                LdDirXMLRec(is,depth,mkdir,dnext); 
+                // next level, with the key initialized as empty
+                t_atom dkey;
+                SetSymbol(dkey,sym__);
+                d.push_back(dkey);
+                lvls.push_back(poolxmllevel());
             }
-            else if(tag.type == xmltag::t_end) {
-                if(!cntval && mkdir) {
+            else if(tk == poolxmlreader::tk_close) {
+                if(!l.cntval && (!flt || flt->Dir(dcnt,dlst))) {
                     // no values have been found in dir -> make empty dir
-                    AddDir(d);
+                    cur.Dir(dcnt,dlst);
                 }
 
-                // break tag loop
-                break;
+                // back to the parent level (or out of the pool)
+                lvls.pop_back();
+                if(dcnt) d.pop_back();
             }
         }
-        else if(tag == "value") {
-            if(tag.type == xmltag::t_start) {
-                inval = true;
-                ++cntval;
+        else if(rd.Is("value")) {
+            if(tk == poolxmlreader::tk_start) {
+                l.inval = true;
+                ++l.cntval;
                 k.Clear(); v.Clear();
             }
-            else if(tag.type == xmltag::t_end) {
-                // set value after tag closing, but only if level <= depth
-        	    if(depth < 0 || d.Count() <= depth) {
+            else if(tk == poolxmlreader::tk_close) {
+                // set value after tag closing, but only if level <= depth (and selected)
+        	    if(sel && (!flt || flt->Key(k))) {
                     int fnd;
-                    for(fnd = d.Count()-1; fnd >= 0; --fnd)
-                        if(GetSymbol(d[fnd]) == sym__) break;
+                    for(fnd = dcnt-1; fnd >= 0; --fnd)
+                        if(IsSymbol(d[fnd]) && GetSymbol(d[fnd]) == sym__) break;
 
                     // look if last dir key has been given
                     if(fnd >= 0) {
-                        if(fnd == d.Count()-1)
+                        if(fnd == dcnt-1)
                             post("pool - XML load: dir key must be given prior to values");
 
                         // else: one directory level has been left unintialized, ignore items
                     }
                     else {
-                        // only use first word of key
-                        if(k.Count() == 1) {
-		        		    pooldir *nd = mkdir?AddDir(d):GetDir(d);
-        				    if(nd) 
-                                nd->SetVal(k[0],new Atoms(v));
-                            else
-                                post("pool - XML load: value key must be exactly one word, value not stored");
+                        // all words of the key form a tuple
+                        if(k.Count()) {
+		        		    pooldir *nd = cur.Dir(dcnt,dlst);
+        				    if(nd) {
+                                // values come one by one, let the table grow along
+                                nd->Reserve(nd->CntAll()+1,0);
+                                nd->SetVal(k,new Atoms(v));
+                            }
 				        }
+                        else
+                            post("pool - XML load: value key missing, value not stored");
                     }
                 }
-                inval = false;
+                l.inval = false;
             }
         }
-        else if(tag == "key") {
-            if(tag.type == xmltag::t_start) {
-                inkey = true;
+        else if(rd.Is("mode")) {
+            if(l.inval) 
+                post("pool - XML tag <mode> within <value>");
+
+            if(tk == poolxmlreader::tk_start) {
+                l.inmode = true;
+                m.Clear();
+            }
+            else if(tk == poolxmlreader::tk_close) {
+        	    if(sel) {
+                    if(dcnt && IsSymbol(d.back()) && GetSymbol(d.back()) == sym__)
+                        post("pool - XML load: dir key must be given prior to mode");
+                    else {
+		        	    pooldir *nd = cur.Dir(dcnt,dlst);
+        			    if(nd && !nd->SetMode(m))
+                            post("pool - XML load: unknown directory mode");
+                    }
+                }
+                l.inmode = false;
+            }
+        }
+        else if(rd.Is("chunk")) {
+            if(l.inval) 
+                post("pool - XML tag <chunk> within <value>");
+
+            if(tk == poolxmlreader::tk_start) {
+                l.inchunk = true;
+                ++l.cntval;
+                m.Clear();
             }
-            else if(tag.type == xmltag::t_end) {
-                inkey = false;
+            else if(tk == poolxmlreader::tk_close) {
+        	    if(sel) {
+                    if(dcnt && IsSymbol(d.back()) && GetSymbol(d.back()) == sym__)
+                        post("pool - XML load: dir key must be given prior to chunks");
+                    else {
+		        	    pooldir *nd = cur.Dir(dcnt,dlst);
+        			    if(nd && !nd->AddChunk(m))
+                            post("pool - XML load: bad value chunk");
+                    }
+                }
+                l.inchunk = false;
             }
         }
-        else if(tag == "data") {
-            if(!inval) 
+        else if(rd.Is("key")) {
+            if(tk == poolxmlreader::tk_start) {
+                l.inkey = true;
+            }
+            else if(tk == poolxmlreader::tk_close) {
+                l.inkey = false;
+            }
+        }
+        else if(rd.Is("data")) {
+            if(!l.inval) 
                 post("pool - XML tag <data> not within <value>");
 
-            if(tag.type == xmltag::t_start) {
-                indata = true;
+            if(tk == poolxmlreader::tk_start) {
+                l.indata = true;
             }
-            else if(tag.type == xmltag::t_end) {
-                indata = false;
+            else if(tk == poolxmlreader::tk_close) {
+                l.indata = false;
             }
         }
-        else if(!d.Count() && tag == "pool" && tag.type == xmltag::t_end) {
-            // break tag loop
-            break;
+        else if(!dcnt && rd.Is("pool") && tk == poolxmlreader::tk_close) {
+            // leave the pool element
+            lvls.pop_back();
         }
 #ifdef FLEXT_DEBUG
         else {
-            post("pool - unknown XML tag '%s'",tag.tag.c_str());
+            post("pool - unknown XML tag '%s'",string(rd.tb,rd.te).c_str());
         }
 #endif
     }
     return true;
 }
 
-bool pooldir::LdDirXML(istream &is,int depth,bool mkdir)
+void pooldir::SvDirXMLRec(poolwriter &wr,int depth,int ind)
 {
-	while(!is.eof()) {
-        xmltag tag;
-        if(!gettag(is,tag)) break;
+	string &s = wr.buf;
+
+    if(GetMode() != poolstore::mode_hash) {
+        Atoms m;
+        GetMode(m);
+        wr.Indent(ind);
+        s += "<mode>";
+		PutAtoms(s,m,true);
+        s += "</mode>";
+        wr.Line();
+    }
 
-        if(tag == "pool") {
-            if(tag.type == xmltag::t_start) {
-                Atoms empty; // must be a separate definition for gcc
-                LdDirXMLRec(is,depth,mkdir,empty);
-            }
-            else
-                post("pool - pool not initialized yet");
-        }
-        else if(tag == "!DOCTYPE") {
-            // ignore
-        }
-#ifdef FLEXT_DEBUG
-        else {
-            post("pool - unknown XML tag '%s'",tag.tag.c_str());
+    if(vals->Chunks()) {
+        for(int ci = 0; ci < vals->Chunks(); ++ci) {
+            Atoms c;
+            vals->GetChunk(ci,c);
+            wr.Indent(ind);
+            s += "<chunk>";
+		    PutAtoms(s,c,true);
+            s += "</chunk>";
+            wr.Line();
         }
-#endif
     }
-    return true;
-}
+	else for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+        wr.Indent(ind);
+        s += "<value><key>";
+		poolkey k = ix->Key();
+		PutAtoms(s,k.cnt,k.atoms,true);
+        s += "</key><data>";
+		PutAtoms(s,*ix->data,true);
+		s += "</data></value>";
+		wr.Line();
+	}
 
-static void indent(ostream &s,int cnt) 
-{
-    for(int i = 0; i < cnt; ++i) s << '\t';
+	if(depth) {
+		int nd = depth > 0?depth-1:-1;
+		for(int di = 0; di < DTSize(); ++di) {
+			for(pooldir *ix = dirs[di].d; ix; ix = ix->nxt) {
+				wr.Indent(ind);
+				s += "<dir>";
+				wr.Line();
+				wr.Indent(ind+1);
+				s += "<key>";
+				PutAtom(s,ix->dir,true);
+				s += "</key>";
+				wr.Line();
+				ix->SvDirXMLRec(wr,nd,ind+1);
+				wr.Indent(ind);
+				s += "</dir>";
+				wr.Line();
+			}
+		}
+	}
 }
 
 bool pooldir::SvDirXML(ostream &os,int depth,const AtomList &dir,int ind)
 {
+	poolwriter wr(os);
+	string &s = wr.buf;
 	int i,lvls = ind?(dir.Count()?1:0):dir.Count();
 
 	for(i = 0; i < lvls; ++i) {
-		indent(os,ind+i);
-		os << "<dir>" << endl;
-		indent(os,ind+i+1);
-		os << "<key>";
-		WriteAtom(os,dir[ind+i],true);
-		os << "</key>" << endl;
+		wr.Indent(ind+i);
+		s += "<dir>";
+		wr.Line();
+		wr.Indent(ind+i+1);
+		s += "<key>";
+		PutAtom(s,dir[ind+i],true);
+		s += "</key>";
+		wr.Line();
+	}
+
+	SvDirXMLRec(wr,depth,ind+lvls);
+
+	for(i = lvls-1; i >= 0; --i) {
+		wr.Indent(ind+i);
+		s += "</dir>";
+		wr.Line();
 	}
+	return wr.Flush();
+}
+
+/* JSON format
+
+   A directory is an object: members with array values are keys with their values,
+   members with object values are subdirectories, the member "@mode" holds the directory mode
+   and "@chunks" the packed chunks of a series (as arrays, in place of the values).
+   Key names are the atoms of a key separated by spaces, parts which read as numbers become numeric atoms.
+   A backslash takes the next character as it is and makes the part a symbol,
+   it is written before spaces and backslashes within symbols, and before symbols
+   which would read as numbers, start with @ or are empty.
+   Values are numbers and strings, on loading true and false are taken as 1 and 0,
+   null is skipped and a single number or string stands for a value of one atom.
+*/
+
+// numeric atom for a string which reads as a number as a whole
+static bool JSONNumber(const char *c,t_atom &a)
+{
+	// strtod would also take inf, nan and hex numbers
+	if(!isdigit((unsigned char)*c) && *c != '-' && *c != '+' && *c != '.') return false;
+	char *endp;
+	double d = strtod(c,&endp);
+	if(*endp || endp == c) return false;
+	if(d >= INT_MIN && d <= INT_MAX && d == (int)d)
+		flext::SetInt(a,(int)d);
+	else
+		flext::SetFloat(a,(t_float)d);
+	return true;
+}
 
-	for(int vi = 0; vi < vsize; ++vi) {
-		for(poolval *ix = vals[vi].v; ix; ix = ix->nxt) {
-            indent(os,ind+lvls);
-            os << "<value><key>";
-			WriteAtom(os,ix->key,true);
-            os << "</key><data>";
-			WriteAtoms(os,*ix->data,true);
-			os << "</data></value>" << endl;
+static void PutJSONString(string &s,const char *c)
+{
+	s += '"';
+	for(;;) {
+		const char *r = c;
+		while((unsigned char)*c >= 0x20 && *c != '"' && *c != '\\') ++c;
+		s.append(r,c-r);
+		if(!*c) break;
+		switch(*c) {
+		case '"': s += "\\\""; break;
+		case '\\': s += "\\\\"; break;
+		case '\n': s += "\\n"; break;
+		case '\t': s += "\\t"; break;
+		case '\r': s += "\\r"; break;
+		default: {
+			char tmp[8];
+			snprintf(tmp,sizeof tmp,"\\u%04x",(unsigned char)*c);
+			s += tmp;
+		}
 		}
+		++c;
+	}
+	s += '"';
+}
+
+static bool PutJSONAtom(string &s,const t_atom &a)
+{
+	if(flext::IsSymbol(a)) {
+		string tmp;
+		const char *c = ToUTF8(flext::GetString(a),tmp);
+		if(!c) return false;
+		PutJSONString(s,c);
+	}
+	else if(flext::IsInt(a))
+		PutInt(s,flext::GetInt(a));
+	else if(flext::IsFloat(a) && flext::GetFloat(a)-flext::GetFloat(a) == 0)
+		PutFloat(s,flext::GetFloat(a));
+	else
+		// infinity and not-a-number can't be written
+		s += "null";
+	return true;
+}
+
+static void PutJSONName(string &s,int argc,const t_atom *argv)
+{
+	string n,tmp;
+	for(int i = 0; i < argc; ++i) {
+		if(i) n += ' ';
+		if(flext::IsSymbol(argv[i])) {
+			const char *c = ToUTF8(flext::GetString(argv[i]),tmp);
+			if(!c) c = "";
+			t_atom a;
+			if(!*c || *c == '@' || JSONNumber(c,a)) n += '\\';
+			for(; *c; ++c) {
+				if(*c == ' ' || *c == '\\') n += '\\';
+				n += *c;
+			}
+		}
+		else if(flext::IsInt(argv[i]))
+			PutInt(n,flext::GetInt(argv[i]));
+		else if(flext::IsFloat(argv[i]))
+			PutFloat(n,flext::GetFloat(argv[i]));
+	}
+	PutJSONString(s,n.c_str());
+}
+
+void pooldir::SvDirJSONRec(poolwriter &wr,int depth,int ind)
+{
+	string &s = wr.buf;
+	int cnt = 0;
+
+	if(GetMode() != poolstore::mode_hash) {
+		Atoms m;
+		GetMode(m);
+		wr.Line();
+		wr.Indent(ind);
+		s += "\"@mode\": [";
+		for(int i = 0; i < m.Count(); ++i) {
+			if(i) s += ", ";
+			PutJSONAtom(s,m[i]);
+		}
+		s += ']';
+		++cnt;
+	}
+
+	if(vals->Chunks()) {
+		// packed series: the chunks as they are, storing the values one by one would thin them out again
+		if(cnt++) s += ',';
+		wr.Line();
+		wr.Indent(ind);
+		s += "\"@chunks\": [";
+		for(int ci = 0; ci < vals->Chunks(); ++ci) {
+			Atoms c;
+			vals->GetChunk(ci,c);
+			if(ci) s += ", ";
+			s += '[';
+			for(int i = 0; i < c.Count(); ++i) {
+				if(i) s += ", ";
+				PutJSONAtom(s,c[i]);
+			}
+			s += ']';
+		}
+		s += ']';
+	}
+	else for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+		if(cnt++) s += ',';
+		wr.Line();
+		wr.Indent(ind);
+		poolkey k = ix->Key();
+		PutJSONName(s,k.cnt,k.atoms);
+		s += ": [";
+		const AtomList &d = *ix->data;
+		for(int i = 0; i < d.Count(); ++i) {
+			if(i) s += ", ";
+			PutJSONAtom(s,d[i]);
+		}
+		s += ']';
 	}
 
 	if(depth) {
 		int nd = depth > 0?depth-1:-1;
-		for(int di = 0; di < dsize; ++di) {
+		for(int di = 0; di < DTSize(); ++di) {
 			for(pooldir *ix = dirs[di].d; ix; ix = ix->nxt) {
-				ix->SvDirXML(os,nd,Atoms(dir).Append(ix->dir),ind+lvls);
+				if(cnt++) s += ',';
+				wr.Line();
+				wr.Indent(ind);
+				PutJSONName(s,1,&ix->dir);
+				s += ": {";
+				ix->SvDirJSONRec(wr,nd,ind+1);
+				wr.Line();
+				wr.Indent(ind);
+				s += '}';
 			}
 		}
 	}
+}
 
-	for(i = lvls-1; i >= 0; --i) {
-		indent(os,ind+i);
-		os << "</dir>" << endl;
+bool pooldir::SvDirJSON(ostream &os,int depth,const AtomList &dir)
+{
+	poolwriter wr(os);
+	string &s = wr.buf;
+	int i,lvls = dir.Count();
+
+	// the path to the directory as nested objects
+	s += '{';
+	for(i = 0; i < lvls; ++i) {
+		wr.Line();
+		wr.Indent(i+1);
+		PutJSONName(s,1,&dir[i]);
+		s += ": {";
+	}
+
+	SvDirJSONRec(wr,depth,lvls+1);
+
+	for(i = lvls; i >= 0; --i) {
+		wr.Line();
+		wr.Indent(i);
+		s += '}';
+	}
+	wr.Line();
+	return wr.Flush();
+}
+
+// scanner for JSON text, strings are unescaped into a buffer which is reused
+class pooljsonreader
+{
+public:
+	pooljsonreader(const char *buf,size_t len): p(buf),e(buf+len) {}
+
+	// next non-blank character, 0 at the end
+	char Peek()
+	{
+		while(p < e && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+		return p < e?*p:0;
+	}
+
+	bool Eat(char c)
+	{
+		if(Peek() != c) return false;
+		++p;
+		return true;
+	}
+
+	// string starting at the current position
+	bool String(string &s);
+	// number, string or literal, none is set for null
+	bool Scalar(t_atom &a,string &tmp,bool &none);
+
+	const char *p,*e;
+
+protected:
+	bool Hex(unsigned int &u);
+};
+
+bool pooljsonreader::Hex(unsigned int &u)
+{
+	if(e-p < 4) return false;
+	u = 0;
+	for(int i = 0; i < 4; ++i) {
+		char c = *p++;
+		u <<= 4;
+		if(c >= '0' && c <= '9') u |= c-'0';
+		else if(c >= 'a' && c <= 'f') u |= c-'a'+10;
+		else if(c >= 'A' && c <= 'F') u |= c-'A'+10;
+		else return false;
+	}
+	return true;
+}
+
+bool pooljsonreader::String(string &s)
+{
+	s.clear();
+	if(p >= e || *p != '"') return false;
+	++p;
+	for(;;) {
+		// copy runs of plain characters
+		const char *r = p;
+		while(p < e && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) ++p;
+		s.append(r,p-r);
+		if(p >= e || (unsigned char)*p < 0x20) return false;
+		if(*p++ == '"') return true;
+
+		if(p >= e) return false;
+		switch(*p++) {
+		case '"': s += '"'; break;
+		case '\\': s += '\\'; break;
+		case '/': s += '/'; break;
+		case 'b': s += '\b'; break;
+		case 'f': s += '\f'; break;
+		case 'n': s += '\n'; break;
+		case 'r': s += '\r'; break;
+		case 't': s += '\t'; break;
+		case 'u': {
+			unsigned int u,l;
+			if(!Hex(u)) return false;
+			if(u >= 0xd800 && u < 0xdc00) {
+				// surrogate pair
+				if(e-p < 2 || p[0] != '\\' || p[1] != 'u') return false;
+				p += 2;
+				if(!Hex(l) || l < 0xdc00 || l >= 0xe000) return false;
+				u = 0x10000+((u-0xd800)<<10)+(l-0xdc00);
+			}
+			else if(u >= 0xdc00 && u < 0xe000)
+				return false;
+
+			// as UTF-8
+			if(u < 0x80)
+				s += (char)u;
+			else if(u < 0x800) {
+				s += (char)(0xc0|(u>>6));
+				s += (char)(0x80|(u&0x3f));
+			}
+			else if(u < 0x10000) {
+				s += (char)(0xe0|(u>>12));
+				s += (char)(0x80|((u>>6)&0x3f));
+				s += (char)(0x80|(u&0x3f));
+			}
+			else {
+				s += (char)(0xf0|(u>>18));
+				s += (char)(0x80|((u>>12)&0x3f));
+				s += (char)(0x80|((u>>6)&0x3f));
+				s += (char)(0x80|(u&0x3f));
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+}
+
+bool pooljsonreader::Scalar(t_atom &a,string &tmp,bool &none)
+{
+	none = false;
+	char c = Peek();
+	if(c == '"') {
+		if(!String(tmp) || !FromUTF8(tmp)) return false;
+		poolstrings::Set(a,tmp.c_str());
+		return true;
+	}
+
+	// number or literal
+	const char *r = p;
+	while(p < e && (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.')) ++p;
+	size_t n = p-r;
+	if(n == 4 && !strncmp(r,"true",4))
+		flext::SetInt(a,1);
+	else if(n == 5 && !strncmp(r,"false",5))
+		flext::SetInt(a,0);
+	else if(n == 4 && !strncmp(r,"null",4))
+		none = true;
+	else {
+		char num[64],*endp;
+		if(!n || n >= sizeof num) return false;
+		memcpy(num,r,n);
+		num[n] = 0;
+		double d = strtod(num,&endp);
+		if(*endp) return false;
+		// like ReadAtom does
+		if(d >= INT_MIN && d <= INT_MAX && d == (int)d)
+			flext::SetInt(a,(int)d);
+		else
+			flext::SetFloat(a,(t_float)d);
 	}
 	return true;
 }
 
+// atoms of a member name
+static void JSONName(const string &name,Atoms &l,string &tmp)
+{
+	l.Clear();
+	size_t i = 0,n = name.size();
+	while(i < n) {
+		if(name[i] == ' ') {
+			++i;
+			continue;
+		}
+
+		bool sym = false;
+		tmp.clear();
+		for(; i < n && name[i] != ' '; ++i) {
+			char c = name[i];
+			if(c == '\\') {
+				// escaped character
+				sym = true;
+				if(++i == n) break;
+				c = name[i];
+			}
+			tmp += c;
+		}
+
+		t_atom a;
+		if(sym || !JSONNumber(tmp.c_str(),a)) flext::SetString(a,tmp.c_str());
+		l.Append(a);
+	}
+}
+
+bool pooldir::LdDirJSON(const char *buf,size_t len,int depth,bool mkdir)
+{
+	pooljsonreader rd(buf,len);
+	if(!rd.Eat('{')) return false;
+
+	// open objects, in place of recursion: their directory (NULL if skipped)
+	vector<pooldir *> lvls(1,this);
+	vector<t_atom> vals;
+	string name,tmp;
+	Atoms key;
+	bool first = true;
+
+	while(!lvls.empty()) {
+		if(rd.Eat('}')) {
+			lvls.pop_back();
+			first = false;
+			continue;
+		}
+		if(!first && !rd.Eat(',')) return false;
+		first = false;
+
+		if(rd.Peek() != '"' || !rd.String(name) || !FromUTF8(name) || !rd.Eat(':')) return false;
+		pooldir *d = lvls.back();
+
+		if(rd.Eat('{')) {
+			// subdirectory
+			pooldir *sd = NULL;
+			if(d && (depth < 0 || (int)lvls.size() <= depth)) {
+				JSONName(name,key,tmp);
+				// names not written by pool may have unescaped spaces
+				if(key.Count() != 1) {
+					key(1);
+					flext::SetString(key[0],name.c_str());
+				}
+				sd = mkdir?d->AddDir(key):d->GetDir(key);
+			}
+			lvls.push_back(sd);
+			first = true;
+			continue;
+		}
+
+		vals.clear();
+		t_atom a;
+		bool none;
+		if(name == "@chunks") {
+			// arrays of atoms
+			if(!rd.Eat('[')) return false;
+			if(!rd.Eat(']')) {
+				do {
+					if(!rd.Eat('[')) return false;
+					vals.clear();
+					if(!rd.Eat(']')) {
+						do {
+							if(!rd.Scalar(a,tmp,none)) return false;
+							// keep the layout of the chunk
+							if(none) flext::SetFloat(a,0);
+							vals.push_back(a);
+						} while(rd.Eat(','));
+						if(!rd.Eat(']')) return false;
+					}
+					if(d && !d->AddChunk(Atoms((int)vals.size(),vals.empty()?NULL:&vals[0])))
+						post("pool - JSON format invalid: bad value chunk");
+				} while(rd.Eat(','));
+				if(!rd.Eat(']')) return false;
+			}
+			continue;
+		}
+
+		if(rd.Eat('[')) {
+			if(!rd.Eat(']')) {
+				do {
+					char c = rd.Peek();
+					if(c == '[' || c == '{') {
+						post("pool - JSON format invalid: nested arrays or objects in values");
+						return false;
+					}
+					if(!rd.Scalar(a,tmp,none)) return false;
+					if(!none) vals.push_back(a);
+				} while(rd.Eat(','));
+				if(!rd.Eat(']')) return false;
+			}
+		}
+		else {
+			if(!rd.Scalar(a,tmp,none)) return false;
+			if(!none) vals.push_back(a);
+		}
+		if(!d) continue;
+
+		if(name == "@mode") {
+			if(!d->SetMode((int)vals.size(),vals.empty()?NULL:&vals[0]))
+				post("pool - JSON format invalid: unknown directory mode");
+			continue;
+		}
+
+		JSONName(name,key,tmp);
+		if(key.Count())
+			d->SetVal(key,new Atoms((int)vals.size(),vals.empty()?NULL:&vals[0]));
+	}
+
+	// nothing but blanks may follow
+	return !rd.Peek();
+}
+
+/* CSV format (loaded in load.cpp)
+
+   Fields are separated by a delimiter, symbols are quoted if necessary (with quotes doubled within).
+   The atoms of a key take the leading columns, tuple keys are loaded back by giving their number of columns.
+*/
+
+// symbol field, quoted if it might not read back as it is
+static void PutCSVString(string &s,const char *c,char delim)
+{
+	size_t n = strlen(c);
+	// empty fields are missing, blanks around it would be dropped, anything starting like a number might read as one
+	bool quote = !n || (c[0] == ' ' || c[0] == '\t' || c[n-1] == ' ' || c[n-1] == '\t' || c[0] == '"' ||
+		isdigit((unsigned char)c[0]) || c[0] == '-' || c[0] == '+' || c[0] == '.');
+	for(size_t i = 0; !quote && i < n; ++i)
+		quote = c[i] == delim || c[i] == '\n' || c[i] == '\r';
+
+	if(!quote) {
+		s.append(c,n);
+		return;
+	}
+
+	s += '"';
+	for(const char *r = c;; ) {
+		const char *q = strchr(r,'"');
+		if(!q) {
+			s += r;
+			break;
+		}
+		s.append(r,q-r+1);
+		s += '"';
+		r = q+1;
+	}
+	s += '"';
+}
+
+static void PutCSVAtoms(string &s,int argc,const t_atom *argv,char delim,bool first)
+{
+	for(int i = 0; i < argc; ++i) {
+		if(!first || i) s += delim;
+		if(flext::IsSymbol(argv[i]))
+			PutCSVString(s,flext::GetString(argv[i]),delim);
+		else if(flext::IsInt(argv[i]))
+			PutInt(s,flext::GetInt(argv[i]));
+		else if(flext::IsFloat(argv[i]))
+			PutFloat(s,flext::GetFloat(argv[i]));
+	}
+}
+
+bool pooldir::SvDirCSV(ostream &os,char delim)
+{
+	poolwriter wr(os);
+	string &s = wr.buf;
+
+	// packed series are written value by value
+	for(poolval *ix = vals->Next(NULL); ix; ix = vals->Next(ix)) {
+		poolkey k = ix->Key();
+		PutCSVAtoms(s,k.cnt,k.atoms,delim,true);
+		PutCSVAtoms(s,ix->data->Count(),ix->data->Atoms(),delim,false);
+		wr.Line();
+	}
+	return wr.Flush();
+}
+
+pooldir *poolcursor::Dir(int argc,const t_atom *argv)
+{
+	// length of the path in common with the last directory
+	int n = path.Count(),c = 0;
+	while(c < n && c < argc && !compare(path[c],argv[c])) ++c;
+	if(c == n && c == argc) return cur;
+
+	// go up to the common directory and down from there
+	pooldir *d = cur;
+	for(int i = c; i < n; ++i) d = d->Parent();
+	d = mkdir?d->AddDir(argc-c,argv+c):d->GetDir(argc-c,argv+c);
+
+	if(d) {
+		cur = d;
+		path(argc,argv);
+	}
+	return d;
+}
+
+
 unsigned int pooldir::FoldBits(unsigned long h,int bits)
 {
 	if(!bits) return 0;
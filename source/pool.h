@@ -17,29 +17,256 @@ WARRANTIES, see the file, "license.txt," in this distribution.
 #error You need at least flext version 0.5.0
 #endif
 
+#include <stdio.h>
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+
+#ifndef POOL_NOTHREADS
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define POOL_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+#endif
 
 using namespace std;
 
 
 typedef flext::AtomListStatic<8> Atoms;
 
+// values and subdirectories up to this count are kept in a single sorted chain
+#define POOL_SMALLCNT 8
+
+// key of a value: a single atom or a tuple of atoms (the atoms are not owned)
+class poolkey
+{
+public:
+	poolkey(const t_atom &a): cnt(1),atoms(&a) {}
+	poolkey(int c,const t_atom *a): cnt(c),atoms(a) {}
+	poolkey(const flext::AtomList &l): cnt(l.Count()),atoms(l.Atoms()) {}
+
+	bool Single() const { return cnt == 1; }
+	const t_atom &operator [](int i) const { return atoms[i]; }
+
+	int cnt;
+	const t_atom *atoms;
+};
+
+// ordering of keys and directory names
+int compare(const t_atom &a,const t_atom &b);
+int compare(const poolkey &a,const poolkey &b);
+
+unsigned long KeyHash(const poolkey &k);
+
+// strings of values kept by the pools instead of the system's symbol table (see strings.cpp)
+// they are disguised as symbols, counted by the values holding them and freed when unused
+class poolstrings:
+	public flext
+{
+public:
+	// while in scope, symbols of values are made pool-owned strings (if on) by Set
+	class Use
+	{
+	public:
+		Use(bool on): prev(active) { active = on; }
+		~Use() { active = prev; }
+	protected:
+		bool prev;
+	};
+
+	// symbol atom of a value
+	static void Set(t_atom &a,const char *s);
+	// are pool-owned strings made currently?
+	static bool Active() { return active; }
+
+	static bool Own(const t_symbol *s) { return GetThing(s) == &mark; }
+	// does l hold pool-owned strings?
+	static bool Any(const AtomList &l) { return live && Find(l); }
+	// real symbols in place of pool-owned strings
+	static const t_symbol *Real(const t_symbol *s) { return Own(s)?MakeSymbol(GetString(s)):s; }
+	static void Real(AtomList &l);
+
+	// strings held by a value
+	static void Acquire(const AtomList *l) { if(live && l) Count(*l,1); }
+	static void Release(const AtomList *l) { if(live && l) Count(*l,-1); }
+
+	// number of strings
+	static size_t Strings() { return live; }
+	// free unused strings
+	static void Sweep(void * = NULL);
+
+protected:
+	static bool Find(const AtomList &l);
+	static void Count(const AtomList &l,int inc);
+
+	static bool active;
+	static size_t live;
+	static char mark;
+};
 
 class poolval:
 	public flext
 {
 public:
-	poolval(const t_atom &key,AtomList *data);
+	poolval(const poolkey &key,AtomList *data);
 	~poolval();
 
 	poolval &Set(AtomList *data);
 	poolval *Dup() const;
+	// hand over the data, its strings are not counted here any more
+	AtomList *Take();
 
-	t_atom key;
+	poolkey Key() const { return xkey?poolkey(kcnt,xkey):poolkey(key); }
+
+	t_atom key; // single key, or first atom of a tuple
+	t_atom *xkey; // all atoms of a tuple key, NULL otherwise
+	int kcnt;
 	AtomList *data;
 	poolval *nxt;
 };
 
+// read-only view of a whole file, memory-mapped where possible
+// compressed files are decompressed into memory
+class poolfile
+{
+public:
+	poolfile(): data(NULL),size(0),mapped(false) {}
+	~poolfile();
+
+	bool Open(const char *flnm);
+	void Close();
+
+	const char *Data() const { return data; }
+	size_t Size() const { return size; }
+
+protected:
+	bool Map(const char *flnm);
+
+	const char *data;
+	size_t size;
+	bool mapped;
+};
+
+// compression of files (see compress.cpp)
+enum { zip_none = 0,zip_gzip,zip_zstd };
+
+// kind of compression from the magic bytes of data, or from the extension of a file name
+int ZipKind(const char *data,size_t len);
+int ZipKind(const char *flnm);
+// decompress data into a buffer allocated with malloc
+bool Unzip(int kind,const char *data,size_t len,char *&res,size_t &reslen);
+
+class poolzbuf;
+
+// file for saving, compressed according to its name
+class poolostream:
+	public std::ostream
+{
+public:
+	poolostream(const char *flnm,bool binary = false);
+	~poolostream();
+
+	// complete the file, false if anything failed
+	bool Close();
+
+protected:
+	std::ofstream file;
+	poolzbuf *zbuf;
+};
+
+class poolstore:
+	public flext
+{
+public:
+	enum { mode_hash = 0,mode_fifo,mode_series,mode_array };
+
+	virtual ~poolstore() {}
+
+	// make a value store from a mode specification (e.g. "fifo 100")
+	static poolstore *New(int argc,const t_atom *argv,int vbits);
+	static poolstore *New(int vbits) { return New(0,NULL,vbits); }
+
+	// make the mode symbols (main thread), so that GetMode can be used while saving in the background
+	static void Setup();
+	static const t_symbol *sym_hash,*sym_array,*sym_fifo,*sym_series;
+
+	virtual int Mode() const = 0;
+	virtual void GetMode(AtomList &m) const = 0;
+
+	virtual int Count() const = 0;
+
+	virtual poolval *Ref(const poolkey &key) = 0;
+	virtual poolval *Refi(int ix) = 0;
+
+	// set (data != NULL) or delete (data == NULL) value
+	// the store takes ownership of data
+	virtual void Set(const poolkey &key,AtomList *data,bool over) = 0;
+	virtual bool Seti(int ix,AtomList *data) = 0;
+
+	// unlink value, ownership passes to the caller
+	virtual poolval *Cut(const poolkey &key) = 0;
+	virtual poolval *Cuti(int ix) = 0;
+
+	virtual void Clear() = 0;
+
+	// walk all values, pass NULL for the first one
+	virtual poolval *Next(const poolval *v) const = 0;
+
+	// append value (only for sequential stores)
+	virtual bool Push(AtomList *data) { return false; }
+
+	// prepare for n values in total (a hint for bulk insertion)
+	virtual void Reserve(int n) {}
+
+	// latest value with a numeric key <= t
+	virtual poolval *RefAt(double t);
+	// values with numeric keys within [t0,t1], ordered by key
+	virtual int GetRange(double t0,double t1,Atoms *&keys,Atoms *&lst);
+
+	// packed chunks (only for series stores)
+	virtual int Chunks() const { return 0; }
+	virtual void GetChunk(int ix,AtomList &l) const {}
+	virtual bool AddChunk(const AtomList &l) { return false; }
+};
+
+// selection of the values to load from a file: directories at or below a path
+// and keys matching a pattern (the atoms of a tuple separated by blanks),
+// with * standing for any characters and ? for a single one
+class poolfilter:
+	public flext
+{
+public:
+	poolfilter() {}
+	poolfilter(const AtomList &p,const char *k): path(p),key(k?k:"") {}
+
+	bool Empty() const { return !path.Count() && key.empty(); }
+
+	// is directory d at or below the path?
+	bool Dir(int argc,const t_atom *argv) const;
+	bool Dir(const AtomList &d) const { return Dir(d.Count(),d.Atoms()); }
+	bool Key(const char *k) const { return key.empty() || Match(key.c_str(),k); }
+	bool Key(const AtomList &k) const;
+
+	// text of a key atom as matched, the same for all file formats
+	static void Text(std::string &s,const t_atom &a);
+	static bool Match(const char *pat,const char *s);
+
+	Atoms path;
+	std::string key;
+};
+
+class poolparser;
+class poolcursor;
+class poolbinreader;
+class poolbinwriter;
+class poolimgwriter;
+class poolwriter;
+
 class pooldir:
 	public flext
 {
@@ -50,9 +277,15 @@ public:
 	void Clear(bool rec,bool dironly = false);
 	void Reset(bool realloc = true);
 
-	bool Empty() const { return !dirs && !vals; }
-	bool HasDirs() const { return dirs != NULL; }
-	bool HasVals() const { return vals != NULL; }
+	bool SetMode(int argc,const t_atom *argv);
+	bool SetMode(const AtomList &m) { return SetMode(m.Count(),m.Atoms()); }
+	int GetMode() const { return vals->Mode(); }
+	void GetMode(AtomList &m) const { vals->GetMode(m); }
+
+	// the tables may be allocated while empty
+	bool Empty() const { return !HasDirs() && !HasVals(); }
+	bool HasDirs() const { return subcnt > 0; }
+	bool HasVals() const { return vals && vals->Count() > 0; }
 
 	pooldir *GetDir(int argc,const t_atom *argv,bool cut = false);
 	pooldir *GetDir(const AtomList &d,bool cut = false) { return GetDir(d.Count(),d.Atoms(),cut); }
@@ -61,54 +294,379 @@ public:
 	pooldir *AddDir(int argc,const t_atom *argv,int vcnt = 0,int dcnt = 0);
 	pooldir *AddDir(const AtomList &d,int vcnt = 0,int dcnt = 0) { return AddDir(d.Count(),d.Atoms(),vcnt,dcnt); }
 
-	void SetVal(const t_atom &key,AtomList *data,bool over = true);
+	void SetVal(const poolkey &key,AtomList *data,bool over = true);
 	bool SetVali(int ix,AtomList *data);
-	void ClrVal(const t_atom &key) { SetVal(key,NULL); }
+	void ClrVal(const poolkey &key) { SetVal(key,NULL); }
     bool ClrVali(int ix) { return SetVali(ix,NULL); }
-	AtomList *PeekVal(const t_atom &key);
-	AtomList *GetVal(const t_atom &key,bool cut = false);
+	AtomList *PeekVal(const poolkey &key);
+	AtomList *GetVal(const poolkey &key,bool cut = false);
+	bool PushVal(AtomList *data) { if(!vals->Push(data)) return false; Touch(); return true; }
+	poolval *PopVal() { poolval *v = vals->Cuti(0); if(v) Touch(); return v; }
+	poolval *RefAt(double t) { return vals->RefAt(t); }
+	int GetRange(double t0,double t1,Atoms *&keys,Atoms *&lst) { return vals->GetRange(t0,t1,keys,lst); }
+	bool AddChunk(const AtomList &c) { Touch(); return vals->AddChunk(c); }
 	int CntAll() const;
-	int GetAll(t_atom *&keys,Atoms *&lst,bool cut = false);
+	// walk all values, pass NULL for the first one
+	poolval *NextVal(const poolval *v) const { return vals->Next(v); }
+	int GetAll(Atoms *&keys,Atoms *&lst,bool cut = false);
 	int PrintAll(char *buf,int len) const;
 	int GetKeys(AtomList &keys);
 	int CntSub() const;
 	int GetSub(const t_atom **&dirs);
+	int GetSub(pooldir **&dirs);
 
-	poolval *RefVal(const t_atom &key);
+	poolval *RefVal(const poolkey &key);
 	poolval *RefVali(int ix);
 	
 	bool Paste(const pooldir *p,int depth,bool repl,bool mkdir);
-	bool Copy(pooldir *p,int depth,bool cur);
+	bool Copy(pooldir *p,int depth,bool cur,bool mkdir = true);
 
-	bool LdDir(istream &is,int depth,bool mkdir);
-	bool LdDirXML(istream &is,int depth,bool mkdir);
+	// load only values selected by flt (if given)
+	bool LdDir(const char *buf,size_t len,int depth,bool mkdir,const poolfilter *flt = NULL);
+	bool LdDirXML(const char *buf,size_t len,int depth,bool mkdir,const poolfilter *flt = NULL);
 	bool SvDir(ostream &os,int depth,const AtomList &dir = AtomList());
 	bool SvDirXML(ostream &os,int depth,const AtomList &dir = AtomList(),int ind = 0);
+	bool LdDirJSON(const char *buf,size_t len,int depth,bool mkdir);
+	bool SvDirJSON(ostream &os,int depth,const AtomList &dir = AtomList());
+	// rows of a table, keyed by the field in column keycol
+	// the key is made of keycols columns from keycol on
+	bool LdDirCSV(const char *buf,size_t len,int keycol,int keycols,char delim);
+	bool SvDirCSV(ostream &os,char delim);
+	bool LdDirBin(const char *buf,size_t len,int depth,bool mkdir);
+	bool SvDirBin(ostream &os,int depth,const AtomList &dir = AtomList());
+	bool SvDirImg(ostream &os);
+
+	// prepare tables for vcnt values and dcnt subdirectories in total (hints for bulk insertion)
+	void Reserve(int vcnt,int dcnt);
+
+	pooldir *Parent() const { return parent; }
+	const t_atom &Name() const { return dir; }
+
+	// changes since the last Clean, for incremental saving (see poolshards)
+	// a change marks the directory itself and the ones above it as dirty
+	void Touch() { if(!changed) Mark(); }
+	// changed values or subdirectories in this directory
+	bool Changed() const { return changed; }
+	// changes in this directory or below
+	bool Dirty() const { return dirty; }
+	void Clean();
+
+	// store parsed entries [from,to), numbered after line
+	void LdLines(const poolparser &ps,int line,int depth,poolcursor &cur,int from = 0,int to = -1);
 
 	int VSize() const { return vsize; }
 	int DSize() const { return dsize; }
 
+	static unsigned int FoldBits(unsigned long h,int bits);
+	static int Int2Bits(unsigned long n);
+
 protected:
-	int VIdx(const t_atom &v) const { return FoldBits(AtomHash(v),vbits); }
-	int DIdx(const t_atom &d) const { return FoldBits(AtomHash(d),dbits); }
+	int DIdx(const t_atom &d) const { return FoldBits(AtomHash(d),dtbits); }
+	int DTSize() const { return dirs?1<<dtbits:0; }
+	// (re)allocate subdirectory bucket table
+	void DRehash(int bits);
 
 	t_atom dir;
 	pooldir *nxt;
 
 	pooldir *parent;
 	const int vbits,dbits,vsize,dsize;
-	
-	static unsigned int FoldBits(unsigned long h,int bits);
-	static int Int2Bits(unsigned long n);
+	bool changed,dirty;
 
-	struct valentry { int cnt; poolval *v; };
 	struct direntry { int cnt; pooldir *d; };
 	
-	valentry *vals;
+	poolstore *vals;
+	// subdirectory buckets, allocated on demand, with current size and total count
 	direntry *dirs;
+	int dtbits,subcnt;
 
 private:
-  	bool LdDirXMLRec(istream &is,int depth,bool mkdir,AtomList &d);
+	void Mark();
+	bool LdDirBinRec(poolbinreader &rd,int depth,bool mkdir,int level);
+	void SvDirRec(poolwriter &wr,int depth,const string &path);
+	void SvDirXMLRec(poolwriter &wr,int depth,int ind);
+	void SvDirJSONRec(poolwriter &wr,int depth,int ind);
+	void SvDirBinRec(poolbinwriter &wr,int depth);
+	unsigned long long SvDirImgRec(poolimgwriter &wr);
+};
+
+// resolves directory paths below a base directory for bulk insertion
+// the last directory is remembered, so that consecutive values in the same
+// directory (as files are written) need no lookup
+class poolcursor:
+	public flext
+{
+public:
+	poolcursor(pooldir *base,bool mk = true): cur(base),mkdir(mk) {}
+
+	// directory at path d (made if mkdir is set), NULL if it doesn't exist
+	pooldir *Dir(int argc,const t_atom *argv);
+	pooldir *Dir(const AtomList &d) { return Dir(d.Count(),d.Atoms()); }
+
+protected:
+	pooldir *cur;
+	bool mkdir;
+	// path of cur relative to base
+	Atoms path;
+};
+
+
+class pooldata;
+
+// incremental loading of a text file into a pool directory
+// pieces of the file are parsed ahead (on a worker thread if available),
+// their lines are stored in time-limited steps
+class poolloader:
+	public flext
+{
+public:
+	poolloader(pooldata *p,const AtomList &d,int depth,bool mkdir,const poolfilter *flt = NULL);
+	~poolloader();
+
+	bool Open(const char *flnm);
+	// store lines for about budget seconds, false when finished (or failed)
+	bool Step(double budget);
+	// stop parsing, lines stored so far are kept
+	void Cancel();
+
+	bool Ok() const { return ok; }
+	// bytes stored so far, file size
+	size_t Pos() const { return pos; }
+	size_t Size() const { return file.Size(); }
+
+protected:
+	struct piece;
+
+	// parse the next piece, NULL at the end of the file
+	piece *Parse();
+	// next parsed piece, NULL if there's none (yet)
+	piece *Next();
+	bool Parsed();
+#ifdef POOL_THREADS
+	void Run();
+#endif
+
+	poolfile file;
+	pooldata *data;
+	Atoms dir;
+	int depth;
+	bool mkdir,ok;
+	poolfilter filter;
+	// parse and store positions
+	size_t ppos,pos;
+	int line;
+	// piece being stored and the next entry in it
+	piece *cur;
+	int ix;
+	std::deque<piece *> parsed;
+#ifdef POOL_THREADS
+	std::thread thr;
+	std::mutex mtx;
+	std::condition_variable cond;
+	bool stop,eof;
+#endif
+};
+
+
+// number of values made from an image which stay valid
+#define POOL_IMGRING 16
+
+// read-only pool image, looked up within the memory-mapped file
+class poolimage:
+	public flext
+{
+public:
+	poolimage();
+	~poolimage();
+
+	bool Open(const char *flnm);
+
+	// offset of a directory, 0 if it doesn't exist
+	size_t Dir(int argc,const t_atom *argv) const;
+	size_t Dir(const AtomList &d) const { return Dir(d.Count(),d.Atoms()); }
+
+	void GetMode(size_t dir,AtomList &m);
+	int CntAll(size_t dir) const;
+	int CntSub(size_t dir) const;
+	// values are made on demand and recycled after POOL_IMGRING further ones
+	poolval *Ref(size_t dir,const poolkey &key);
+	poolval *Refi(size_t dir,int ix);
+	int GetAll(size_t dir,Atoms *&keys,Atoms *&lst);
+	int PrintAll(size_t dir,char *buf,int len);
+	int GetSub(size_t dir,const t_atom **&dirs);
+	// copy contents into a pool directory
+	bool Copy(size_t dir,pooldir *p,int depth);
+
+protected:
+	struct dirhead { unsigned int vcnt,vbits,dcnt,dbits; size_t mode,vtab,vidx,vofs,dtab,dofs; };
+
+	const unsigned char *Data() const { return (const unsigned char *)file.Data(); }
+	bool Valid(size_t o,unsigned long long len) const { return o <= file.Size() && len <= file.Size()-o; }
+	bool DirHead(size_t dir,dirhead &h) const;
+
+	const char *SymStr(unsigned int ix) const;
+	const t_symbol *Sym(unsigned int ix);
+	// decode atom(s) at offset o (only skip them if a or l is NULL), return the following offset or 0
+	size_t AtomAt(size_t o,t_atom *a);
+	size_t AtomsAt(size_t o,AtomList *l);
+	bool Equal(size_t o,const t_atom &a) const;
+	poolval *Value(size_t o);
+
+	poolfile file;
+	size_t symtab,root;
+	// symbols, made on first use
+	const t_symbol **syms;
+	unsigned int symcnt;
+	poolval *vring[POOL_IMGRING];
+	int vpos;
+	// subdirectory names handed out by GetSub
+	std::map<size_t,t_atom *> names;
+};
+
+
+// append-only log of the changes to a pool, replayed when it is opened
+// records are buffered and written together a short time after the first change
+class pooljournal:
+	public flext
+{
+public:
+	pooljournal();
+	~pooljournal();
+
+	// open (or make) the journal file, replaying its records into p
+	bool Open(const char *flnm,pooldata *p);
+	// replace the journal by a snapshot of p
+	bool Compact(pooldata *p);
+	// write buffered records
+	bool Flush();
+
+	const char *Name() const { return name.c_str(); }
+
+	// records, made before the changes are applied
+	void Reset();
+	void MkDir(const AtomList &d,int vcnt,int dcnt);
+	void RmDir(const AtomList &d);
+	void Set(const AtomList &d,const poolkey &key,const AtomList *data,bool over);
+	void Clr(const AtomList &d,const poolkey &key);
+	void Seti(const AtomList &d,int ix,const AtomList *data);
+	void Clri(const AtomList &d,int ix);
+	void ClrAll(const AtomList &d,bool rec,bool dironly);
+	void SetMode(const AtomList &d,const AtomList &m);
+	void Push(const AtomList &d,const AtomList *data);
+	void Pop(const AtomList &d);
+	void CutAll(const AtomList &d,int depth);
+	void Paste(const AtomList &d,const pooldir *clip,int depth,bool repl,bool mkdir);
+	// file data loaded into d
+	void Load(int fmt,const AtomList &d,int depth,bool mkdir,const char *data,size_t len,const poolfilter *flt = NULL);
+	void LoadCSV(const AtomList &d,int keycol,int keycols,char delim,const char *data,size_t len);
+
+	enum { fmt_txt,fmt_xml,fmt_bin,fmt_json,fmt_csv };
+
+protected:
+	void Close();
+	bool Replay(const char *data,size_t size,pooldata *p,size_t &valid);
+	bool Apply(const char *data,size_t len,pooldata *p);
+	static bool Truncate(const char *flnm,size_t len);
+
+	void Header();
+	void Varint(unsigned long long v);
+	void Int(int i);
+	void Atom(const t_atom &a);
+	void Atoms(int argc,const t_atom *argv);
+	void Atoms(const AtomList &l) { Atoms(l.Count(),l.Atoms()); }
+	// frame a record, from the operation to the checksum
+	void Begin(int op,const AtomList &d);
+	void End();
+
+	static void Tick(void *data);
+
+	FILE *file;
+	std::string name;
+	// records not written yet, start of the last one
+	std::string buf;
+	size_t rec;
+	Timer tmr;
+};
+
+
+// a pool saved to a folder, with a file per top-level directory (or group of them) and a manifest listing the files
+// saving to the same folder again only rewrites the files of changed directories
+class poolshards:
+	public flext
+{
+public:
+	// groups: number of files the directories are distributed to, 0 for a file per directory
+	poolshards(const char *d,int g = 0): dir(d),groups(g) {}
+
+	const char *Name() const { return dir.c_str(); }
+	int Groups() const { return groups; }
+
+	// write the files of directories changed since the last save (all if full)
+	bool Save(pooldir *root,bool full);
+	// load all files into the root of p
+	bool Load(pooldata *p);
+
+protected:
+	// file name -> number of directories in it
+	typedef std::map<std::string,int> manifest;
+
+	std::string Path(const std::string &f) const { return dir+'/'+f; }
+	bool Read(manifest &m,int &groups) const;
+	bool Write(const manifest &m) const;
+
+	std::string dir;
+	int groups;
+};
+
+
+// directory trees of text and XML files, shared by all pools in the process
+// a file is parsed into the cache when it is loaded the second time unchanged (same modification time and size),
+// later loads copy the tree instead of reading and parsing the file again
+class poolcache
+{
+public:
+	// tree of file flnm, NULL if it must be parsed (into a new tree for Put, if build is set)
+	static pooldir *Get(const char *flnm,bool xml,bool &build);
+	// is the tree of flnm there?
+	static bool Has(const char *flnm,bool xml);
+	// keep tree t parsed from size bytes of flnm, after Get has asked for it
+	static void Put(const char *flnm,bool xml,pooldir *t,size_t size);
+	// forget file flnm (when it gets written)
+	static void Drop(const char *flnm);
+	// modification time of a file in ns (as far as the system has it)
+	static long long MTime(const struct stat &st);
+};
+
+
+// a text or XML file reloaded when it changes, only applying the differences to its previously loaded version
+class poolwatch:
+	public flext
+{
+public:
+	poolwatch();
+	~poolwatch();
+
+	// load the file into the root of p and watch it, returns the number of changes or -1
+	int Open(const char *flnm,pooldata *p);
+	// has the file been written? (called periodically)
+	bool Changed();
+	// load the file again, returns the number of values and directories set or cleared in p, or -1
+	int Reload(pooldata *p);
+
+	const char *Name() const { return name.c_str(); }
+
+protected:
+	void Close();
+	// make p's directory path look like n, given that it looked like o (or was not loaded, if o is NULL)
+	static int Diff(pooldata *p,Atoms &path,pooldir *o,pooldir *n);
+
+	std::string name,base;
+	// contents at the last load
+	pooldir *tree;
+	// state of the file at the last load, mtime in ns
+	long long mtime,size;
+	// inotify instance watching the folder of the file
+	int fd;
 };
 
 
@@ -124,99 +682,192 @@ public:
 	void Push() { ++refs; }
 	bool Pop() { return --refs > 0; }
 
-    void Reset() { root.Reset(); }
+    void Reset() 
+    { 
+        if(journal) journal->Reset();
+        root.Reset(); 
+        if(image) { delete image; image = NULL; }
+    }
+
+    // log all changes to a journal file (after replaying it), see pooljournal
+    bool OpenJournal(const char *flnm);
+    void CloseJournal();
+    // fold the journal into a snapshot
+    bool Compact() { return journal && journal->Compact(this); }
+    pooljournal *Journal() const { return journal; }
+
+    // serve data read-only from a pool image (until reset)
+    bool Open(const char *flnm);
+    bool ReadOnly() const { return image != NULL; }
+    bool SvImage(const char *flnm);
+
+    // save to/load from a folder of files, see poolshards
+    bool SvShards(const char *flnm,int groups = 0);
+    bool LdShards(const char *flnm);
+
+    // is the file in the cache of parsed files? see poolcache
+    bool Cached(const char *flnm,bool xml) const;
 
     bool MkDir(const AtomList &d,int vcnt = 0,int dcnt = 0) 
     { 
+        if(image) return false;
+        if(journal) journal->MkDir(d,vcnt,dcnt);
         root.AddDir(d,vcnt,dcnt); 
         return true; 
     }
 
     bool ChkDir(const AtomList &d) 
     { 
-        return root.GetDir(d) != NULL; 
+        return image?image->Dir(d) != 0:root.GetDir(d) != NULL; 
     }
 
     bool RmDir(const AtomList &d) 
     { 
+        if(image) return false;
+        if(journal) journal->RmDir(d);
         return root.DelDir(d); 
     }
 
-    bool Set(const AtomList &d,const t_atom &key,AtomList *data,bool over = true)
+    bool Set(const AtomList &d,const poolkey &key,AtomList *data,bool over = true)
     {
-	    pooldir *pd = root.GetDir(d);
+	    pooldir *pd = WrDir(d);
 	    if(!pd) return false;
+	    if(journal) journal->Set(d,key,data,over);
 	    pd->SetVal(key,data,over);
 	    return true;
     }
 
-    bool Seti(const AtomList &d,int ix,AtomList *data)
+    bool SetMode(const AtomList &d,const AtomList &m)
     {
+	    pooldir *pd = WrDir(d);
+	    if(!pd) return false;
+	    if(journal) journal->SetMode(d,m);
+	    return pd->SetMode(m);
+    }
+
+    bool GetMode(const AtomList &d,AtomList &m)
+    {
+        if(image) {
+            size_t id = image->Dir(d);
+            if(id) image->GetMode(id,m);
+            return id != 0;
+        }
 	    pooldir *pd = root.GetDir(d);
 	    if(!pd) return false;
-	    pd->SetVali(ix,data);
+	    pd->GetMode(m);
 	    return true;
     }
 
-	bool Clr(const AtomList &d,const t_atom &key)
+    bool PushVal(const AtomList &d,AtomList *data)
+    {
+	    pooldir *pd = WrDir(d);
+	    if(!pd) return false;
+	    if(journal) journal->Push(d,data);
+	    return pd->PushVal(data);
+    }
+
+	poolval *PopVal(const AtomList &d)
+    {
+	    pooldir *pd = WrDir(d);
+	    if(!pd) return NULL;
+	    if(journal) journal->Pop(d);
+	    return pd->PopVal();
+    }
+
+	poolval *RefAt(const AtomList &d,double t)
     {
+        // not looked up in images
+        if(image) return NULL;
 	    pooldir *pd = root.GetDir(d);
+	    return pd?pd->RefAt(t):NULL;
+    }
+
+	// values within [t0,t1], -1 if the directory doesn't exist (or an image is served)
+	int GetRange(const AtomList &d,double t0,double t1,Atoms *&keys,Atoms *&lst);
+
+    bool Seti(const AtomList &d,int ix,AtomList *data)
+    {
+	    pooldir *pd = WrDir(d);
+	    if(!pd) return false;
+	    if(journal) journal->Seti(d,ix,data);
+	    pd->SetVali(ix,data);
+	    return true;
+    }
+
+	bool Clr(const AtomList &d,const poolkey &key)
+    {
+	    pooldir *pd = WrDir(d);
 	    if(!pd) return false;
+	    if(journal) journal->Clr(d,key);
 	    pd->ClrVal(key);
 	    return true;
     }
 
 	bool Clri(const AtomList &d,int ix)
     {
-	    pooldir *pd = root.GetDir(d);
+	    pooldir *pd = WrDir(d);
 	    if(!pd) return false;
+	    if(journal) journal->Clri(d,ix);
 	    pd->ClrVali(ix);
 	    return true;
     }
 
 	bool ClrAll(const AtomList &d,bool rec,bool dironly = false)
     {
-	    pooldir *pd = root.GetDir(d);
+	    pooldir *pd = WrDir(d);
 	    if(!pd) return false;
+	    if(journal) journal->ClrAll(d,rec,dironly);
 	    pd->Clear(rec,dironly);
 	    return true;
     }
 
-	AtomList *Peek(const AtomList &d,const t_atom &key)
+	AtomList *Peek(const AtomList &d,const poolkey &key)
     {
+        if(image) {
+            poolval *r = Ref(d,key);
+            return r?r->data:NULL;
+        }
 	    pooldir *pd = root.GetDir(d);
 	    return pd?pd->PeekVal(key):NULL;
     }
 
-	AtomList *Get(const AtomList &d,const t_atom &key)
+	AtomList *Get(const AtomList &d,const poolkey &key)
     {
+        if(image) {
+            poolval *r = Ref(d,key);
+            return r?new Atoms(*r->data):NULL;
+        }
 	    pooldir *pd = root.GetDir(d);
 	    return pd?pd->GetVal(key):NULL;
     }
 
-	poolval *Ref(const AtomList &d,const t_atom &key)
+	poolval *Ref(const AtomList &d,const poolkey &key)
     {
+        if(image) return image->Ref(image->Dir(d),key);
 	    pooldir *pd = root.GetDir(d);
 	    return pd?pd->RefVal(key):NULL;
     }
 
 	poolval *Refi(const AtomList &d,int ix)
     {
+        if(image) return image->Refi(image->Dir(d),ix);
 	    pooldir *pd = root.GetDir(d);
 	    return pd?pd->RefVali(ix):NULL;
     }
 
 	int CntAll(const AtomList &d)
     {
+        if(image) return image->CntAll(image->Dir(d));
 	    pooldir *pd = root.GetDir(d);
 	    return pd?pd->CntAll():0;
     }
 
 	int PrintAll(const AtomList &d);
-	int GetAll(const AtomList &d,t_atom *&keys,Atoms *&lst);
+	int GetAll(const AtomList &d,Atoms *&keys,Atoms *&lst);
 
     int CntSub(const AtomList &d)
     {
+        if(image) return image->CntSub(image->Dir(d));
 	    pooldir *pd = root.GetDir(d);
 	    return pd?pd->CntSub():0;
     }
@@ -224,17 +875,34 @@ public:
 	int GetSub(const AtomList &d,const t_atom **&dirs);
 
 	bool Paste(const AtomList &d,const pooldir *clip,int depth = -1,bool repl = true,bool mkdir = true);
-	pooldir *Copy(const AtomList &d,const t_atom &key,bool cut);
+	pooldir *Copy(const AtomList &d,const poolkey &key,bool cut);
 	pooldir *CopyAll(const AtomList &d,int depth,bool cut);
 
-	bool LdDir(const AtomList &d,const char *flnm,int depth,bool mkdir = true);
+	// private pool with a copy of directory d (and the path to it), e.g. for saving in the background
+	pooldata *Snapshot(const AtomList &d,int depth);
+
+	bool LdDir(const AtomList &d,const char *flnm,int depth,bool mkdir = true,const poolfilter *flt = NULL);
+	// load several text files, parsed concurrently and stored in the given order
+	bool LdDirs(const AtomList &d,const std::vector<std::string> &flnms,int depth,bool mkdir = true);
 	bool SvDir(const AtomList &d,const char *flnm,int depth,bool absdir);
+	// forget the parsed tree of a file about to be written (main thread, before saving)
+	void Written(const char *flnm);
+	// start an incremental load of a text file, see poolloader
+	poolloader *LdAsync(const AtomList &d,const char *flnm,int depth,bool mkdir = true,const poolfilter *flt = NULL);
 	bool Load(const char *flnm) { AtomList l; return LdDir(l,flnm,-1); }
-	bool Save(const char *flnm) { AtomList l; return SvDir(l,flnm,-1,true); }
-	bool LdDirXML(const AtomList &d,const char *flnm,int depth,bool mkdir = true);
+	bool Save(const char *flnm) { AtomList l; Written(flnm); return SvDir(l,flnm,-1,true); }
+	bool LdDirXML(const AtomList &d,const char *flnm,int depth,bool mkdir = true,const poolfilter *flt = NULL);
 	bool SvDirXML(const AtomList &d,const char *flnm,int depth,bool absdir);
 	bool LoadXML(const char *flnm) { AtomList l; return LdDirXML(l,flnm,-1); }
-	bool SaveXML(const char *flnm) { AtomList l; return SvDirXML(l,flnm,-1,true); }
+	bool SaveXML(const char *flnm) { AtomList l; Written(flnm); return SvDirXML(l,flnm,-1,true); }
+	bool LdDirBin(const AtomList &d,const char *flnm,int depth,bool mkdir = true);
+	bool SvDirBin(const AtomList &d,const char *flnm,int depth,bool absdir);
+	bool LoadBin(const char *flnm) { AtomList l; return LdDirBin(l,flnm,-1); }
+	bool SaveBin(const char *flnm) { AtomList l; return SvDirBin(l,flnm,-1,true); }
+	bool LdDirJSON(const AtomList &d,const char *flnm,int depth,bool mkdir = true);
+	bool SvDirJSON(const AtomList &d,const char *flnm,int depth,bool absdir);
+	bool LdDirCSV(const AtomList &d,const char *flnm,int keycol,int keycols,char delim);
+	bool SvDirCSV(const AtomList &d,const char *flnm,char delim);
 
 	int refs;
 	const t_symbol *sym;
@@ -242,7 +910,19 @@ public:
 
 	pooldir root;
 
+	// directory for modification, none for images
+	pooldir *WrDir(const AtomList &d) { return image?NULL:root.GetDir(d); }
+
 private:
+	// directory for saving, a temporary copy for images
+	pooldir *SvBegin(const AtomList &d,int depth) { return image?CopyAll(d,depth,false):root.GetDir(d); }
+	void SvEnd(pooldir *pd) { if(image && pd) delete pd; }
+
+	poolimage *image;
+	pooljournal *journal;
+	// folder of the last saved shards, changes are tracked from there
+	poolshards *shards;
+
 	static const t_atom nullatom;
 };
 
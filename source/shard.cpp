@@ -0,0 +1,242 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fstream>
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef POOL_THREADS
+#include <atomic>
+#endif
+
+#if FLEXT_OS == FLEXT_OS_WIN
+#include <windows.h>
+#include <direct.h>
+#endif
+
+using namespace std;
+
+
+/* shard folder layout
+
+   shards.txt:  "pool shards <groups>", then a line "<file> <number of directories>" per file
+   root.txt:    values of the root directory (text format)
+   d<hash>.txt: top-level directories (with their subdirectories, text format),
+                the hash of the directory name determines the file
+   g<n>.txt:    the same, in a given number of groups (n is the hash modulo groups)
+
+   Files are written under a temporary name and renamed when complete,
+   the manifest last, so that an interrupted save leaves complete files.
+   Files are written and read concurrently.
+*/
+
+static const char *shmanifest = "shards.txt";
+static const char *shroot = "root.txt";
+
+// file for a top-level directory, stable across sessions
+static string ShardName(const t_atom &d,int groups)
+{
+	char tmp[1024];
+	flext::PrintAtom(d,tmp,sizeof tmp);
+
+	// 64 bit FNV-1a of the type and the printed name
+	unsigned long long h = 14695981039346656037ULL;
+	h = (h^(flext::IsSymbol(d)?'s':'n'))*1099511628211ULL;
+	for(const char *c = tmp; *c; ++c) h = (h^(unsigned char)*c)*1099511628211ULL;
+
+	char nm[32];
+	if(groups > 0)
+		sprintf(nm,"g%04u.txt",(unsigned int)(h%groups));
+	else
+		sprintf(nm,"d%08x%08x.txt",(unsigned int)(h>>32),(unsigned int)h);
+	return nm;
+}
+
+// replace file dst by src in one step
+static bool Replace(const string &src,const string &dst)
+{
+#if FLEXT_OS == FLEXT_OS_WIN
+	return MoveFileEx(src.c_str(),dst.c_str(),MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return !rename(src.c_str(),dst.c_str());
+#endif
+}
+
+static bool MkFolder(const char *dir)
+{
+	struct stat st;
+	if(!stat(dir,&st)) return (st.st_mode&S_IFDIR) != 0;
+#if FLEXT_OS == FLEXT_OS_WIN
+	return !_mkdir(dir);
+#else
+	return !mkdir(dir,0777);
+#endif
+}
+
+bool poolshards::Read(manifest &m,int &grp) const
+{
+	ifstream file(Path(shmanifest).c_str());
+	string ln;
+	if(!getline(file,ln) || ln.compare(0,12,"pool shards ")) return false;
+	grp = atoi(ln.c_str()+12);
+
+	while(getline(file,ln)) {
+		if(ln.empty()) continue;
+		size_t sp = ln.rfind(' ');
+		if(sp == string::npos || !sp) return false;
+		m[ln.substr(0,sp)] = atoi(ln.c_str()+sp+1);
+	}
+	return true;
+}
+
+bool poolshards::Write(const manifest &m) const
+{
+	string tmp = Path(shmanifest)+".tmp";
+	bool ok;
+	{
+		ofstream file(tmp.c_str());
+		file << "pool shards " << groups << endl;
+		for(manifest::const_iterator it = m.begin(); it != m.end(); ++it)
+			file << it->first << ' ' << it->second << endl;
+		ok = file.good();
+	}
+	ok = ok && Replace(tmp,Path(shmanifest));
+	if(!ok) remove(tmp.c_str());
+	return ok;
+}
+
+// a file to write: the root values or top-level directories
+struct poolshardjob
+{
+	string file;
+	vector<pooldir *> dirs;
+	bool root,ok;
+};
+
+static void SvShard(poolshardjob &j)
+{
+	string tmp = j.file+".tmp";
+	{
+		ofstream file(tmp.c_str());
+		j.ok = file.good();
+		if(j.root)
+			j.ok = j.ok && j.dirs[0]->SvDir(file,0);
+		else
+			for(size_t i = 0; j.ok && i < j.dirs.size(); ++i) {
+				Atoms path(1,&j.dirs[i]->Name());
+				j.ok = j.dirs[i]->SvDir(file,-1,path);
+			}
+	}
+	j.ok = j.ok && Replace(tmp,j.file);
+	if(!j.ok) remove(tmp.c_str());
+}
+
+#ifdef POOL_THREADS
+static void SvShards(vector<poolshardjob> *jobs,atomic<size_t> *next)
+{
+	// the directories are only read, each by one thread
+	for(size_t i; (i = (*next)++) < jobs->size(); ) SvShard((*jobs)[i]);
+}
+#endif
+
+bool poolshards::Save(pooldir *root,bool full)
+{
+	if(!MkFolder(dir.c_str())) return false;
+
+	// without the previous manifest it's unknown what the files hold
+	manifest old;
+	int ogrp;
+	if(!Read(old,ogrp)) {
+		old.clear();
+		full = true;
+	}
+	else if(ogrp != groups)
+		full = true;
+
+	// group top-level directories by file
+	typedef map<string,vector<pooldir *> > groupmap;
+	groupmap grp;
+	pooldir **subs;
+	int cnt = root->GetSub(subs);
+	for(int i = 0; i < cnt; ++i)
+		grp[ShardName(subs[i]->Name(),groups)].push_back(subs[i]);
+	delete[] subs;
+
+	manifest now;
+	vector<poolshardjob> jobs;
+	now[shroot] = 1;
+	if(full || root->Changed() || !old.count(shroot)) {
+		poolshardjob j;
+		j.file = Path(shroot);
+		j.dirs.push_back(root);
+		j.root = true;
+		jobs.push_back(j);
+	}
+
+	for(groupmap::iterator it = grp.begin(); it != grp.end(); ++it) {
+		const vector<pooldir *> &ds = it->second;
+		int n = (int)ds.size();
+		now[it->first] = n;
+
+		// directories added or removed, or changes within them
+		manifest::iterator o = old.find(it->first);
+		bool wr = full || o == old.end() || o->second != n;
+		for(int i = 0; !wr && i < n; ++i) wr = ds[i]->Dirty();
+		if(wr) {
+			poolshardjob j;
+			j.file = Path(it->first);
+			j.dirs = ds;
+			j.root = false;
+			jobs.push_back(j);
+		}
+	}
+
+	size_t done = 0;
+#ifdef POOL_THREADS
+	int thrs = (int)thread::hardware_concurrency();
+	if(thrs > (int)jobs.size()) thrs = (int)jobs.size();
+	if(thrs > 1) {
+		atomic<size_t> next(0);
+		vector<thread> th;
+		for(int i = 1; i < thrs; ++i) {
+			try { th.push_back(thread(SvShards,&jobs,&next)); }
+			catch(...) { break; }
+		}
+		SvShards(&jobs,&next);
+		for(size_t i = 0; i < th.size(); ++i) th[i].join();
+		done = jobs.size();
+	}
+#endif
+	for(; done < jobs.size(); ++done) SvShard(jobs[done]);
+
+	for(size_t i = 0; i < jobs.size(); ++i)
+		if(!jobs[i].ok) return false;
+	if((full || now != old) && !Write(now)) return false;
+
+	// files of directories which are gone
+	for(manifest::iterator it = old.begin(); it != old.end(); ++it)
+		if(!now.count(it->first)) remove(Path(it->first).c_str());
+	return true;
+}
+
+bool poolshards::Load(pooldata *p)
+{
+	manifest m;
+	int grp;
+	if(!Read(m,grp)) return false;
+	groups = grp;
+
+	vector<string> files;
+	for(manifest::iterator it = m.begin(); it != m.end(); ++it)
+		files.push_back(Path(it->first));
+	return p->LdDirs(AtomList(),files,-1);
+}
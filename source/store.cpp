@@ -0,0 +1,1365 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+
+static const t_atom nokey = { A_NULL };
+
+static bool keyless(const poolval *a,const poolval *b) { return flext::GetAFloat(a->key) < flext::GetAFloat(b->key); }
+
+const t_symbol *poolstore::sym_hash,*poolstore::sym_array,*poolstore::sym_fifo,*poolstore::sym_series;
+
+void poolstore::Setup()
+{
+	sym_hash = MakeSymbol("hash");
+	sym_array = MakeSymbol("array");
+	sym_fifo = MakeSymbol("fifo");
+	sym_series = MakeSymbol("series");
+}
+
+poolval *poolstore::RefAt(double t)
+{
+	poolval *r = NULL;
+	for(poolval *ix = Next(NULL); ix; ix = Next(ix)) {
+		if(ix->kcnt != 1 || !CanbeFloat(ix->key)) continue;
+		double k = GetAFloat(ix->key);
+		if(k <= t && (!r || GetAFloat(r->key) < k)) r = ix;
+	}
+	return r;
+}
+
+int poolstore::GetRange(double t0,double t1,Atoms *&keys,Atoms *&lst)
+{
+	vector<poolval *> sel;
+	for(poolval *ix = Next(NULL); ix; ix = Next(ix)) {
+		if(ix->kcnt != 1 || !CanbeFloat(ix->key)) continue;
+		double k = GetAFloat(ix->key);
+		if(k >= t0 && k <= t1) sel.push_back(ix);
+	}
+	sort(sel.begin(),sel.end(),keyless);
+
+	int cnt = (int)sel.size();
+	keys = new Atoms[cnt];
+	lst = new Atoms[cnt];
+	for(int i = 0; i < cnt; ++i) {
+		keys[i](1,&sel[i]->key);
+		lst[i] = *sel[i]->data;
+	}
+	return cnt;
+}
+
+
+
+/* hashed storage with sorted chains (default mode)
+
+   While all keys are small non-negative integers, the values are held in a 
+   plain array indexed by key instead. This happens automatically once a few values 
+   are present, or right from the start in "array" mode.
+   Other keys or too sparse a population revert to hashing.
+   The mode is reported as "array" only while a requested array is actually in use.
+
+   The bucket table is only allocated with the first hashed value, and it has
+   a single bucket (one sorted chain) until there are more than POOL_SMALLCNT values.
+*/
+
+class poolhash:
+	public poolstore
+{
+public:
+	poolhash(int bits,bool array = false);
+	~poolhash();
+
+	virtual int Mode() const { return array && arr?mode_array:mode_hash; }
+	virtual void GetMode(AtomList &m) const { m(1); SetSymbol(m[0],Mode() == mode_array?sym_array:sym_hash); }
+
+	virtual int Count() const { return cnt; }
+
+	virtual poolval *Ref(const poolkey &key);
+	virtual poolval *Refi(int ix);
+	virtual void Set(const poolkey &key,AtomList *data,bool over);
+	virtual bool Seti(int ix,AtomList *data);
+	virtual poolval *Cut(const poolkey &key);
+	virtual poolval *Cuti(int ix);
+	virtual void Clear();
+	virtual poolval *Next(const poolval *v) const;
+	virtual void Reserve(int n);
+
+protected:
+	// minimum number of values for automatic switching to the array, minimum array size
+	enum { autoarray = 8,minslots = 16 };
+
+	int VIdx(const poolkey &k) const { return pooldir::FoldBits(KeyHash(k),tbits); }
+	int TSize() const { return vals?1<<tbits:0; }
+
+	// array slot for a key, -1 if it's not a small non-negative integer
+	static int Slot(const poolkey &k);
+	// would using slot s keep the array populated densely enough?
+	bool Dense(int s) const { return s < minslots || s < (cnt+1)*2; }
+	// slot of the value at index ix
+	int SlotAt(int ix) const;
+
+	void ToArray();
+	void ToHash();
+	void Grow(int n);
+	void Trim() { while(aused && !arr[aused-1]) --aused; }
+
+	// (re)allocate bucket table
+	void Rehash(int bits);
+	// insert into sorted chain
+	void Link(poolval *v);
+	// find value by index, also returning the bucket and the predecessor
+	poolval *Find(int ix,int &vix,poolval *&prv) const;
+	void Unlink(int vix,poolval *prv,poolval *v);
+
+	struct valentry { int cnt; poolval *v; };
+
+	const int vbits;
+	const bool array;
+	int cnt;
+	// bucket table (NULL if not needed), with current size
+	valentry *vals;
+	int tbits;
+
+	// array representation (NULL while hashed), with allocated and used size
+	poolval **arr;
+	int asize,aused;
+	// hashed values with array-compatible keys, upper bound of their slots
+	int nslot,maxslot;
+};
+
+poolhash::poolhash(int bits,bool a):
+	vbits(bits),array(a),cnt(0),
+	vals(NULL),tbits(0),
+	arr(NULL),asize(0),aused(0),
+	nslot(0),maxslot(0)
+{
+	if(array) Grow(minslots);
+}
+
+poolhash::~poolhash()
+{
+	Clear();
+	if(arr) delete[] arr;
+}
+
+int poolhash::Slot(const poolkey &k)
+{
+	if(!k.Single() || !CanbeInt(k[0])) return -1;
+	int s = GetAInt(k[0]);
+	// reject non-integral floats
+	if(IsFloat(k[0]) && GetFloat(k[0]) != s) return -1;
+	return s >= 0?s:-1;
+}
+
+void poolhash::Clear()
+{
+	if(arr) {
+		for(int s = 0; s < aused; ++s)
+			if(arr[s]) { delete arr[s]; arr[s] = NULL; }
+		aused = 0;
+		if(!array) { delete[] arr; arr = NULL; asize = 0; }
+	}
+
+	for(int i = 0; i < TSize(); ++i) {
+		poolval *v = vals[i].v,*v1;
+		for(; v; v = v1) {
+			v1 = v->nxt;
+			v->nxt = NULL;
+			delete v;
+		}
+	}
+	if(vals) { delete[] vals; vals = NULL; }
+	tbits = 0;
+	cnt = nslot = maxslot = 0;
+
+	// a requested array starts out empty again
+	if(array && !arr) Grow(minslots);
+}
+
+void poolhash::Grow(int n)
+{
+	int sz = asize?asize:minslots;
+	while(sz < n) sz *= 2;
+	if(sz == asize) return;
+
+	poolval **narr = new poolval *[sz];
+	if(aused) memcpy(narr,arr,aused*sizeof *arr);
+	ZeroMem(narr+aused,(sz-aused)*sizeof *arr);
+	if(arr) delete[] arr;
+	arr = narr;
+	asize = sz;
+}
+
+void poolhash::ToArray()
+{
+	FLEXT_ASSERT(!aused && nslot == cnt);
+	Grow(maxslot);
+	for(int i = 0; i < TSize(); ++i) {
+		poolval *v = vals[i].v,*v1;
+		for(; v; v = v1) {
+			v1 = v->nxt;
+			v->nxt = NULL;
+			int s = Slot(v->Key());
+			arr[s] = v;
+			if(s >= aused) aused = s+1;
+		}
+	}
+	if(vals) { delete[] vals; vals = NULL; }
+	tbits = 0;
+}
+
+void poolhash::ToHash()
+{
+	Rehash(cnt > POOL_SMALLCNT?vbits:0);
+	for(int s = 0; s < aused; ++s)
+		if(arr[s]) Link(arr[s]);
+	delete[] arr;
+	arr = NULL;
+	nslot = cnt,maxslot = aused;
+	asize = aused = 0;
+}
+
+int poolhash::SlotAt(int ix) const
+{
+	if(ix < 0 || ix >= cnt) return -1;
+	// without gaps the index is the slot
+	if(cnt == aused) return ix;
+	for(int s = 0; s < aused; ++s)
+		if(arr[s] && !ix--) return s;
+	return -1;
+}
+
+void poolhash::Rehash(int bits)
+{
+	valentry *ovals = vals;
+	int osize = TSize();
+
+	tbits = bits;
+	vals = new valentry[1<<bits];
+	ZeroMem(vals,(1<<bits)*sizeof *vals);
+
+	for(int i = 0; i < osize; ++i) {
+		poolval *v = ovals[i].v,*v1;
+		for(; v; v = v1) {
+			v1 = v->nxt;
+			Link(v);
+		}
+	}
+	if(ovals) delete[] ovals;
+}
+
+void poolhash::Reserve(int n)
+{
+	// the table may grow beyond the configured size here, 
+	// as bulk insertion would otherwise degrade into long chains
+	if(!arr && n > POOL_SMALLCNT && pooldir::Int2Bits(n) > tbits)
+		Rehash(pooldir::Int2Bits(n));
+}
+
+void poolhash::Link(poolval *v)
+{
+	poolkey key = v->Key();
+	int vix = VIdx(key);
+	poolval *prv = NULL,*ix = vals[vix].v;
+	for(; ix && compare(key,ix->Key()) > 0; prv = ix,ix = ix->nxt) {}
+
+	v->nxt = ix;
+	if(prv) prv->nxt = v;
+	else vals[vix].v = v;
+	vals[vix].cnt++;
+}
+
+void poolhash::Unlink(int vix,poolval *prv,poolval *v)
+{
+	if(prv) prv->nxt = v->nxt;
+	else vals[vix].v = v->nxt;
+	vals[vix].cnt--;
+	cnt--;
+	if(Slot(v->Key()) >= 0) nslot--;
+	v->nxt = NULL;
+}
+
+poolval *poolhash::Ref(const poolkey &key)
+{
+	if(arr) {
+		int s = Slot(key);
+		return s >= 0 && s < aused?arr[s]:NULL;
+	}
+
+	if(!vals) return NULL;
+
+	int c = 1,vix = VIdx(key);
+	poolval *ix = vals[vix].v;
+	for(; ix; ix = ix->nxt) {
+		c = compare(key,ix->Key());
+		if(c <= 0) break;
+	}
+
+	return c || !ix?NULL:ix;
+}
+
+poolval *poolhash::Find(int rix,int &vix,poolval *&prv) const
+{
+	prv = NULL;
+	for(vix = 0; vix < TSize(); ++vix)
+		if(rix >= vals[vix].cnt) rix -= vals[vix].cnt;
+		else {
+			poolval *ix = vals[vix].v;
+			for(; ix && rix; prv = ix,ix = ix->nxt) --rix;
+			return ix;
+		}
+	return NULL;
+}
+
+poolval *poolhash::Refi(int rix)
+{
+	if(arr) {
+		int s = SlotAt(rix);
+		return s >= 0?arr[s]:NULL;
+	}
+
+	int vix;
+	poolval *prv;
+	return Find(rix,vix,prv);
+}
+
+void poolhash::Set(const poolkey &key,AtomList *data,bool over)
+{
+	if(arr) {
+		int s = Slot(key);
+		if(s >= 0 && (s < aused || Dense(s))) {
+			if(s >= asize) Grow(s+1);
+			poolval *&v = arr[s];
+			if(!v) {
+				if(data) {
+					v = new poolval(key,data);
+					cnt++;
+					if(s >= aused) aused = s+1;
+				}
+			}
+			else if(over) {
+				if(data)
+					v->Set(data);
+				else {
+					delete v; v = NULL;
+					cnt--;
+					Trim();
+				}
+			}
+			else if(data)
+				delete data;
+			return;
+		}
+		else if(!data)
+			// key is not present
+			return;
+		else
+			// not suitable for the array any more
+			ToHash();
+	}
+
+	if(!vals) {
+		if(!data) return;
+		Rehash(0);
+	}
+
+    int c = 1,vix = VIdx(key);
+	poolval *prv = NULL,*ix = vals[vix].v;
+	for(; ix; prv = ix,ix = ix->nxt) {
+		c = compare(key,ix->Key());
+		if(c <= 0) break;
+	}
+
+	if(c || !ix) {
+		// no existing data found
+
+		if(data) {
+			poolval *nv = new poolval(key,data);
+			nv->nxt = ix;
+
+			if(prv) prv->nxt = nv;
+			else vals[vix].v = nv;
+			vals[vix].cnt++;
+			cnt++;
+
+			int s = Slot(key);
+			if(s >= 0) {
+				nslot++;
+				if(s >= maxslot) maxslot = s+1;
+			}
+
+			if((array || cnt >= autoarray) && nslot == cnt && maxslot <= cnt*2)
+				ToArray();
+			else if(tbits < vbits && cnt > POOL_SMALLCNT)
+				// outgrown the single chain
+				Rehash(vbits);
+		}
+	}
+	else if(over) {
+		// data exists... only set if overwriting enabled
+
+		if(data)
+			ix->Set(data);
+		else {
+			// delete key
+			Unlink(vix,prv,ix);
+			delete ix;
+		}
+	}
+	else if(data)
+		delete data;
+}
+
+bool poolhash::Seti(int rix,AtomList *data)
+{
+	if(arr) {
+		int s = SlotAt(rix);
+		if(s < 0) return false;
+		if(data)
+			arr[s]->Set(data);
+		else {
+			delete arr[s]; arr[s] = NULL;
+			cnt--;
+			Trim();
+		}
+		return true;
+	}
+
+	int vix;
+	poolval *prv,*ix = Find(rix,vix,prv);
+
+	if(ix) {
+		// data exists... overwrite it
+
+		if(data)
+			ix->Set(data);
+		else {
+			// delete key
+			Unlink(vix,prv,ix);
+			delete ix;
+		}
+        return true;
+	}
+    else
+        return false;
+}
+
+poolval *poolhash::Cut(const poolkey &key)
+{
+	if(arr) {
+		int s = Slot(key);
+		if(s < 0 || s >= aused || !arr[s]) return NULL;
+		poolval *v = arr[s];
+		arr[s] = NULL;
+		cnt--;
+		Trim();
+		return v;
+	}
+
+	if(!vals) return NULL;
+
+	int c = 1,vix = VIdx(key);
+	poolval *prv = NULL,*ix = vals[vix].v;
+	for(; ix; prv = ix,ix = ix->nxt) {
+		c = compare(key,ix->Key());
+		if(c <= 0) break;
+	}
+
+	if(c || !ix)
+		return NULL;
+	else {
+		Unlink(vix,prv,ix);
+		return ix;
+	}
+}
+
+poolval *poolhash::Cuti(int rix)
+{
+	if(arr) {
+		int s = SlotAt(rix);
+		if(s < 0) return NULL;
+		poolval *v = arr[s];
+		arr[s] = NULL;
+		cnt--;
+		Trim();
+		return v;
+	}
+
+	int vix;
+	poolval *prv,*ix = Find(rix,vix,prv);
+	if(ix) Unlink(vix,prv,ix);
+	return ix;
+}
+
+poolval *poolhash::Next(const poolval *v) const
+{
+	if(arr) {
+		for(int s = v?Slot(v->Key())+1:0; s < aused; ++s)
+			if(arr[s]) return arr[s];
+		return NULL;
+	}
+
+	int vix;
+	if(v) {
+		if(v->nxt) return v->nxt;
+		vix = VIdx(v->Key())+1;
+	}
+	else
+		vix = 0;
+
+	for(; vix < TSize(); ++vix)
+		if(vals[vix].v) return vals[vix].v;
+	return NULL;
+}
+
+
+/* ring buffer storage for queues
+
+   Keys are the positions relative to the oldest entry,
+   they are renewed whenever a value is handed out.
+   A non-zero maximum size lets the oldest entries drop out.
+*/
+
+class poolfifo:
+	public poolstore
+{
+public:
+	poolfifo(int max);
+	~poolfifo();
+
+	virtual int Mode() const { return mode_fifo; }
+	virtual void GetMode(AtomList &m) const;
+
+	virtual int Count() const { return cnt; }
+
+	virtual poolval *Ref(const poolkey &key) { int ix = Index(key); return ix >= 0?At(ix):NULL; }
+	virtual poolval *Refi(int ix) { return ix >= 0 && ix < cnt?At(ix):NULL; }
+	virtual void Set(const poolkey &key,AtomList *data,bool over);
+	virtual bool Seti(int ix,AtomList *data);
+	virtual poolval *Cut(const poolkey &key) { return Cuti(Index(key)); }
+	virtual poolval *Cuti(int ix);
+	virtual void Clear();
+	virtual poolval *Next(const poolval *v) const { return v?At(GetInt(v->key)+1):At(0); }
+	virtual bool Push(AtomList *data);
+
+protected:
+	int Index(const poolkey &key) const;
+
+	// value at position, with refreshed key
+	poolval *At(int ix) const
+	{
+		if(ix >= cnt) return NULL;
+		poolval *v = ring[(head+ix)&(size-1)];
+		SetInt(v->key,ix);
+		return v;
+	}
+
+	poolval *&Slot(int ix) const { return ring[(head+ix)&(size-1)]; }
+
+	poolval **ring;
+	int size,head,cnt;
+	const int max;
+};
+
+poolfifo::poolfifo(int m):
+	ring(NULL),size(0),head(0),cnt(0),max(m)
+{}
+
+poolfifo::~poolfifo()
+{
+	Clear();
+	if(ring) delete[] ring;
+}
+
+void poolfifo::GetMode(AtomList &m) const
+{
+	m(max?2:1);
+	SetSymbol(m[0],sym_fifo);
+	if(max) SetInt(m[1],max);
+}
+
+int poolfifo::Index(const poolkey &key) const
+{
+	if(!key.Single() || !CanbeInt(key[0])) return -1;
+	int ix = GetAInt(key[0]);
+	// reject non-integral floats
+	if(IsFloat(key[0]) && GetFloat(key[0]) != ix) return -1;
+	return ix >= 0 && ix < cnt?ix:-1;
+}
+
+void poolfifo::Clear()
+{
+	for(int i = 0; i < cnt; ++i) {
+		poolval *&v = Slot(i);
+		delete v; v = NULL;
+	}
+	head = cnt = 0;
+}
+
+bool poolfifo::Push(AtomList *data)
+{
+	if(max && cnt >= max) {
+		// drop oldest entry
+		delete Cuti(0);
+	}
+
+	if(cnt == size) {
+		// grow ring, unwrapping the contents
+		int nsize = size?size*2:8;
+		poolval **nring = new poolval *[nsize];
+		for(int i = 0; i < cnt; ++i) nring[i] = Slot(i);
+		if(ring) delete[] ring;
+		ring = nring;
+		size = nsize;
+		head = 0;
+	}
+
+	t_atom k; SetInt(k,cnt);
+	Slot(cnt++) = new poolval(k,data);
+	return true;
+}
+
+void poolfifo::Set(const poolkey &key,AtomList *data,bool over)
+{
+	int ix = Index(key);
+	if(ix < 0) {
+		// the position just past the end appends (as when loading), other keys are no positions
+		if(key.Single() && CanbeInt(key[0]) && GetAFloat(key[0]) == cnt) {
+			if(data) Push(data);
+		}
+		else if(data) {
+			post("pool - fifo: key must be an index up to the count, value not stored");
+			delete data;
+		}
+	}
+	else if(over) {
+		if(data)
+			Slot(ix)->Set(data);
+		else
+			delete Cuti(ix);
+	}
+	else if(data)
+		delete data;
+}
+
+bool poolfifo::Seti(int ix,AtomList *data)
+{
+	if(ix < 0 || ix >= cnt) return false;
+
+	if(data)
+		Slot(ix)->Set(data);
+	else
+		delete Cuti(ix);
+	return true;
+}
+
+poolval *poolfifo::Cuti(int ix)
+{
+	if(ix < 0 || ix >= cnt) return NULL;
+
+	poolval *v = At(ix);
+	if(ix < cnt/2) {
+		// close the gap from the front
+		for(int i = ix; i > 0; --i) Slot(i) = Slot(i-1);
+		head = (head+1)&(size-1);
+	}
+	else {
+		// close the gap from the back
+		for(int i = ix; i < cnt-1; ++i) Slot(i) = Slot(i+1);
+	}
+	--cnt;
+	return v;
+}
+
+/* chunked storage for time series with increasing numeric keys
+
+   Each chunk holds a byte stream of delta-encoded keys and raw atom payloads.
+   Time lookups bisect the chunks by their first key and scan within one chunk.
+   If a thinning factor is given, sealed chunks older than the newest 'keep' ones 
+   only retain every factor-th value.
+   Values inserted out of order go into their chunk, which is split in two once it outgrows the chunk size.
+   Thinned chunks take no new values.
+   Iteration hands out values carrying their position, so that several iterations can run at once
+   (up to 'iterations', the least recently used one is taken over beyond).
+*/
+
+class poolseries:
+	public poolstore
+{
+public:
+	poolseries(int csize,int keep,int factor);
+	~poolseries();
+
+	virtual int Mode() const { return mode_series; }
+	virtual void GetMode(AtomList &m) const;
+
+	virtual int Count() const { return cnt; }
+
+	virtual poolval *Ref(const poolkey &key);
+	virtual poolval *Refi(int ix);
+	virtual void Set(const poolkey &key,AtomList *data,bool over);
+	virtual bool Seti(int ix,AtomList *data);
+	virtual poolval *Cut(const poolkey &key);
+	virtual poolval *Cuti(int ix);
+	virtual void Clear();
+	virtual poolval *Next(const poolval *v) const;
+
+	virtual poolval *RefAt(double t);
+	virtual int GetRange(double t0,double t1,Atoms *&keys,Atoms *&lst);
+
+	virtual int Chunks() const { return (int)chunks.size(); }
+	virtual void GetChunk(int ix,AtomList &l) const;
+	virtual bool AddChunk(const AtomList &l);
+
+protected:
+	struct chunk {
+		chunk(): first(0),last(0),cnt(0),level(0) {}
+		double first,last;
+		int cnt,level;
+		vector<unsigned char> bytes;
+	};
+
+	// decoded contents of a chunk
+	struct unpacked {
+		vector<double> keys;
+		vector<Atoms> vals;
+	};
+
+	static void Encode(chunk &c,double key,const AtomList &data);
+	static const unsigned char *Decode(const unsigned char *p,double &key,AtomList *data);
+
+	void Unpack(int ci,unpacked &u) const;
+	// replace chunk ci by the values u (none, one chunk or several of at most csize)
+	void Repack(int ci,const unpacked &u,int level);
+
+	void Append(double key,const AtomList &data);
+	void Thin(int ci);
+
+	// last chunk starting at or before t, -1 if none
+	int Find(double t) const;
+	// chunk holding the value at index ix, also returning the index within
+	int FindIx(int ix,int &cix) const;
+
+	static poolval *Out(poolval &v,double key,const AtomList *data);
+
+	// value handed out by Next, with the position after it
+	struct iterval:
+		public poolval
+	{
+		iterval(): poolval(nokey,NULL),ci(0),n(0),pos(0),k(0),gen(0),use(0) {}
+		// chunk, number of values read from it and their bytes, last key
+		int ci,n;
+		size_t pos;
+		double k;
+		// chunk layout the position refers to, last use
+		unsigned long gen,use;
+	};
+
+	enum { iterations = 4 };
+
+	// find the position after key it.k again
+	void Seek(iterval &it) const;
+
+	vector<chunk *> chunks;
+	int cnt;
+	const int csize,keep,factor;
+	// changed whenever chunks are replaced
+	unsigned long gen;
+
+	// scratch values handed out by lookups, one each so that they don't clobber each other
+	poolval ref,refat,refi;
+	mutable iterval its[iterations];
+	mutable unsigned long ituse;
+};
+
+static void PutVarint(vector<unsigned char> &b,unsigned long long v)
+{
+	while(v >= 0x80) {
+		b.push_back((unsigned char)(v|0x80));
+		v >>= 7;
+	}
+	b.push_back((unsigned char)v);
+}
+
+static unsigned long long GetVarint(const unsigned char *&p)
+{
+	unsigned long long v = 0;
+	for(int sh = 0; ; sh += 7) {
+		unsigned char c = *p++;
+		v |= (unsigned long long)(c&0x7f)<<sh;
+		if(!(c&0x80)) break;
+	}
+	return v;
+}
+
+static void PutRaw(vector<unsigned char> &b,const void *d,size_t n)
+{
+	const unsigned char *c = (const unsigned char *)d;
+	b.insert(b.end(),c,c+n);
+}
+
+enum { pack_float = 0,pack_symbol,pack_int };
+
+poolseries::poolseries(int cs,int k,int f):
+	cnt(0),csize(cs),keep(k),factor(f),gen(0),
+	ref(nokey,NULL),refat(nokey,NULL),refi(nokey,NULL),
+	ituse(0)
+{}
+
+poolseries::~poolseries()
+{
+	Clear();
+}
+
+void poolseries::GetMode(AtomList &m) const
+{
+	m(4);
+	SetSymbol(m[0],sym_series);
+	SetInt(m[1],csize);
+	SetInt(m[2],keep);
+	SetInt(m[3],factor);
+}
+
+void poolseries::Clear()
+{
+	for(size_t i = 0; i < chunks.size(); ++i) delete chunks[i];
+	chunks.clear();
+	cnt = 0;
+	++gen;
+}
+
+void poolseries::Encode(chunk &c,double key,const AtomList &data)
+{
+	if(!c.cnt) {
+		c.first = key;
+		PutVarint(c.bytes,0);
+	}
+	else {
+		double d = key-c.last;
+		FLEXT_ASSERT(d > 0);
+		if(key == floor(key) && d == floor(d) && d < 4503599627370496.) 
+			// integer step
+			PutVarint(c.bytes,(unsigned long long)d<<1);
+		else {
+			// escape and store full key
+			PutVarint(c.bytes,1);
+			PutRaw(c.bytes,&key,sizeof key);
+		}
+	}
+	c.last = key;
+	c.cnt++;
+
+	// values: count and flag for mixed types, then payloads
+	int n = data.Count();
+	bool mixed = false;
+	for(int i = 0; i < n; ++i)
+		if(!IsFloat(data[i])) { mixed = true; break; }
+
+	PutVarint(c.bytes,((unsigned long long)n<<1)|(mixed?1:0));
+	for(int i = 0; i < n; ++i) {
+		const t_atom &a = data[i];
+		if(IsFloat(a)) {
+			if(mixed) c.bytes.push_back(pack_float);
+			t_float f = GetFloat(a);
+			PutRaw(c.bytes,&f,sizeof f);
+		}
+		else if(IsSymbol(a)) {
+			// symbols are never freed, the pointer can be kept (pool-owned strings are not counted here)
+			c.bytes.push_back(pack_symbol);
+			const t_symbol *s = poolstrings::Real(GetSymbol(a));
+			PutRaw(c.bytes,&s,sizeof s);
+		}
+		else {
+			c.bytes.push_back(pack_int);
+			int v = GetAInt(a);
+			PutRaw(c.bytes,&v,sizeof v);
+		}
+	}
+}
+
+const unsigned char *poolseries::Decode(const unsigned char *p,double &key,AtomList *data)
+{
+	unsigned long long k = GetVarint(p);
+	if(k&1) {
+		memcpy(&key,p,sizeof key);
+		p += sizeof key;
+	}
+	else
+		key += (double)(k>>1);
+
+	unsigned long long h = GetVarint(p);
+	int n = (int)(h>>1);
+	bool mixed = (h&1) != 0;
+
+	if(data) (*data)(n);
+	for(int i = 0; i < n; ++i) {
+		int tp = mixed?*p++:pack_float;
+		switch(tp) {
+		case pack_float: {
+			t_float f;
+			memcpy(&f,p,sizeof f); p += sizeof f;
+			if(data) SetFloat((*data)[i],f);
+			break;
+		}
+		case pack_symbol: {
+			const t_symbol *s;
+			memcpy(&s,p,sizeof s); p += sizeof s;
+			if(data) SetSymbol((*data)[i],s);
+			break;
+		}
+		default: {
+			int v;
+			memcpy(&v,p,sizeof v); p += sizeof v;
+			if(data) SetInt((*data)[i],v);
+		}
+		}
+	}
+	return p;
+}
+
+void poolseries::Unpack(int ci,unpacked &u) const
+{
+	const chunk &c = *chunks[ci];
+	u.keys.resize(c.cnt);
+	u.vals.resize(c.cnt);
+	const unsigned char *p = &c.bytes[0];
+	double key = c.first;
+	for(int i = 0; i < c.cnt; ++i) {
+		p = Decode(p,key,&u.vals[i]);
+		u.keys[i] = key;
+	}
+}
+
+void poolseries::Repack(int ci,const unpacked &u,int level)
+{
+	cnt -= chunks[ci]->cnt;
+	delete chunks[ci];
+	chunks.erase(chunks.begin()+ci);
+
+	// split evenly, so that there's room for more inserts
+	size_t n = u.keys.size(),pieces = (n+csize-1)/csize;
+	for(size_t pc = 0; pc < pieces; ++pc) {
+		chunk *nc = new chunk;
+		nc->level = level;
+		for(size_t i = n*pc/pieces; i < n*(pc+1)/pieces; ++i) 
+			Encode(*nc,u.keys[i],u.vals[i]);
+		cnt += nc->cnt;
+		chunks.insert(chunks.begin()+ci+pc,nc);
+	}
+	++gen;
+}
+
+void poolseries::Thin(int ci)
+{
+	unpacked u,t;
+	Unpack(ci,u);
+	for(size_t i = 0; i < u.keys.size(); i += factor) {
+		t.keys.push_back(u.keys[i]);
+		t.vals.push_back(u.vals[i]);
+	}
+	Repack(ci,t,chunks[ci]->level+1);
+}
+
+void poolseries::Append(double key,const AtomList &data)
+{
+	if(chunks.empty() || chunks.back()->cnt >= csize) {
+		if(factor > 1) {
+			// thin out the chunks leaving the full-resolution window (more than one after splits)
+			for(int ci = (int)chunks.size()-1-keep; ci >= 0 && !chunks[ci]->level; --ci) Thin(ci);
+		}
+		chunks.push_back(new chunk);
+	}
+
+	Encode(*chunks.back(),key,data);
+	++cnt;
+}
+
+int poolseries::Find(double t) const
+{
+	int lo = 0,hi = (int)chunks.size();
+	while(lo < hi) {
+		int mid = (lo+hi)/2;
+		if(chunks[mid]->first <= t) lo = mid+1;
+		else hi = mid;
+	}
+	return lo-1;
+}
+
+int poolseries::FindIx(int ix,int &cix) const
+{
+	if(ix < 0 || ix >= cnt) return -1;
+	for(size_t ci = 0; ci < chunks.size(); ++ci) {
+		if(ix < chunks[ci]->cnt) {
+			cix = ix;
+			return (int)ci;
+		}
+		ix -= chunks[ci]->cnt;
+	}
+	return -1;
+}
+
+poolval *poolseries::Out(poolval &v,double key,const AtomList *data)
+{
+	SetFloat(v.key,(t_float)key);
+	if(!v.data) v.data = new Atoms;
+	*v.data = *data;
+	return &v;
+}
+
+poolval *poolseries::Ref(const poolkey &key)
+{
+	if(!key.Single() || !CanbeFloat(key[0])) return NULL;
+	double t = GetAFloat(key[0]);
+	int ci = Find(t);
+	if(ci < 0 || t > chunks[ci]->last) return NULL;
+
+	const chunk &c = *chunks[ci];
+	const unsigned char *p = &c.bytes[0];
+	double k = c.first;
+	Atoms d;
+	for(int i = 0; i < c.cnt; ++i) {
+		p = Decode(p,k,&d);
+		if(k == t) return Out(ref,k,&d);
+		if(k > t) break;
+	}
+	return NULL;
+}
+
+poolval *poolseries::RefAt(double t)
+{
+	int ci = Find(t);
+	if(ci < 0) return NULL;
+
+	const chunk &c = *chunks[ci];
+	const unsigned char *p = &c.bytes[0];
+	double k = c.first,kt = k;
+	Atoms d,dt;
+	for(int i = 0; i < c.cnt; ++i) {
+		p = Decode(p,k,&d);
+		if(k > t) break;
+		kt = k; dt = d;
+	}
+	return Out(refat,kt,&dt);
+}
+
+int poolseries::GetRange(double t0,double t1,Atoms *&keys,Atoms *&lst)
+{
+	int c0 = Find(t0);
+	if(c0 < 0) c0 = 0;
+
+	unpacked u;
+	for(int ci = c0; ci < (int)chunks.size() && chunks[ci]->first <= t1; ++ci) {
+		const chunk &c = *chunks[ci];
+		if(c.last < t0) continue;
+
+		const unsigned char *p = &c.bytes[0];
+		double k = c.first;
+		Atoms d;
+		for(int i = 0; i < c.cnt; ++i) {
+			p = Decode(p,k,&d);
+			if(k > t1) break;
+			if(k >= t0) {
+				u.keys.push_back(k);
+				u.vals.push_back(d);
+			}
+		}
+	}
+
+	int n = (int)u.keys.size();
+	keys = new Atoms[n];
+	lst = new Atoms[n];
+	for(int i = 0; i < n; ++i) {
+		keys[i](1);
+		SetFloat(keys[i][0],(t_float)u.keys[i]);
+		lst[i] = u.vals[i];
+	}
+	return n;
+}
+
+poolval *poolseries::Refi(int ix)
+{
+	int cix,ci = FindIx(ix,cix);
+	if(ci < 0) return NULL;
+
+	const chunk &c = *chunks[ci];
+	const unsigned char *p = &c.bytes[0];
+	double k = c.first;
+	for(int i = 0; i < cix; ++i) p = Decode(p,k,NULL);
+	Atoms d;
+	Decode(p,k,&d);
+	return Out(refi,k,&d);
+}
+
+void poolseries::Set(const poolkey &key,AtomList *data,bool over)
+{
+	if(!key.Single() || !CanbeFloat(key[0])) {
+		if(data) {
+			post("pool - series: key must be numeric, value not stored");
+			delete data;
+		}
+		return;
+	}
+
+	double t = GetAFloat(key[0]);
+	if(chunks.empty() || t > chunks.back()->last) {
+		// fast path: append
+		if(data) {
+			Append(t,*data);
+			delete data;
+		}
+		return;
+	}
+
+	int ci = Find(t);
+	if(ci < 0) ci = 0;
+	// between two chunks, the following one may take it if the preceding one is thinned
+	else if(t > chunks[ci]->last && chunks[ci]->level && ci+1 < (int)chunks.size() && !chunks[ci+1]->level) ++ci;
+
+	unpacked u;
+	Unpack(ci,u);
+	size_t i = lower_bound(u.keys.begin(),u.keys.end(),t)-u.keys.begin();
+	if(i < u.keys.size() && u.keys[i] == t) {
+		if(!over) {
+			if(data) delete data;
+			return;
+		}
+		if(data)
+			u.vals[i] = *data;
+		else {
+			u.keys.erase(u.keys.begin()+i);
+			u.vals.erase(u.vals.begin()+i);
+		}
+	}
+	else if(data) {
+		if(chunks[ci]->level) {
+			post("pool - series: key lies within thinned out values, value not stored");
+			delete data;
+			return;
+		}
+		u.keys.insert(u.keys.begin()+i,t);
+		u.vals.insert(u.vals.begin()+i,Atoms(*data));
+	}
+	else
+		return;
+
+	Repack(ci,u,chunks[ci]->level);
+	if(data) delete data;
+}
+
+bool poolseries::Seti(int ix,AtomList *data)
+{
+	int cix,ci = FindIx(ix,cix);
+	if(ci < 0) return false;
+
+	unpacked u;
+	Unpack(ci,u);
+	if(data) {
+		u.vals[cix] = *data;
+		delete data;
+	}
+	else {
+		u.keys.erase(u.keys.begin()+cix);
+		u.vals.erase(u.vals.begin()+cix);
+	}
+	Repack(ci,u,chunks[ci]->level);
+	return true;
+}
+
+poolval *poolseries::Cuti(int ix)
+{
+	int cix,ci = FindIx(ix,cix);
+	if(ci < 0) return NULL;
+
+	unpacked u;
+	Unpack(ci,u);
+	t_atom k; SetFloat(k,(t_float)u.keys[cix]);
+	poolval *ret = new poolval(k,new Atoms(u.vals[cix]));
+	u.keys.erase(u.keys.begin()+cix);
+	u.vals.erase(u.vals.begin()+cix);
+	Repack(ci,u,chunks[ci]->level);
+	return ret;
+}
+
+poolval *poolseries::Cut(const poolkey &key)
+{
+	if(!key.Single() || !CanbeFloat(key[0])) return NULL;
+	double t = GetAFloat(key[0]);
+	int ci = Find(t);
+	if(ci < 0) return NULL;
+
+	unpacked u;
+	Unpack(ci,u);
+	size_t i = lower_bound(u.keys.begin(),u.keys.end(),t)-u.keys.begin();
+	if(i >= u.keys.size() || u.keys[i] != t) return NULL;
+
+	poolval *ret = new poolval(key,new Atoms(u.vals[i]));
+	u.keys.erase(u.keys.begin()+i);
+	u.vals.erase(u.vals.begin()+i);
+	Repack(ci,u,chunks[ci]->level);
+	return ret;
+}
+
+void poolseries::Seek(iterval &it) const
+{
+	it.gen = gen;
+	it.ci = Find(it.k);
+	it.n = 0;
+	it.pos = 0;
+	if(it.ci < 0) {
+		// all keys are past it
+		it.ci = 0;
+		return;
+	}
+
+	const chunk &c = *chunks[it.ci];
+	const unsigned char *p = &c.bytes[0];
+	double k = c.first;
+	for(; it.n < c.cnt; ++it.n) {
+		double nk = k;
+		const unsigned char *np = Decode(p,nk,NULL);
+		if(nk > it.k) break;
+		p = np,k = nk;
+	}
+	it.pos = p-&c.bytes[0];
+	it.k = k;
+}
+
+poolval *poolseries::Next(const poolval *v) const
+{
+	iterval *it;
+	if(v) {
+		it = &its[static_cast<const iterval *>(v)-its];
+		// chunks have been replaced since
+		if(it->gen != gen) Seek(*it);
+	}
+	else {
+		it = its;
+		for(int i = 1; i < iterations; ++i)
+			if(its[i].use < it->use) it = its+i;
+		it->ci = it->n = 0;
+		it->pos = 0;
+		it->gen = gen;
+	}
+	it->use = ++ituse;
+
+	while(it->ci < (int)chunks.size() && it->n >= chunks[it->ci]->cnt) ++it->ci,it->n = 0,it->pos = 0;
+	if(it->ci >= (int)chunks.size()) return NULL;
+
+	const chunk &c = *chunks[it->ci];
+	if(!it->n) it->k = c.first;
+
+	if(!it->data) it->data = new Atoms;
+	it->pos = Decode(&c.bytes[it->pos],it->k,it->data)-&c.bytes[0];
+	++it->n;
+	SetFloat(it->key,(t_float)it->k);
+	return it;
+}
+
+/* chunk as list of atoms:
+   level, count, keys..., then count and atoms for each value
+   keys are absolute, they all came from atoms and are exact as such (steps summed up in t_float would not be)
+*/
+
+void poolseries::GetChunk(int ci,AtomList &l) const
+{
+	unpacked u;
+	Unpack(ci,u);
+	int n = (int)u.keys.size(),sz = 2+n;
+	for(int i = 0; i < n; ++i) sz += 1+u.vals[i].Count();
+
+	l(sz);
+	int o = 0;
+	SetInt(l[o++],chunks[ci]->level);
+	SetInt(l[o++],n);
+	for(int i = 0; i < n; ++i) 
+		SetFloat(l[o++],(t_float)u.keys[i]);
+	for(int i = 0; i < n; ++i) {
+		const Atoms &d = u.vals[i];
+		SetInt(l[o++],d.Count());
+		for(int j = 0; j < d.Count(); ++j) SetAtom(l[o++],d[j]);
+	}
+}
+
+bool poolseries::AddChunk(const AtomList &l)
+{
+	int sz = l.Count();
+	if(sz < 2 || !CanbeInt(l[0]) || !CanbeInt(l[1])) return false;
+	int level = GetAInt(l[0]),n = GetAInt(l[1]);
+	if(n < 0 || sz < 2+n) return false;
+
+	unpacked u;
+	u.keys.resize(n);
+	u.vals.resize(n);
+	int o = 2+n;
+	for(int i = 0; i < n; ++i) {
+		if(!CanbeFloat(l[2+i])) return false;
+		u.keys[i] = GetAFloat(l[2+i]);
+
+		if(o >= sz || !CanbeInt(l[o])) return false;
+		int dn = GetAInt(l[o++]);
+		if(dn < 0 || o+dn > sz) return false;
+		u.vals[i](dn,l.Atoms()+o);
+		o += dn;
+	}
+
+	if(!n) return true;
+
+	bool sorted = true;
+	for(int i = 1; i < n && sorted; ++i) sorted = u.keys[i] > u.keys[i-1];
+
+	if(sorted && (chunks.empty() || u.keys[0] > chunks.back()->last)) {
+		// take over chunk as a whole
+		chunks.push_back(new chunk);
+		Repack((int)chunks.size()-1,u,level);
+	}
+	else {
+		for(int i = 0; i < n; ++i) {
+			t_atom k; SetFloat(k,(t_float)u.keys[i]);
+			Set(k,new Atoms(u.vals[i]),true);
+		}
+	}
+	return true;
+}
+
+
+poolstore *poolstore::New(int argc,const t_atom *argv,int vbits)
+{
+	const char *m = argc?GetAString(argv[0]):"hash";
+	if(!m)
+		return NULL;
+	else if(!strcmp(m,"hash"))
+		return argc <= 1?new poolhash(vbits):NULL;
+	else if(!strcmp(m,"array"))
+		return argc <= 1?new poolhash(vbits,true):NULL;
+	else if(!strcmp(m,"fifo")) {
+		int max = 0;
+		if(argc >= 2) {
+			if(!CanbeInt(argv[1]) || (max = GetAInt(argv[1])) < 0) return NULL;
+		}
+		return argc <= 2?new poolfifo(max):NULL;
+	}
+	else if(!strcmp(m,"series")) {
+		// chunk size, full-resolution chunks, thinning factor
+		int prm[3] = { 256,0,1 };
+		if(argc > 4) return NULL;
+		for(int i = 1; i < argc; ++i) {
+			if(!CanbeInt(argv[i]) || (prm[i-1] = GetAInt(argv[i])) < 0) return NULL;
+		}
+		if(prm[0] < 1 || prm[2] < 1) return NULL;
+		return new poolseries(prm[0],prm[1],prm[2]);
+	}
+	else
+		return NULL;
+}
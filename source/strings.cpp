@@ -0,0 +1,160 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <stdlib.h>
+
+using namespace std;
+
+
+/* pool-owned strings
+
+   Symbols of the system are never freed, and each one makes later lookups in its table slower.
+   With the "ownstrings" attribute set, symbols in values loaded from files are kept here instead,
+   in a table of their own, counted by the values (poolval) holding them.
+   They look like symbols, marked by their s_thing, so that values can hold them as atoms,
+   and are only made real symbols when values are output (or packed into series).
+   Unused strings are freed from a timer, so that copies of values being output stay valid
+   while the pool is changed in the meantime.
+   Only used from the main thread.
+*/
+
+struct poolstr
+{
+	t_symbol sym;
+	poolstr *nxt;
+	unsigned long hash;
+	int refs;
+	// in the list of strings to check for freeing
+	bool dead;
+	char name[1];
+};
+
+bool poolstrings::active = false;
+size_t poolstrings::live = 0;
+char poolstrings::mark = 0;
+
+// hash table of the strings (size is a power of 2)
+static vector<poolstr *> table;
+static vector<poolstr *> dead;
+static flext::Timer *sweeper = NULL;
+
+static unsigned long StrHash(const char *s,size_t n)
+{
+	// FNV-1a
+	unsigned long h = 2166136261UL;
+	for(size_t i = 0; i < n; ++i) h = (h^(unsigned char)s[i])*16777619UL;
+	return h;
+}
+
+static void Dead(poolstr *s)
+{
+	if(s->dead) return;
+	s->dead = true;
+	dead.push_back(s);
+
+	if(!sweeper) {
+		sweeper = new flext::Timer;
+		sweeper->SetCallback(poolstrings::Sweep);
+	}
+	if(dead.size() == 1) sweeper->Delay(0);
+}
+
+void poolstrings::Set(t_atom &a,const char *s)
+{
+	if(!active) {
+		SetString(a,s);
+		return;
+	}
+
+	size_t n = strlen(s);
+	unsigned long h = StrHash(s,n);
+	if(table.empty()) table.resize(1024,NULL);
+
+	poolstr **b = &table[h&(table.size()-1)];
+	poolstr *p;
+	for(p = *b; p; p = p->nxt)
+		if(p->hash == h && !strcmp(p->name,s)) break;
+
+	if(!p) {
+		p = (poolstr *)malloc(sizeof(poolstr)+n);
+		memset(&p->sym,0,sizeof p->sym);
+		memcpy(p->name,s,n+1);
+		p->sym.s_name = p->name;
+		SetThing(&p->sym,&mark);
+		p->hash = h;
+		p->refs = 0;
+		p->dead = false;
+		p->nxt = *b;
+		*b = p;
+
+		if(++live > table.size()) {
+			// grow the table, keeping the chains short
+			vector<poolstr *> nt(table.size()*2,NULL);
+			for(size_t i = 0; i < table.size(); ++i)
+				for(poolstr *q = table[i],*nx; q; q = nx) {
+					nx = q->nxt;
+					poolstr *&nb = nt[q->hash&(nt.size()-1)];
+					q->nxt = nb;
+					nb = q;
+				}
+			table.swap(nt);
+		}
+
+		// freed if no value takes it
+		Dead(p);
+	}
+
+	SetSymbol(a,&p->sym);
+}
+
+bool poolstrings::Find(const AtomList &l)
+{
+	for(int i = 0; i < l.Count(); ++i)
+		if(IsSymbol(l[i]) && Own(GetSymbol(l[i]))) return true;
+	return false;
+}
+
+void poolstrings::Real(AtomList &l)
+{
+	for(int i = 0; i < l.Count(); ++i)
+		if(IsSymbol(l[i])) SetSymbol(l[i],Real(GetSymbol(l[i])));
+}
+
+void poolstrings::Count(const AtomList &l,int inc)
+{
+	for(int i = 0; i < l.Count(); ++i) {
+		if(!IsSymbol(l[i])) continue;
+		const t_symbol *s = GetSymbol(l[i]);
+		if(!Own(s)) continue;
+
+		// the symbol is the first member
+		poolstr *p = (poolstr *)s;
+		p->refs += inc;
+		FLEXT_ASSERT(p->refs >= 0);
+		if(!p->refs) Dead(p);
+	}
+}
+
+void poolstrings::Sweep(void *)
+{
+	for(size_t i = 0; i < dead.size(); ++i) {
+		poolstr *p = dead[i];
+		p->dead = false;
+		// taken again in the meantime?
+		if(p->refs) continue;
+
+		poolstr **b = &table[p->hash&(table.size()-1)];
+		while(*b != p) b = &(*b)->nxt;
+		*b = p->nxt;
+		free(p);
+		--live;
+	}
+	dead.clear();
+}
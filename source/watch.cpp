@@ -0,0 +1,210 @@
+/*
+pool - hierarchical storage object for PD and Max/MSP
+
+Copyright (c) 2002-2025 Thomas Grill (gr@grrrr.org)
+For information on usage and redistribution, and for a DISCLAIMER OF ALL
+WARRANTIES, see the file, "license.txt," in this distribution.
+*/
+
+#include "pool.h"
+#include <string.h>
+#include <sys/stat.h>
+
+#if FLEXT_OS == FLEXT_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+/* watched files
+
+   On Linux the folder of the file is watched with inotify for the file being written or replaced
+   (editors often save to a new file and rename it), elsewhere its modification time and size are polled.
+   The new contents are parsed and compared to the previously loaded version,
+   only values and directories which differ are set in the pool, or cleared if they are gone.
+   Values changed in the pool in the meantime are left alone unless the file changes them.
+*/
+
+static const t_atom nullatom = { A_NULL };
+
+poolwatch::poolwatch():
+	tree(NULL),mtime(0),size(-1),fd(-1)
+{}
+
+poolwatch::~poolwatch()
+{
+	Close();
+}
+
+void poolwatch::Close()
+{
+	if(tree) {
+		delete tree;
+		tree = NULL;
+	}
+#if FLEXT_OS == FLEXT_OS_LINUX
+	// also removes the watch
+	if(fd >= 0) close(fd);
+#endif
+	fd = -1;
+	mtime = 0;
+	size = -1;
+}
+
+int poolwatch::Open(const char *flnm,pooldata *p)
+{
+	Close();
+	name = flnm;
+
+	size_t sl = name.find_last_of("/\\");
+	string dir = sl == string::npos?".":name.substr(0,sl?sl:1);
+	base = sl == string::npos?name:name.substr(sl+1);
+
+#if FLEXT_OS == FLEXT_OS_LINUX
+	fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+	if(fd >= 0 && inotify_add_watch(fd,dir.c_str(),IN_CLOSE_WRITE|IN_MOVED_TO) < 0) {
+		// poll instead
+		close(fd);
+		fd = -1;
+	}
+#endif
+
+	return Reload(p);
+}
+
+bool poolwatch::Changed()
+{
+#if FLEXT_OS == FLEXT_OS_LINUX
+	if(fd >= 0) {
+		bool hit = false;
+		union {
+			inotify_event ev;
+			char buf[4096];
+		} u;
+		ssize_t n;
+		while((n = read(fd,u.buf,sizeof u.buf)) > 0) {
+			for(const char *e = u.buf; e < u.buf+n; ) {
+				const inotify_event *ev = (const inotify_event *)e;
+				if((ev->mask&IN_Q_OVERFLOW) || (ev->len && base == ev->name)) hit = true;
+				e += sizeof(inotify_event)+ev->len;
+			}
+		}
+		return hit;
+	}
+#endif
+
+	struct stat st;
+	return !stat(name.c_str(),&st) && (poolcache::MTime(st) != mtime || (long long)st.st_size != size);
+}
+
+int poolwatch::Reload(pooldata *p)
+{
+	if(p->ReadOnly()) return -1;
+
+	struct stat st;
+	if(stat(name.c_str(),&st)) return -1;
+	mtime = poolcache::MTime(st);
+	size = (long long)st.st_size;
+
+	poolfile file;
+	if(!file.Open(name.c_str())) return -1;
+
+	pooldir *nt = new pooldir(nullatom,NULL,0,0);
+	bool ok;
+	if(file.Size() >= 5 && !strncmp(file.Data(),"<?xml",5))
+		ok = nt->LdDirXML(file.Data(),file.Size(),-1,true);
+	else
+		ok = nt->LdDir(file.Data(),file.Size(),-1,true);
+	if(!ok) {
+		delete nt;
+		return -1;
+	}
+
+	Atoms path;
+	int cnt = Diff(p,path,tree,nt);
+	if(tree) delete tree;
+	tree = nt;
+	return cnt;
+}
+
+static bool SameMode(pooldir *o,pooldir *n)
+{
+	Atoms om,nm;
+	o->GetMode(om);
+	n->GetMode(nm);
+	return !compare(om,nm);
+}
+
+// same values in the same order?
+// compare goes by the names of symbols, so pool-owned strings equal real symbols (ownstrings may be toggled between loads)
+static bool SameVals(pooldir *o,pooldir *n)
+{
+	if(o->CntAll() != n->CntAll()) return false;
+	for(poolval *ov = o->NextVal(NULL),*nv = n->NextVal(NULL); ov && nv; ov = o->NextVal(ov),nv = n->NextVal(nv))
+		if(compare(ov->Key(),nv->Key()) || compare(*ov->data,*nv->data)) return false;
+	return true;
+}
+
+int poolwatch::Diff(pooldata *p,Atoms &path,pooldir *o,pooldir *n)
+{
+	int cnt = 0;
+
+	if(n->GetMode() == poolstore::mode_hash && (!o || o->GetMode() == poolstore::mode_hash)) {
+		// values one by one
+		for(poolval *v = n->NextVal(NULL); v; v = n->NextVal(v)) {
+			poolval *ov = o?o->RefVal(v->Key()):NULL;
+			if(!ov || compare(*ov->data,*v->data)) {
+				p->Set(path,v->Key(),new Atoms(*v->data));
+				++cnt;
+			}
+		}
+		if(o) {
+			for(poolval *v = o->NextVal(NULL); v; v = o->NextVal(v))
+				if(!n->RefVal(v->Key())) {
+					p->Clr(path,v->Key());
+					++cnt;
+				}
+		}
+	}
+	else if(!o || !SameMode(o,n) || !SameVals(o,n)) {
+		// ordered values are replaced as a whole
+		Atoms m;
+		n->GetMode(m);
+		p->ClrAll(path,false);
+		p->SetMode(path,m);
+		for(poolval *v = n->NextVal(NULL); v; v = n->NextVal(v)) {
+			p->Set(path,v->Key(),new Atoms(*v->data));
+			++cnt;
+		}
+		if(o) cnt += o->CntAll();
+	}
+
+	pooldir **subs;
+	int sn = n->GetSub(subs);
+	for(int i = 0; i < sn; ++i) {
+		Atoms sub(path);
+		sub.Append(subs[i]->Name());
+		pooldir *od = o?o->GetDir(1,&subs[i]->Name()):NULL;
+		if(!od) {
+			p->MkDir(sub);
+			++cnt;
+		}
+		cnt += Diff(p,sub,od,subs[i]);
+	}
+	delete[] subs;
+
+	if(o) {
+		sn = o->GetSub(subs);
+		for(int i = 0; i < sn; ++i)
+			if(!n->GetDir(1,&subs[i]->Name())) {
+				Atoms sub(path);
+				sub.Append(subs[i]->Name());
+				p->RmDir(sub);
+				++cnt;
+			}
+		delete[] subs;
+	}
+	return cnt;
+}